@@ -0,0 +1,211 @@
+#include "AutoTune.h"
+
+#include <absl/log/log.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "Parallel.h"
+#include "PixelIndex.h"
+
+namespace optics {
+
+namespace {
+
+// A full density sample of the input: the points closest to a point of the input.
+struct Patch {
+    std::vector<Point> points;
+    // centers of the trial queries
+    std::vector<Vec3> queries;
+};
+
+using Neighbor = std::pair<double, size_t>;
+
+// Patches of the input, and the mean size of the epsilon-neighborhoods of randomly
+// chosen points.
+struct Sample {
+    std::vector<Patch> patches;
+    double neighbors = 0.0;
+};
+
+Sample SampleInput(Point const* points, size_t numPoints, double epsilon,
+                   AutoTuneOptions const& options) {
+    std::mt19937_64 rng{options.seed};
+    std::uniform_int_distribution<size_t> pick{0, numPoints - 1};
+    size_t const numPatches = numPoints <= options.pointsPerPatch ? 1
+                                                                   : options.numPatches;
+    size_t const size = std::min(options.pointsPerPatch, numPoints);
+    // Patches are centered on the first centers. Neighbors are counted around all of
+    // them, since patches hold too few points to count the neighbors of points in
+    // dense regions when epsilon is large.
+    size_t const numCenters = std::max(numPatches, options.densitySamples);
+    std::vector<Vec3> centers;
+    for (size_t c = 0; c < numCenters; ++c) {
+        centers.push_back(points[pick(rng)].v);
+    }
+    // Find the points closest to each patch center and the neighbors of every center
+    // with a single parallel scan of the input, keeping a max-heap of the closest
+    // points found so far per thread and patch.
+    size_t const numThreads = std::min(ResolveThreadCount(options.numThreads),
+                                       numPoints);
+    std::vector<std::vector<Neighbor>> heaps(numThreads * numPatches);
+    std::vector<size_t> counts(numThreads * numCenters, 0);
+    ParallelFor(numPoints, numThreads, [&](size_t thread, size_t begin, size_t end) {
+        std::vector<Neighbor>* const threadHeaps = &heaps[thread * numPatches];
+        size_t* const threadCounts = &counts[thread * numCenters];
+        for (size_t p = 0; p < numPatches; ++p) {
+            threadHeaps[p].reserve(size);
+        }
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t c = 0; c < numCenters; ++c) {
+                double const d = SquaredEuclidianDistance(centers[c], points[i].v);
+                threadCounts[c] += d <= epsilon;
+                if (c >= numPatches) {
+                    continue;
+                }
+                std::vector<Neighbor>& heap = threadHeaps[c];
+                if (heap.size() < size) {
+                    heap.emplace_back(d, i);
+                    std::push_heap(heap.begin(), heap.end());
+                } else if (d < heap.front().first) {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = Neighbor{d, i};
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+        }
+    });
+    Sample sample;
+    size_t neighbors = 0;
+    for (size_t count : counts) {
+        neighbors += count;
+    }
+    sample.neighbors = static_cast<double>(neighbors) / numCenters;
+    double const radius = std::sqrt(epsilon);
+    sample.patches.resize(numPatches);
+    for (size_t p = 0; p < numPatches; ++p) {
+        std::vector<Neighbor> nearest;
+        for (size_t t = 0; t < numThreads; ++t) {
+            std::vector<Neighbor>& heap = heaps[t * numPatches + p];
+            nearest.insert(nearest.end(), heap.begin(), heap.end());
+            std::vector<Neighbor>{}.swap(heap);
+        }
+        std::sort(nearest.begin(), nearest.end());
+        nearest.resize(size);
+        Patch& patch = sample.patches[p];
+        for (auto const& [d, i] : nearest) {
+            patch.points.push_back(points[i]);
+        }
+        // Query points close enough to the center that their whole neighborhood is
+        // in the patch, unless the patch is not much larger than a neighborhood.
+        double const patchRadius = std::sqrt(nearest.back().first);
+        double const inner = patchRadius - radius;
+        size_t const numQueries = std::min(options.queriesPerPatch, size);
+        size_t numInner = 0;
+        while (numInner < size && inner > 0.0 &&
+               nearest[numInner].first <= inner * inner) {
+            ++numInner;
+        }
+        if (numInner < numQueries && size < numPoints) {
+            LOG(WARNING) << fmt::format(
+                "sample patch of radius {:.3g} holds only {} queries whose "
+                "neighborhoods of radius {:.3g} it contains",
+                patchRadius, numInner, radius);
+        }
+        size_t const span = std::max(numInner, numQueries);
+        for (size_t q = 0; q < numQueries; ++q) {
+            patch.queries.push_back(points[nearest[q * span / numQueries].second].v);
+        }
+    }
+    return sample;
+}
+
+}  // namespace
+
+template <typename Index>
+IndexParameters AutoTuneIndex(Point const* points, size_t numPoints, double epsilon,
+                              AutoTuneOptions const& options) {
+    if (points == nullptr || numPoints == 0) {
+        throw std::invalid_argument("no input points provided");
+    }
+    if (!(epsilon > 0.0)) {
+        throw std::invalid_argument("epsilon must be positive");
+    }
+    if (options.numPatches == 0 || options.pointsPerPatch == 0 ||
+        options.queriesPerPatch == 0 || options.pointsPerLeaf.empty() ||
+        options.extentFactors.empty()) {
+        throw std::invalid_argument("auto-tuning needs samples and candidates");
+    }
+    using Clock = std::chrono::steady_clock;
+    Sample const sample = SampleInput(points, numPoints, epsilon, options);
+    std::vector<Patch> const& patches = sample.patches;
+    size_t numQueries = 0;
+    for (Patch const& patch : patches) {
+        numQueries += patch.queries.size();
+    }
+    // The pixel index has no leaf extent threshold.
+    std::vector<double> extentFactors = options.extentFactors;
+    if constexpr (std::is_same_v<Index, PixelIndex>) {
+        extentFactors.resize(1);
+    }
+    double const radius = std::sqrt(epsilon);
+    IndexParameters best;
+    best.predictedSeconds = std::numeric_limits<double>::infinity();
+    std::vector<Point> scratch;
+    for (size_t pointsPerLeaf : options.pointsPerLeaf) {
+        for (double factor : extentFactors) {
+            IndexParameters candidate;
+            candidate.pointsPerLeaf = pointsPerLeaf;
+            candidate.leafExtentThreshold = factor * radius;
+            double buildSeconds = 0.0;
+            double querySeconds = 0.0;
+            size_t patchPoints = 0;
+            for (Patch const& patch : patches) {
+                scratch = patch.points;
+                auto const start = Clock::now();
+                Index index{scratch.data(), scratch.size(), pointsPerLeaf,
+                            candidate.leafExtentThreshold};
+                auto const built = Clock::now();
+                for (Vec3 const& v : patch.queries) {
+                    index.inRange(v, epsilon);
+                }
+                buildSeconds += std::chrono::duration<double>(built - start).count();
+                querySeconds += std::chrono::duration<double>(Clock::now() - built)
+                                    .count();
+                patchPoints += scratch.size();
+            }
+            candidate.neighbors = sample.neighbors;
+            candidate.querySeconds = querySeconds / numQueries;
+            candidate.predictedSeconds =
+                numPoints * (buildSeconds / patchPoints + candidate.querySeconds);
+            LOG(INFO) << fmt::format(
+                "candidate {} points per leaf, leaf extent threshold {:.3g}: "
+                "{:.0f} ns per query, predicted {:.3f} s",
+                pointsPerLeaf, candidate.leafExtentThreshold,
+                1e9 * candidate.querySeconds, candidate.predictedSeconds);
+            if (candidate.predictedSeconds < best.predictedSeconds) {
+                best = candidate;
+            }
+        }
+    }
+    LOG(INFO) << fmt::format(
+        "chose {} points per leaf and leaf extent threshold {:.3g} for {:.1f} "
+        "neighbors per point: predicted {:.3f} s to build and query",
+        best.pointsPerLeaf, best.leafExtentThreshold, best.neighbors,
+        best.predictedSeconds);
+    return best;
+}
+
+template IndexParameters AutoTuneIndex<Tree>(Point const*, size_t, double,
+                                             AutoTuneOptions const&);
+template IndexParameters AutoTuneIndex<PixelIndex>(Point const*, size_t, double,
+                                                   AutoTuneOptions const&);
+
+}  // namespace optics
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Tree.h"
+
+namespace optics {
+
+// Parameters of a spatial index, as passed to the Tree, PixelIndex and BasicOptics
+// constructors, along with the costs predicted for them by AutoTuneIndex().
+struct IndexParameters {
+    size_t pointsPerLeaf = 16;
+    double leafExtentThreshold = 0.0;
+    // estimated mean number of points within epsilon of a point, itself included
+    double neighbors = 0.0;
+    // predicted time taken by a range query at epsilon, in seconds
+    double querySeconds = 0.0;
+    // predicted time taken to build the index and to query it once per point
+    double predictedSeconds = 0.0;
+};
+
+struct AutoTuneOptions {
+    // number of sample patches, and number of points in each
+    size_t numPatches = 8;
+    size_t pointsPerPatch = 20000;
+    // number of trial queries per patch and candidate
+    size_t queriesPerPatch = 500;
+    // number of points whose neighbors are counted to estimate neighborhood sizes
+    size_t densitySamples = 64;
+    // candidate numbers of points per leaf
+    std::vector<size_t> pointsPerLeaf = {4, 8, 16, 32, 64, 128, 256};
+    // candidate leaf extent thresholds, as multiples of the euclidian radius of the
+    // epsilon-neighborhoods
+    std::vector<double> extentFactors = {0.0, 0.5, 1.0, 2.0};
+    uint64_t seed = 1;
+    // 0 to use all hardware threads for sampling
+    size_t numThreads = 0;
+};
+
+// Picks the index parameters that minimize the predicted time of range queries at
+// squared euclidian distance `epsilon` around every point.
+//
+// The sky density of real catalogues varies by orders of magnitude, so the input is
+// sampled with patches of its nearest points around randomly chosen points, rather
+// than by picking points uniformly, which would lower the density. Patches are
+// therefore centered in proportion to the number of points, like the queries of
+// OPTICS. Each candidate index is built over every patch, and timed on queries
+// centered on points close to the center of the patch, whose neighborhoods are
+// within the patch. Patches fit in cache, so times are optimistic: only their
+// relative values are meaningful. The chosen parameters and the predicted costs of
+// every candidate are logged.
+//
+// Neighborhood sizes are estimated by counting the neighbors of a few random points
+// while scanning the input for patches.
+//
+// Works with Tree and PixelIndex, which ignores leaf extent thresholds.
+template <typename Index>
+IndexParameters AutoTuneIndex(Point const* points, size_t numPoints, double epsilon,
+                              AutoTuneOptions const& options = {});
+
+}  // namespace optics
@@ -0,0 +1,94 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "AutoTune.h"
+#include "PixelIndex.h"
+#include "SkyGenerator.h"
+#include "TestCatalog.h"
+#include "Tree.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+// Returns a catalogue of large clusters and abundant noise.
+TestCatalog MakeSky(size_t numPoints) {
+    SkyGeneratorConfig config = TestCatalogConfig(numPoints);
+    config.seed = 11;
+    config.numClusters = 50;
+    config.noiseFraction = 0.2;
+    config.minClusterSigma = 5.0 / 3600.0;
+    config.maxClusterSigma = 60.0 / 3600.0;
+    return TestCatalog{config};
+}
+
+// Returns the mean number of points within epsilon of a randomly chosen point.
+double MeanNeighbors(std::vector<Point> const& points, double epsilon) {
+    std::mt19937_64 rng{5};
+    std::uniform_int_distribution<size_t> pick{0, points.size() - 1};
+    size_t neighbors = 0;
+    size_t const numQueries = 200;
+    for (size_t q = 0; q < numQueries; ++q) {
+        Vec3 const& v = points[pick(rng)].v;
+        for (Point const& p : points) {
+            neighbors += SquaredEuclidianDistance(v, p.v) <= epsilon;
+        }
+    }
+    return static_cast<double>(neighbors) / numQueries;
+}
+
+TEST(AutoTuneTest, PicksCandidateParameters) {
+    TestCatalog const sky = MakeSky(100000);
+    std::vector<Point> const& points = sky.points;
+    double const epsilon = SquaredEuclidianDistance(20.0 / 3600.0);
+    AutoTuneOptions options;
+    options.numPatches = 4;
+    options.pointsPerPatch = 10000;
+    options.queriesPerPatch = 200;
+    IndexParameters const tree = AutoTuneIndex<Tree>(points.data(), points.size(),
+                                                      epsilon, options);
+    EXPECT_THAT(options.pointsPerLeaf, testing::Contains(tree.pointsPerLeaf));
+    std::vector<double> thresholds;
+    for (double factor : options.extentFactors) {
+        thresholds.push_back(factor * std::sqrt(epsilon));
+    }
+    EXPECT_THAT(thresholds, testing::Contains(tree.leafExtentThreshold));
+    EXPECT_GT(tree.querySeconds, 0.0);
+    EXPECT_GT(tree.predictedSeconds, points.size() * tree.querySeconds);
+    // Patches are centered on random points, so they sample neighborhood sizes like
+    // the queries of OPTICS do.
+    double const expected = MeanNeighbors(points, epsilon);
+    EXPECT_GT(tree.neighbors, 0.5 * expected);
+    EXPECT_LT(tree.neighbors, 2.0 * expected);
+
+    IndexParameters const pixels = AutoTuneIndex<PixelIndex>(
+        points.data(), points.size(), epsilon, options);
+    EXPECT_THAT(options.pointsPerLeaf, testing::Contains(pixels.pointsPerLeaf));
+    EXPECT_EQ(pixels.leafExtentThreshold, 0.0);
+    EXPECT_DOUBLE_EQ(pixels.neighbors, tree.neighbors);
+}
+
+TEST(AutoTuneTest, SmallInputs) {
+    TestCatalog const sky = MakeSky(500);
+    std::vector<Point> const& points = sky.points;
+    double const epsilon = SquaredEuclidianDistance(60.0 / 3600.0);
+    IndexParameters const parameters = AutoTuneIndex<Tree>(points.data(),
+                                                           points.size(), epsilon);
+    EXPECT_GE(parameters.neighbors, 1.0);
+    EXPECT_THROW(AutoTuneIndex<Tree>(points.data(), 0, epsilon), std::invalid_argument);
+    EXPECT_THROW(AutoTuneIndex<Tree>(points.data(), points.size(), 0.0),
+                 std::invalid_argument);
+    AutoTuneOptions options;
+    options.pointsPerLeaf.clear();
+    EXPECT_THROW(AutoTuneIndex<Tree>(points.data(), points.size(), epsilon, options),
+                 std::invalid_argument);
+}
+
+}  // namespace
+}  // namespace optics
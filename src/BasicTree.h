@@ -0,0 +1,333 @@
+#pragma once
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Numa.h"
+#include "Stats.h"
+#include "Tree.h"
+#include "Vec3.h"
+
+namespace optics {
+
+// A 3-d tree over points stored in a caller-defined layout, such as the columns of an
+// existing catalogue, which are then indexed in place rather than copied into an
+// array of Point objects. The tree has the structure of a Tree built with
+// TreeBuilder::NTH_ELEMENT, and the same query contracts.
+//
+// The layout is described by a traits type T, which provides:
+//
+//   typename T::Points
+//       A handle to the points, such as a pointer to an array, copied by the tree.
+//   static double T::coord(Points const& points, size_t i, size_t dim)
+//   static Vec3 T::position(Points const& points, size_t i)
+//       The coordinates of the i-th point, a unit vector.
+//   static void T::swap(Points& points, size_t i, size_t j)
+//       Exchanges the i-th and j-th points, along with any data that must follow
+//       them. Building the tree reorders the points with swaps.
+//   static void T::setDist(Points& points, size_t i, double dist)
+//   static void T::setNext(Points& points, size_t i, size_t next)
+//       Stores the distance of the i-th point to a query point, and the index of the
+//       point following it in a list of results. Only needed by inRange().
+//
+// and optionally:
+//
+//   static void T::select(Points& points, size_t first, size_t nth, size_t last,
+//                         size_t dim)
+//       Partially orders the points in [first, last) along dimension dim, like
+//       std::nth_element. By default, the points are selected with swaps.
+template <typename Traits>
+class BasicTree {
+   public:
+    using Points = typename Traits::Points;
+
+    // Creates a new 3-d tree over the given points, which are reordered. See Tree for
+    // the meaning of the parameters.
+    BasicTree(Points points, size_t numPoints, size_t pointsPerLeaf,
+              double leafExtentThreshold);
+
+    size_t size() const { return numPoints_; }
+    size_t height() const { return height_; }
+    Points const& points() const { return points_; }
+
+    // Returns range query counters accumulated since construction or the last call to
+    // resetStats(). Always zero unless compiled with OPTICS_ENABLE_STATS.
+    QueryStats const& stats() const { return stats_; }
+    void resetStats() { stats_ = QueryStats{}; }
+
+    // Locates all points within squared euclidian distance `dist` of `v`, and returns
+    // the index of the first one, or NOT_FOUND. The indexes of the remaining points
+    // are those stored with Traits::setNext(), as for Tree::inRange().
+    size_t inRange(Vec3 const& v, double dist);
+
+    // Calls fn(i, d) for every point i within squared euclidian distance d <= `dist`
+    // of the query point `v`, without modifying the points.
+    template <typename F>
+    void visitRange(Vec3 const& v, double dist, F&& fn) const {
+        VisitRange(
+            nodes(), [this](size_t i) { return Traits::position(points_, i); }, v, dist,
+            std::forward<F>(fn));
+    }
+
+    // Returns the nodes of the tree, indexed by breadth first index, and their number.
+    NodeView nodes() const { return NodeView{nodes_.data(), layout_}; }
+    size_t numNodes() const { return numNodes_; }
+
+   private:
+    Points points_;
+    size_t numPoints_;
+    size_t height_;
+    size_t numNodes_;
+    NumaArray<Node> nodes_;
+    NodeLayout layout_;
+    QueryStats stats_;
+};
+
+// Traits for arrays of Point objects, which are selected with std::nth_element.
+struct PointTraits {
+    using Points = Point*;
+
+    static double coord(Point const* points, size_t i, size_t dim) {
+        return points[i].v.coords[dim];
+    }
+    static Vec3 const& position(Point const* points, size_t i) { return points[i].v; }
+    static void swap(Point* points, size_t i, size_t j) {
+        std::swap(points[i], points[j]);
+    }
+    static void setDist(Point* points, size_t i, double dist) { points[i].dist = dist; }
+    static void setNext(Point* points, size_t i, size_t next) { points[i].next = next; }
+    static void select(Point* points, size_t first, size_t nth, size_t last,
+                       size_t dim) {
+        std::nth_element(points + first, points + nth, points + last,
+                         [dim](Point const& a, Point const& b) {
+                             return a.v.coords[dim] < b.v.coords[dim];
+                         });
+    }
+};
+
+// A catalogue stored as separate columns (structure of arrays), indexed in place with
+// BasicTree<ColumnarTraits>. Building the tree reorders the rows of every column.
+struct ColumnarPoints {
+    // A column of fixed width values, permuted along with the coordinates.
+    struct Column {
+        void* data;
+        // size of a value in bytes
+        size_t width;
+    };
+
+    // x, y and z components of the unit vector of each row
+    std::array<double*, 3> coords = {nullptr, nullptr, nullptr};
+    // Scratch columns for the results of inRange(): distance to the query point, and
+    // index of the next result. May be null if inRange() is not used.
+    double* dist = nullptr;
+    size_t* next = nullptr;
+    // other columns of the catalogue, such as record offsets or magnitudes
+    std::vector<Column> payload;
+};
+
+struct ColumnarTraits {
+    using Points = ColumnarPoints;
+
+    static double coord(ColumnarPoints const& points, size_t i, size_t dim) {
+        return points.coords[dim][i];
+    }
+    static Vec3 position(ColumnarPoints const& points, size_t i) {
+        return Vec3{points.coords[0][i], points.coords[1][i], points.coords[2][i]};
+    }
+    static void swap(ColumnarPoints& points, size_t i, size_t j) {
+        for (double* column : points.coords) {
+            std::swap(column[i], column[j]);
+        }
+        for (ColumnarPoints::Column const& column : points.payload) {
+            auto* const data = static_cast<unsigned char*>(column.data);
+            std::swap_ranges(data + i * column.width, data + (i + 1) * column.width,
+                             data + j * column.width);
+        }
+    }
+    static void setDist(ColumnarPoints& points, size_t i, double dist) {
+        points.dist[i] = dist;
+    }
+    static void setNext(ColumnarPoints& points, size_t i, size_t next) {
+        points.next[i] = next;
+    }
+};
+
+// Returns the height of a 3-d tree over numPoints points with about pointsPerLeaf
+// points per leaf.
+inline size_t TreeHeight(size_t numPoints, size_t pointsPerLeaf) {
+    size_t h = 0;
+    while (h < Tree::MAX_HEIGHT &&
+           numPoints / (static_cast<size_t>(1) << h) > pointsPerLeaf) {
+        ++h;
+    }
+    return h;
+}
+
+// Partially orders the points in [first, last) along dimension dim, such that the
+// nth point is the one that would be there if the points were sorted, and no point
+// before it is greater. Uses Traits::select() if provided, and otherwise median of
+// three quickselect.
+template <typename Traits>
+void SelectPoint(typename Traits::Points& points, size_t first, size_t nth,
+                 size_t last, size_t dim) {
+    if constexpr (requires { Traits::select(points, first, nth, last, dim); }) {
+        Traits::select(points, first, nth, last, dim);
+    } else {
+        auto coord = [&points, dim](size_t i) { return Traits::coord(points, i, dim); };
+        auto order = [&](size_t a, size_t b) {
+            if (coord(b) < coord(a)) {
+                Traits::swap(points, a, b);
+            }
+        };
+        while (last - first > 16) {
+            size_t const mid = first + ((last - first) >> 1);
+            order(first, mid);
+            order(mid, last - 1);
+            order(first, mid);
+            double const pivot = coord(mid);
+            // Hoare partition: [first, j] <= pivot <= (j, last)
+            size_t i = first - 1;
+            size_t j = last;
+            while (true) {
+                do {
+                    ++i;
+                } while (coord(i) < pivot);
+                do {
+                    --j;
+                } while (pivot < coord(j));
+                if (i >= j) {
+                    break;
+                }
+                Traits::swap(points, i, j);
+            }
+            if (nth <= j) {
+                last = j + 1;
+            } else {
+                first = j + 1;
+            }
+        }
+        // insertion sort the remaining points
+        for (size_t i = first + 1; i < last; ++i) {
+            for (size_t k = i; k > first && coord(k) < coord(k - 1); --k) {
+                Traits::swap(points, k, k - 1);
+            }
+        }
+    }
+}
+
+// Builds the breadth first node array of a 3-d tree of the given height over the
+// given points, which are reordered, by splitting every node at the median point
+// along its dimension of maximum extent.
+template <typename Traits>
+void BuildTree(typename Traits::Points& points, size_t numPoints, size_t height,
+               double leafExtentThreshold, Node* nodes) {
+    size_t node = 0;
+    size_t left = 0;
+    size_t right = numPoints;
+    size_t h = 0;
+    while (true) {
+        nodes[node].setRight(right);
+        if (h < height) {
+            // find splitting dimension
+            Vec3 min = {std::numeric_limits<double>::infinity(),
+                        std::numeric_limits<double>::infinity(),
+                        std::numeric_limits<double>::infinity()};
+            Vec3 max = -min;
+            for (size_t i = left; i < right; ++i) {
+                min = Min(min, Traits::position(points, i));
+                max = Max(max, Traits::position(points, i));
+            }
+            Vec3 const extents = max - min;
+            size_t dim = 0;
+            for (size_t d = 1; d < 3; ++d) {
+                if (extents.coords[d] > extents.coords[dim]) {
+                    dim = d;
+                }
+            }
+            if (extents.coords[dim] > leafExtentThreshold) {
+                nodes[node].setSplitDim(dim);
+                // find median of array
+                size_t median = left + ((right - left) >> 1);
+                SelectPoint<Traits>(points, left, median, right, dim);
+                right = median;
+                nodes[node].split = Traits::coord(points, right, dim);
+                // process left child
+                node = (node << 1) + 1;
+                ++h;
+                continue;
+            }
+            // node extent is below the subdivision limit: set right index for all right
+            // children of node as their left siblings may be valid
+            size_t h2 = h;
+            size_t c = node;
+            do {
+                c = (c << 1) + 2;
+                ++h2;
+                nodes[c].setRight(right);
+            } while (h2 < height);
+        }
+        // move up the tree until a left child is found
+        left = right;
+        for (; h > 0 && (node & 1) == 0; --h) {
+            node = (node - 1) >> 1;
+        }
+        if (h == 0) {
+            // tree construction complete!
+            break;
+        }
+        // node is now the index of a left child - process its right sibling
+        right = nodes[(node - 1) >> 1].right();
+        node += 1;
+    }
+}
+
+template <typename Traits>
+BasicTree<Traits>::BasicTree(Points points, size_t numPoints, size_t pointsPerLeaf,
+                             double leafExtentThreshold)
+    : points_(std::move(points)), numPoints_(numPoints) {
+    if (numPoints == 0) {
+        throw std::invalid_argument("no input points provided");
+    }
+    if (pointsPerLeaf == 0) {
+        throw std::invalid_argument("target number of points per leaf must be > 0");
+    }
+    height_ = TreeHeight(numPoints, pointsPerLeaf);
+    numNodes_ = (static_cast<size_t>(1) << (height_ + 1)) - 1;
+    layout_ = NodeLayout{height_ + 1, 0};
+    nodes_ = NumaArray<Node>{numNodes_, InterleaveIfLarge<Node>(numNodes_)};
+    LOG(INFO) << "building 3d tree of height " << height_ << " for " << numPoints_
+              << " points";
+    BuildTree<Traits>(points_, numPoints_, height_, leafExtentThreshold, nodes_.data());
+    LOG(INFO) << "built 3d tree";
+}
+
+template <typename Traits>
+size_t BasicTree<Traits>::inRange(Vec3 const& v, double dist) {
+    size_t head = NOT_FOUND;
+    size_t tail = NOT_FOUND;
+    OPTICS_STATS(QueryStats stats; stats.queries = 1);
+    visitRange(v, dist, [&](size_t i, double d) {
+        OPTICS_STATS(++stats.hits);
+        Traits::setDist(points_, i, d);
+        if (tail == NOT_FOUND) {
+            head = i;
+        } else {
+            Traits::setNext(points_, tail, i);
+        }
+        tail = i;
+    });
+    if (tail != NOT_FOUND) {
+        Traits::setNext(points_, tail, NOT_FOUND);
+    }
+    OPTICS_STATS(stats_ += stats);
+    return head;
+}
+
+}  // namespace optics
@@ -0,0 +1,249 @@
+#include "BubbleOptics.h"
+
+#include <absl/log/check.h>
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "Parallel.h"
+
+namespace optics {
+
+namespace {
+
+struct Summary {
+    Vec3 mean;
+    // root-mean-square distance between pairs of distinct points
+    double extent;
+};
+
+Summary Summarize(Point const *points, size_t n) {
+    Summary summary;
+    for (size_t i = 0; i < n; ++i) {
+        summary.mean += points[i].v;
+    }
+    summary.mean /= static_cast<double>(n);
+    // The mean squared distance between pairs of distinct points is 2n/(n-1) times
+    // the mean squared distance to the centroid.
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += SquaredEuclidianDistance(points[i].v, summary.mean);
+    }
+    summary.extent = n > 1 ? std::sqrt(2.0 * sum / (n - 1)) : 0.0;
+    return summary;
+}
+
+}  // namespace
+
+BubbleOptics::BubbleOptics(Point *points, size_t numPoints, size_t minNeighbors,
+                           double epsilon, double leafExtentThreshold,
+                           size_t pointsPerLeaf, size_t pointsPerBubble)
+    : points_{points},
+      numPoints_{numPoints},
+      epsilon_{std::abs(epsilon)},
+      minNeighbors_{minNeighbors},
+      pointTree_{points, numPoints, pointsPerLeaf, leafExtentThreshold},
+      reps_{summarize(pointsPerBubble)},
+      bubbleTree_{reps_.data(), reps_.size(), pointsPerLeaf, 0.0},
+      seeds_{reps_.data(), reps_.size()},
+      coreDist_(reps_.size()) {
+    if (minNeighbors == 0) {
+        throw std::invalid_argument("minimum number of neighbors must be > 0");
+    }
+    // Building the bubble tree reordered the representatives, each of which is tagged
+    // with the index of its bubble: reorder the bubbles to match.
+    std::vector<Bubble> bubbles(bubbles_.size());
+    for (size_t b = 0; b < reps_.size(); ++b) {
+        bubbles[b] = bubbles_[reps_[b].state];
+        reps_[b].state = UNPROCESSED;
+    }
+    bubbles_.swap(bubbles);
+    LOG(INFO) << "summarized " << numPoints_ << " points with " << bubbles_.size()
+              << " data bubbles";
+}
+
+std::vector<Point> BubbleOptics::summarize(size_t pointsPerBubble) {
+    // Bubbles wider than epsilon would blur the structure that OPTICS is meant to
+    // find, so the highest tree nodes that are both small and compact enough are
+    // summarized.
+    double const maxExtent = std::sqrt(epsilon_);
+    std::vector<size_t> const ends =
+        pointTree_.partition([this, pointsPerBubble, maxExtent](size_t begin,
+                                                                size_t end) {
+            return end - begin <= pointsPerBubble &&
+                   Summarize(points_ + begin, end - begin).extent <= maxExtent;
+        });
+    std::vector<Summary> summaries(ends.size());
+    ParallelFor(ends.size(), 0, [&](size_t, size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            size_t const left = b == 0 ? 0 : ends[b - 1];
+            summaries[b] = Summarize(points_ + left, ends[b] - left);
+        }
+    });
+    // A leaf can still be wider than epsilon when it straddles the boundary of a
+    // cluster, or contains points that are too sparse to be clustered: its points
+    // become bubbles of their own.
+    std::vector<Point> reps;
+    bubbles_.clear();
+    for (size_t b = 0; b < ends.size(); ++b) {
+        size_t const begin = b == 0 ? 0 : ends[b - 1];
+        Summary const &summary = summaries[b];
+        if (summary.extent <= maxExtent) {
+            size_t const n = ends[b] - begin;
+            bubbles_.push_back(Bubble{begin, ends[b], summary.extent,
+                                      std::sqrt(1.0 / n) * summary.extent});
+            reps.emplace_back().v = Normalize(summary.mean);
+            maxExtent_ = std::max(maxExtent_, summary.extent);
+        } else {
+            for (size_t i = begin; i < ends[b]; ++i) {
+                bubbles_.push_back(Bubble{i, i + 1, 0.0, 0.0});
+                reps.emplace_back().v = points_[i].v;
+            }
+        }
+    }
+    for (size_t b = 0; b < reps.size(); ++b) {
+        reps[b].state = b;
+    }
+    return reps;
+}
+
+double BubbleOptics::nnDist(size_t k, size_t b) const {
+    // Points are locally distributed over a 2-d surface, so the expected distance to
+    // the k-th nearest neighbor scales as the square root of k.
+    return std::sqrt(static_cast<double>(k) / sizeOf(b)) * bubbles_[b].extent;
+}
+
+void BubbleOptics::run(ClusterPublisher &publisher) {
+    LOG(INFO) << "clustering " << numPoints_ << " points in " << bubbles_.size()
+              << " data bubbles using OPTICS";
+    for (Point &rep : reps_) {
+        rep.reach = std::numeric_limits<double>::infinity();
+        rep.state = UNPROCESSED;
+    }
+    seeds_.clear();
+    cluster_.clear();
+    size_t const numBubbles = bubbles_.size();
+    size_t scanFrom = 0;
+    while (true) {
+        size_t b;
+        if (seeds_.empty()) {
+            // find next unprocessed bubble
+            for (b = scanFrom; b < numBubbles; ++b) {
+                if (reps_[b].state == UNPROCESSED) {
+                    scanFrom = b + 1;
+                    break;
+                }
+            }
+            if (b == numBubbles) {
+                break;
+            }
+            reps_[b].state = PROCESSED;
+            expandClusterOrder(b);
+            if (cluster_.size() > 0) {
+                publish(publisher);
+                cluster_.clear();
+            }
+            cluster_.push_back(b);
+        } else {
+            // expand cluster around seed with smallest reachability-distance
+            b = seeds_.pop();
+            expandClusterOrder(b);
+            DCHECK(reps_[b].reach != std::numeric_limits<double>::infinity());
+            cluster_.push_back(b);
+        }
+    }
+    publish(publisher);
+    LOG(INFO) << "finished clustering";
+}
+
+void BubbleOptics::expandClusterOrder(size_t b) {
+    Bubble const &bubble = bubbles_[b];
+    double const eps = std::sqrt(epsilon_);
+    // Any bubble within epsilon of b has a representative within this distance of
+    // the representative of b.
+    double const radius = eps + bubble.extent + maxExtent_;
+    size_t j = bubbleTree_.inRange(reps_[b].v, radius * radius);
+    neighbors_.clear();
+    while (j != NOT_FOUND) {
+        Point const *p = reps_.data() + j;
+        if (j != b) {
+            Bubble const &other = bubbles_[j];
+            double const gap = std::sqrt(p->dist) - bubble.extent - other.extent;
+            double const d = gap >= 0.0
+                                 ? gap + bubble.nnDist1 + other.nnDist1
+                                 : std::max(bubble.nnDist1, other.nnDist1);
+            if (d <= eps) {
+                neighbors_.push_back(Neighbor{d, j});
+            }
+        }
+        j = p->next;
+    }
+    // The core-distance is the estimated distance to the k-th nearest neighbor of a
+    // point in b: either inside b itself, or inside the closest neighboring bubble at
+    // which the cumulative point count reaches k.
+    size_t const k = minNeighbors_;
+    size_t count = sizeOf(b) - 1;
+    double coreDist = std::numeric_limits<double>::infinity();
+    if (count >= k) {
+        coreDist = nnDist(k, b);
+    } else {
+        std::sort(neighbors_.begin(), neighbors_.end());
+        for (Neighbor const &nb : neighbors_) {
+            size_t const n = sizeOf(nb.index);
+            if (count + n >= k) {
+                coreDist = nb.dist + nnDist(k - count, nb.index);
+                break;
+            }
+            count += n;
+        }
+    }
+    if (coreDist > eps) {
+        coreDist = std::numeric_limits<double>::infinity();
+    }
+    coreDist_[b] = coreDist;
+    if (coreDist == std::numeric_limits<double>::infinity()) {
+        return;
+    }
+    // b is a core-object. Update reachability-distance of all bubbles in its
+    // epsilon-neighborhood. Seeds are ordered by squared distances, as for Optics.
+    for (Neighbor const &nb : neighbors_) {
+        if (reps_[nb.index].state != PROCESSED) {
+            double const reach = std::max(coreDist, nb.dist);
+            seeds_.update(nb.index, reach * reach);
+        }
+    }
+}
+
+void BubbleOptics::publish(ClusterPublisher &publisher) {
+    if (cluster_.size() == 1 &&
+        coreDist_[cluster_[0]] == std::numeric_limits<double>::infinity()) {
+        // an isolated bubble that is not a core-object: its points are noise
+        Bubble const &bubble = bubbles_[cluster_[0]];
+        for (size_t i = bubble.begin; i < bubble.end; ++i) {
+            points_[i].reach = std::numeric_limits<double>::infinity();
+            records_.assign(1, points_[i].record);
+            publisher.publish(records_);
+        }
+        return;
+    }
+    records_.clear();
+    for (size_t b : cluster_) {
+        Bubble const &bubble = bubbles_[b];
+        size_t const n = sizeOf(b);
+        double const virtualReach =
+            n > minNeighbors_ ? nnDist(minNeighbors_, b) : coreDist_[b];
+        points_[bubble.begin].reach = reps_[b].reach;
+        for (size_t i = bubble.begin; i < bubble.end; ++i) {
+            if (i != bubble.begin) {
+                points_[i].reach = virtualReach * virtualReach;
+            }
+            records_.push_back(points_[i].record);
+        }
+    }
+    publisher.publish(records_);
+}
+
+}  // namespace optics
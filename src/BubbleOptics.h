@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "ClusterPublisher.h"
+#include "SeedList.h"
+#include "Tree.h"
+
+namespace optics {
+
+// Approximates the OPTICS algorithm by clustering "data bubbles" rather than points.
+// For details, see the following paper:
+//
+// "Data Bubbles: Quality Preserving Performance Boosting for Hierarchical Clustering".
+// Markus M. Breunig, Hans-Peter Kriegel, Peer Kroger, Jorg Sander (2001).
+// ACM SIGMOD international conference on Management of data.
+// ACM Press. pp. 79-90.
+//
+// The points are partitioned by the nodes of a 3-d tree, each of which is a spatially
+// compact, contiguous range of points. Every node with at most pointsPerBubble points
+// and an extent (the root-mean-square distance between pairs of its points) of at
+// most epsilon is summarised by a bubble holding a representative (the normalized
+// centroid of its points), a point count and the extent. Points in leaves that are
+// wider than epsilon become bubbles of their own. OPTICS is then run over the bubbles
+// using the bubble distance and core-distance from the paper, and the resulting
+// cluster ordering is expanded back to the member points.
+//
+// The cost of clustering is roughly proportional to the number of bubbles rather than
+// the number of points, so this is much faster than Optics for dense catalogues, at
+// the cost of cluster boundaries that are only resolved to the scale of a bubble.
+class BubbleOptics {
+   public:
+    // - leafExtentThreshold:  As for Optics, used to build the 3-d tree over the
+    //                         points.
+    // - pointsPerLeaf:        Target # of points (bubbles) per leaf of the 3-d trees
+    //                         over the points (bubble representatives).
+    // - pointsPerBubble:      Maximum # of points per bubble.
+    BubbleOptics(Point* points, size_t numPoints, size_t minNeighbors, double epsilon,
+                 double leafExtentThreshold, size_t pointsPerLeaf,
+                 size_t pointsPerBubble);
+
+    // The tree and seed list over the representatives point into reps_.
+    BubbleOptics(BubbleOptics const&) = delete;
+    BubbleOptics(BubbleOptics&&) = delete;
+    BubbleOptics& operator=(BubbleOptics const&) = delete;
+    BubbleOptics& operator=(BubbleOptics&&) = delete;
+
+    // Clusters the points. Each cluster is published as the records of its member
+    // points, with the points of a bubble contiguous. As for Optics, points that are
+    // not density-reachable from any other point are published as clusters of size 1.
+    //
+    // On return, the reachability-distance of the first point of each bubble is the
+    // reachability-distance of the bubble, and that of the remaining points is the
+    // virtual reachability-distance of the bubble: an estimate of the distance of a
+    // point to its nearest neighbors inside the bubble.
+    void run(ClusterPublisher& publisher);
+
+    size_t numBubbles() const { return bubbles_.size(); }
+    size_t minNeighbors() const { return minNeighbors_; }
+    double epsilon() const { return epsilon_; }
+
+   private:
+    struct Bubble {
+        // index of the first and one past the last member point
+        size_t begin;
+        size_t end;
+        // root-mean-square distance between pairs of member points
+        double extent;
+        // estimated distance of a member point to its nearest neighbor
+        double nnDist1;
+    };
+
+    struct Neighbor {
+        double dist;
+        size_t index;
+
+        bool operator<(Neighbor const& other) const { return dist < other.dist; }
+    };
+
+    Point* points_;  // unowned
+    size_t numPoints_;
+    double epsilon_;
+    size_t minNeighbors_;
+    Tree pointTree_;
+    std::vector<Bubble> bubbles_;
+    double maxExtent_ = 0.0;
+    // bubble representatives, in the same order as bubbles_ once construction is
+    // complete
+    std::vector<Point> reps_;
+    Tree bubbleTree_;
+    SeedList seeds_;
+    // core-distance of each bubble (a euclidian, not squared euclidian, distance)
+    std::vector<double> coreDist_;
+    std::vector<Neighbor> neighbors_;
+    std::vector<size_t> cluster_;
+    std::vector<char const*> records_;
+
+    std::vector<Point> summarize(size_t pointsPerBubble);
+    size_t sizeOf(size_t b) const { return bubbles_[b].end - bubbles_[b].begin; }
+    double nnDist(size_t k, size_t b) const;
+    void expandClusterOrder(size_t b);
+    void publish(ClusterPublisher& publisher);
+};
+
+}  // namespace optics
@@ -0,0 +1,98 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BubbleOptics.h"
+#include "ClusterPublisher.h"
+#include "Optics.h"
+#include "SkyGenerator.h"
+#include "TestCatalog.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+// Assigns a label to every record, equal to the index of the cluster containing it.
+struct LabelingPublisher : ClusterPublisher {
+    char const* base;
+    std::vector<int64_t> labels;
+    int64_t numClusters = 0;
+
+    LabelingPublisher(char const* base, size_t numRecords)
+        : base{base}, labels(numRecords, -1) {}
+
+    void publish(std::vector<char const*> const& cluster) override {
+        for (char const* record : cluster) {
+            labels[record - base] = numClusters;
+        }
+        ++numClusters;
+    }
+};
+
+// Returns the adjusted Rand index of two labelings of the same items: 1 for identical
+// partitions, and 0 in expectation for independent random partitions.
+double AdjustedRandIndex(std::vector<int64_t> const& a, std::vector<int64_t> const& b) {
+    auto pairs = [](double n) { return 0.5 * n * (n - 1.0); };
+    std::map<std::pair<int64_t, int64_t>, size_t> joint;
+    std::map<int64_t, size_t> rows;
+    std::map<int64_t, size_t> cols;
+    for (size_t i = 0; i < a.size(); ++i) {
+        ++joint[{a[i], b[i]}];
+        ++rows[a[i]];
+        ++cols[b[i]];
+    }
+    double index = 0.0;
+    double rowPairs = 0.0;
+    double colPairs = 0.0;
+    for (auto const& [key, n] : joint) {
+        index += pairs(n);
+    }
+    for (auto const& [key, n] : rows) {
+        rowPairs += pairs(n);
+    }
+    for (auto const& [key, n] : cols) {
+        colPairs += pairs(n);
+    }
+    double const expected = rowPairs * colPairs / pairs(a.size());
+    double const max = 0.5 * (rowPairs + colPairs);
+    return max == expected ? 1.0 : (index - expected) / (max - expected);
+}
+
+TEST(BubbleOpticsTest, AdjustedRandIndex) {
+    EXPECT_DOUBLE_EQ(AdjustedRandIndex({0, 0, 1, 1}, {5, 5, 3, 3}), 1.0);
+    EXPECT_LT(AdjustedRandIndex({0, 0, 1, 1}, {0, 1, 0, 1}), 0.0);
+}
+
+// Compares the approximate clustering to the exact one. The speed-up is measured by
+// BM_Clustering in optics-bench.
+TEST(BubbleOpticsTest, AgreesWithOptics) {
+    SkyGeneratorConfig config = TestCatalogConfig(20000);
+    config.seed = 11;
+    config.numClusters = config.numPoints / 100;
+    TestCatalog catalog{config};
+    size_t const n = catalog.points.size();
+
+    std::vector<Point> points = catalog.points;
+    LabelingPublisher exact{catalog.records.data(), n};
+    Optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(exact);
+
+    points = catalog.points;
+    LabelingPublisher approx{catalog.records.data(), n};
+    BubbleOptics bubbles{points.data(), n, MinNeighbors, Epsilon, 0.0, 16, 256};
+    bubbles.run(approx);
+
+    EXPECT_LT(bubbles.numBubbles(), n / 4);
+    EXPECT_THAT(approx.labels, testing::Each(testing::Ge(0)));
+    double const ari = AdjustedRandIndex(exact.labels, approx.labels);
+    RecordProperty("AdjustedRandIndex", std::to_string(ari));
+    EXPECT_GT(ari, 0.95);
+}
+
+}  // namespace
+}  // namespace optics
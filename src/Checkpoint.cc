@@ -0,0 +1,257 @@
+#include "Checkpoint.h"
+
+#include <absl/cleanup/cleanup.h>
+#include <absl/log/log.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace optics {
+
+namespace {
+
+constexpr char MAGIC[8] = {'O', 'P', 'T', 'I', 'C', 'S', 'C', 'K'};
+constexpr uint64_t VERSION = 2;
+
+struct FileHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t pointSize;
+    OrderingState state;
+};
+
+// Writes the given buffers to a file descriptor, retrying on partial writes. Only
+// calls async-signal-safe functions, as it runs in a forked child.
+bool WriteAll(int fd, struct ::iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = ::writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t written = static_cast<size_t>(n);
+        while (iovcnt > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Writes a checkpoint to a temporary file, syncs it, and renames it over the
+// checkpoint file. Only calls async-signal-safe functions, as it runs in a forked
+// child.
+bool WriteCheckpointFile(char const* tmpPath, char const* path, struct ::iovec* iov,
+                         int iovcnt) {
+    int fd = ::open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    bool ok = WriteAll(fd, iov, iovcnt) && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    return ok && ::rename(tmpPath, path) == 0;
+}
+
+void ReadAll(int fd, void* data, size_t size, char const* path) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(
+                fmt::format("failed to read {}: errno={}", path, errno));
+        }
+        if (n == 0) {
+            throw std::runtime_error(fmt::format("checkpoint {} is truncated", path));
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+FileHeader ReadHeader(int fd, char const* path) {
+    FileHeader header;
+    ReadAll(fd, &header, sizeof(header), path);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION || header.pointSize != sizeof(Point)) {
+        throw std::runtime_error(
+            fmt::format("{} is not a compatible OPTICS checkpoint", path));
+    }
+    return header;
+}
+
+int OpenForReading(char const* path) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error(
+            fmt::format("failed to open {}: errno={}", path, errno));
+    }
+    return fd;
+}
+
+}  // namespace
+
+CheckpointWriter::CheckpointWriter(std::filesystem::path const& path)
+    : path_{path.string()}, tmpPath_{path.string() + ".tmp"} {}
+
+CheckpointWriter::~CheckpointWriter() { wait(); }
+
+bool CheckpointWriter::write(OrderingState const& state, Point const* points,
+                             size_t const* heap, size_t const* cluster) {
+    if (child_ != -1 && !reap(false)) {
+        // previous checkpoint still in progress
+        return false;
+    }
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.pointSize = sizeof(Point);
+    header.state = state;
+    struct ::iovec iov[4] = {
+        {&header, sizeof(header)},
+        {const_cast<Point*>(points), state.numPoints * sizeof(Point)},
+        {const_cast<size_t*>(heap), state.seedListSize * sizeof(size_t)},
+        {const_cast<size_t*>(cluster), state.clusterSize * sizeof(size_t)},
+    };
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        // child process: the parent's memory is a copy-on-write snapshot
+        bool ok = WriteCheckpointFile(tmpPath_.c_str(), path_.c_str(), iov, 4);
+        ::_exit(ok ? 0 : 1);
+    }
+    if (pid == -1) {
+        LOG(WARNING) << "fork failed (errno=" << errno
+                     << "), writing checkpoint synchronously";
+        failed_ = !WriteCheckpointFile(tmpPath_.c_str(), path_.c_str(), iov, 4);
+        if (failed_) {
+            LOG(ERROR) << "failed to write checkpoint " << path_ << ": errno="
+                       << errno;
+        }
+        return true;
+    }
+    child_ = pid;
+    return true;
+}
+
+bool CheckpointWriter::wait() {
+    if (child_ != -1) {
+        reap(true);
+    }
+    return !failed_;
+}
+
+bool CheckpointWriter::reap(bool block) {
+    int status = 0;
+    pid_t pid;
+    do {
+        pid = ::waitpid(child_, &status, block ? 0 : WNOHANG);
+    } while (pid == -1 && errno == EINTR);
+    if (pid == 0) {
+        return false;
+    }
+    child_ = -1;
+    failed_ = pid == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    if (failed_) {
+        LOG(ERROR) << "failed to write checkpoint " << path_;
+    }
+    return true;
+}
+
+OrderingState ReadCheckpointState(std::filesystem::path const& path) {
+    int fd = OpenForReading(path.c_str());
+    absl::Cleanup const closer = [fd] { ::close(fd); };
+    return ReadHeader(fd, path.c_str()).state;
+}
+
+OrderingState ReadCheckpoint(std::filesystem::path const& path, Point* points,
+                             size_t numPoints, size_t* heap,
+                             std::vector<size_t>& cluster) {
+    constexpr size_t CHUNK_SIZE = 4096;
+
+    int fd = OpenForReading(path.c_str());
+    absl::Cleanup const closer = [fd] { ::close(fd); };
+    OrderingState const state = ReadHeader(fd, path.c_str()).state;
+    if (state.numPoints != numPoints || state.seedListSize > numPoints ||
+        state.clusterSize > numPoints || state.scanFrom > numPoints) {
+        throw std::runtime_error(fmt::format(
+            "checkpoint {} is for {} points, not {}", path.c_str(), state.numPoints,
+            numPoints));
+    }
+    // Stage the reachability-distance and state of each point, after checking that
+    // the checkpointed point order matches, and that states are valid. The points are
+    // only updated once the whole checkpoint has been validated.
+    auto corrupt = [&path](char const* what) {
+        return std::runtime_error(
+            fmt::format("checkpoint {} is corrupt: invalid {}", path.c_str(), what));
+    };
+    if (state.clusterStartCore > 1) {
+        throw corrupt("cluster state");
+    }
+    std::vector<double> reach(numPoints);
+    std::vector<size_t> states(numPoints);
+    size_t numSeeds = 0;
+    std::vector<Point> chunk(CHUNK_SIZE);
+    for (size_t i = 0; i < numPoints; i += CHUNK_SIZE) {
+        size_t const n = std::min(CHUNK_SIZE, numPoints - i);
+        ReadAll(fd, chunk.data(), n * sizeof(Point), path.c_str());
+        for (size_t j = 0; j < n; ++j) {
+            if (chunk[j].v != points[i + j].v) {
+                throw std::runtime_error(fmt::format(
+                    "checkpoint {} does not match the input points", path.c_str()));
+            }
+            size_t const s = chunk[j].state;
+            if (s != UNPROCESSED && s != PROCESSED) {
+                if (s >= state.seedListSize) {
+                    throw corrupt("point state");
+                }
+                ++numSeeds;
+            }
+            reach[i + j] = chunk[j].reach;
+            states[i + j] = s;
+        }
+    }
+    if (numSeeds != state.seedListSize) {
+        throw corrupt("seed list size");
+    }
+    // Every seed list entry must be a point whose state is its heap index, which
+    // makes the heap and the seed states a bijection.
+    ReadAll(fd, heap, state.seedListSize * sizeof(size_t), path.c_str());
+    for (size_t k = 0; k < state.seedListSize; ++k) {
+        if (heap[k] >= numPoints || states[heap[k]] != k) {
+            throw corrupt("seed list entry");
+        }
+    }
+    std::vector<size_t> members(state.clusterSize);
+    ReadAll(fd, members.data(), state.clusterSize * sizeof(size_t), path.c_str());
+    for (size_t i : members) {
+        if (i >= numPoints) {
+            throw corrupt("cluster member");
+        }
+    }
+    for (size_t i = 0; i < numPoints; ++i) {
+        points[i].reach = reach[i];
+        points[i].state = states[i];
+    }
+    cluster = std::move(members);
+    return state;
+}
+
+}  // namespace optics
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Tree.h"
+
+namespace optics {
+
+// Scalar state of an in-progress OPTICS cluster ordering.
+struct OrderingState {
+    uint64_t numPoints = 0;
+    uint64_t minNeighbors = 0;
+    double epsilon = 0.0;
+    // index at which to continue scanning for unprocessed points
+    uint64_t scanFrom = 0;
+    uint64_t pointsProcessed = 0;
+    uint64_t clustersPublished = 0;
+    uint64_t seedListSize = 0;
+    // number of points in the cluster being assembled
+    uint64_t clusterSize = 0;
+    // 1 if the first point of that cluster is a core-object, 0 otherwise
+    uint64_t clusterStartCore = 0;
+};
+
+// Writes checkpoints of an OPTICS cluster ordering: the scalar state, the (tree
+// ordered) point array, the seed list heap and the point indices of the partial
+// cluster.
+//
+// Checkpoints are written from a forked child process, so that the snapshot is a
+// copy-on-write view of the parent's memory and the ordering loop only stalls for
+// as long as fork() takes. The child dumps all arrays with vectored writes to a
+// temporary file that is renamed over the checkpoint once it has been synced, so a
+// crash never leaves a torn checkpoint behind. If fork() fails, the checkpoint is
+// written synchronously instead.
+class CheckpointWriter {
+   public:
+    explicit CheckpointWriter(std::filesystem::path const& path);
+
+    CheckpointWriter(CheckpointWriter const&) = delete;
+    CheckpointWriter& operator=(CheckpointWriter const&) = delete;
+
+    // Waits for any checkpoint still being written.
+    ~CheckpointWriter();
+
+    // Starts writing a checkpoint. If the previous checkpoint is still being written,
+    // nothing is done and false is returned.
+    bool write(OrderingState const& state, Point const* points, size_t const* heap,
+               size_t const* cluster);
+
+    // Waits for any checkpoint still being written, and returns false if writing the
+    // most recent checkpoint failed.
+    bool wait();
+
+   private:
+    std::string path_;
+    std::string tmpPath_;
+    pid_t child_ = -1;
+    bool failed_ = false;
+
+    // Collects the exit status of the child writing a checkpoint. Returns false if
+    // the child is still running (only possible if block is false).
+    bool reap(bool block);
+};
+
+// Reads the scalar state stored in a checkpoint.
+OrderingState ReadCheckpointState(std::filesystem::path const& path);
+
+// Restores an OPTICS cluster ordering from a checkpoint. Throws if the checkpoint is
+// not for the given points: the point coordinates must match those in the checkpoint
+// exactly and in the same order, which is the case when the 3-d tree is rebuilt
+// from the same input. Also throws if a point state, seed list entry or cluster
+// member read from the checkpoint is out of range. On success, the reach and state
+// of every point are restored, the seed list heap is copied to `heap` (which must
+// have room for numPoints entries), and the partial cluster is copied to `cluster`.
+// On failure, the points and `cluster` are left unchanged.
+OrderingState ReadCheckpoint(std::filesystem::path const& path, Point* points,
+                             size_t numPoints, size_t* heap,
+                             std::vector<size_t>& cluster);
+
+}  // namespace optics
@@ -1,14 +1,99 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
 #include <string_view>
 #include <vector>
 
+#include "Vec3.h"
+
 namespace optics {
 
+// Summary statistics of a published cluster, accumulated while the cluster is
+// ordered so that consumers need not parse its records to locate it. Distances are
+// squared euclidian distances between unit vectors, like epsilon.
+struct ClusterSummary {
+    // number of records
+    size_t size = 0;
+    // sum of the unit vectors of the records
+    Vec3 sum;
+    // normalized mean of the unit vectors of the records
+    Vec3 center;
+    // componentwise bounds of the unit vectors of the records
+    Vec3 min;
+    Vec3 max;
+    // largest distance between the center and a record, i.e. the radius of the
+    // bounding circle around the center
+    double radius = 0.0;
+    // reachability-distances of the points of the cluster other than the first,
+    // which is not reachable from the cluster; NaN for clusters of a single point
+    double minReach = std::numeric_limits<double>::quiet_NaN();
+    double maxReach = std::numeric_limits<double>::quiet_NaN();
+    double meanReach = std::numeric_limits<double>::quiet_NaN();
+
+    // Returns the angular radius of the bounding circle in degrees.
+    double radiusDegrees() const {
+        return 2.0 * DEG_PER_RAD * std::asin(std::min(1.0, 0.5 * std::sqrt(radius)));
+    }
+};
+
+// Adds `weight` records at position v to the size, sum and bounds of a summary.
+inline void AddToSummary(ClusterSummary &summary, Vec3 const &v, size_t weight = 1) {
+    if (summary.size == 0) {
+        summary.min = v;
+        summary.max = v;
+    } else {
+        summary.min = Min(summary.min, v);
+        summary.max = Max(summary.max, v);
+    }
+    summary.size += weight;
+    summary.sum = summary.sum + static_cast<double>(weight) * v;
+}
+
+// Completes a summary whose size, sum and bounds cover all of its records, which lie
+// at the n positions position(0), ..., position(n - 1): sets the center, and the
+// radius around it. The center of a single position is that position, exactly.
+template <typename F>
+void FinishSummary(ClusterSummary &summary, size_t n, F &&position) {
+    double const norm = std::sqrt(summary.sum.dot(summary.sum));
+    summary.center = n == 1       ? summary.min
+                     : norm > 0.0 ? summary.sum / norm
+                                  : summary.sum;
+    double radius = 0.0;
+    for (size_t m = 0; m < n; ++m) {
+        Vec3 const v = position(m);
+        radius = std::max(radius, SquaredEuclidianDistance(summary.center, v));
+    }
+    summary.radius = radius;
+}
+
+// Returns the summary of one record at each of the n positions position(0), ...,
+// position(n - 1). Reachability-distances are left undefined.
+template <typename F>
+ClusterSummary Summarize(size_t n, F &&position) {
+    ClusterSummary summary;
+    for (size_t m = 0; m < n; ++m) {
+        AddToSummary(summary, position(m));
+    }
+    FinishSummary(summary, n, position);
+    return summary;
+}
+
 struct ClusterPublisher {
     virtual ~ClusterPublisher() = 0;
 
     virtual void publish(std::vector<char const *> const &cluster) = 0;
+
+    // Publishes a cluster along with its summary. Publishers that use the summary
+    // override this; by default, the summary is dropped.
+    virtual void publishSummarized(std::vector<char const *> const &cluster,
+                                   ClusterSummary const & /* summary */) {
+        publish(cluster);
+    }
 };
 
+inline ClusterPublisher::~ClusterPublisher() = default;
+
 }  // namespace optics
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+namespace optics {
+
+// Retains the k smallest of the distances between a point and its neighbors in a
+// max-heap, stored in caller provided scratch space for k distances. Once every
+// neighbor has been added, the largest retained distance is the core-distance of the
+// point for minNeighbors = k.
+class CoreDistanceHeap {
+   public:
+    CoreDistanceHeap(double* heap, size_t k) : heap_{heap}, k_{k} {}
+
+    void add(double d) {
+        if (n_ < k_) {
+            heap_[n_++] = d;
+            std::push_heap(heap_, heap_ + n_);
+        } else if (heap_[0] > d) {
+            std::pop_heap(heap_, heap_ + n_);
+            heap_[n_ - 1] = d;
+            std::push_heap(heap_, heap_ + n_);
+        }
+    }
+
+    // Returns the number of retained distances, at most k.
+    size_t size() const { return n_; }
+
+    // Returns the k-th smallest distance added, or infinity if fewer than k distances
+    // were added. Must not be called after sort().
+    double coreDistance() const {
+        return n_ == k_ ? heap_[0] : std::numeric_limits<double>::infinity();
+    }
+
+    // Sorts the retained distances in increasing order, so that the m-th smallest
+    // distance is heap[m - 1] for m <= size().
+    void sort() { std::sort_heap(heap_, heap_ + n_); }
+
+   private:
+    double* heap_;
+    size_t k_;
+    size_t n_ = 0;
+};
+
+}  // namespace optics
@@ -0,0 +1,273 @@
+#include "CrossMatch.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Parallel.h"
+
+namespace optics {
+
+namespace {
+
+// Number of matches buffered per thread before they are passed to the sink
+constexpr size_t BATCH_SIZE = 4096;
+
+// Target number of node pairs per thread that the traversal is split into before
+// threads start. Threads grab pairs dynamically, which balances the load when the
+// number of matches per pair varies a lot (e.g. in clustered catalogues).
+constexpr size_t PAIRS_PER_THREAD = 64;
+
+struct Box {
+    Vec3 min;
+    Vec3 max;
+};
+
+// Returns the squared euclidian distance between the closest points of two boxes,
+// or +infinity if either box is empty.
+double SquaredDistance(Box const& a, Box const& b) {
+    double dist = 0.0;
+    for (size_t d = 0; d < 3; ++d) {
+        double const gap = std::max({a.min.coords[d] - b.max.coords[d],
+                                     b.min.coords[d] - a.max.coords[d], 0.0});
+        dist += gap * gap;
+    }
+    return dist;
+}
+
+double SquaredDistance(Box const& box, Vec3 const& v) {
+    return SquaredDistance(box, Box{v, v});
+}
+
+double SquaredDiagonal(Box const& box) {
+    return SquaredEuclidianDistance(box.min, box.max);
+}
+
+size_t Begin(NodeView nodes, size_t node) {
+    return (node & (node + 1)) != 0 ? nodes[node - 1].right() : 0;
+}
+
+// Computes the bounding box of the points in every node of a tree. Nodes below a
+// leaf (which exist when the tree stops splitting early) and empty nodes get an
+// empty box, with min = +infinity and max = -infinity.
+std::vector<Box> BoundingBoxes(Tree const& tree, size_t numThreads) {
+    double const inf = std::numeric_limits<double>::infinity();
+    NodeView const nodes = tree.nodes();
+    Point const* points = tree.getPoints();
+    size_t const numNodes = tree.numNodes();
+    std::vector<Box> boxes(numNodes, Box{Vec3{inf, inf, inf}, Vec3{-inf, -inf, -inf}});
+    // a node is reachable if its parent is a reachable internal node
+    std::vector<char> reachable(numNodes, 0);
+    reachable[0] = 1;
+    for (size_t node = 1; node < numNodes; ++node) {
+        size_t const parent = (node - 1) >> 1;
+        reachable[node] = reachable[parent] && !nodes[parent].isLeaf();
+    }
+    ParallelFor(numNodes, numThreads, [&](size_t, size_t begin, size_t end) {
+        for (size_t node = begin; node < end; ++node) {
+            if (!reachable[node] || !nodes[node].isLeaf()) {
+                continue;
+            }
+            Box& box = boxes[node];
+            for (size_t i = Begin(nodes, node); i < nodes[node].right(); ++i) {
+                box.min = Min(box.min, points[i].v);
+                box.max = Max(box.max, points[i].v);
+            }
+        }
+    });
+    for (size_t node = numNodes; node-- > 0;) {
+        if (reachable[node] && !nodes[node].isLeaf()) {
+            Box const& left = boxes[(node << 1) + 1];
+            Box const& right = boxes[(node << 1) + 2];
+            boxes[node] = Box{Min(left.min, right.min), Max(left.max, right.max)};
+        }
+    }
+    return boxes;
+}
+
+// Joins two trees, given the bounding boxes of their nodes.
+class Join {
+   public:
+    using Pair = std::pair<size_t, size_t>;
+
+    Join(Tree const& a, Tree const& b, double dist, size_t numThreads)
+        : a_{a.nodes(), a.getPoints(), BoundingBoxes(a, numThreads)},
+          b_{b.nodes(), b.getPoints(), BoundingBoxes(b, numThreads)},
+          dist_{dist} {}
+
+    // Splits the root pair into pairs of nodes until there are at least `target`
+    // of them or every remaining pair is a pair of leaves. Pruned pairs are dropped.
+    std::vector<Pair> split(size_t target) const {
+        std::vector<Pair> pairs = {{0, 0}};
+        std::vector<Pair> next;
+        bool splittable = true;
+        while (splittable && pairs.size() < target) {
+            splittable = false;
+            next.clear();
+            for (Pair const& pair : pairs) {
+                if (pruned(pair)) {
+                    continue;
+                }
+                size_t const before = next.size();
+                expand(pair, next);
+                splittable = splittable || next.size() != before;
+                if (next.size() == before) {
+                    next.push_back(pair);
+                }
+            }
+            pairs.swap(next);
+        }
+        return pairs;
+    }
+
+    // Finds all matches between the points of the given pair of nodes, and calls
+    // emit(match) for each.
+    template <typename F>
+    void run(Pair root, std::vector<Pair>& stack, F&& emit) const {
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty()) {
+            Pair const pair = stack.back();
+            stack.pop_back();
+            if (pruned(pair)) {
+                continue;
+            }
+            if (!expand(pair, stack)) {
+                compare(pair, emit);
+            }
+        }
+    }
+
+   private:
+    struct Side {
+        NodeView nodes;
+        Point const* points;
+        std::vector<Box> boxes;
+    };
+
+    Side a_;
+    Side b_;
+    double dist_;
+
+    bool pruned(Pair const& pair) const {
+        return SquaredDistance(a_.boxes[pair.first], b_.boxes[pair.second]) > dist_;
+    }
+
+    // Appends the pairs formed by splitting the larger of the two nodes of a pair
+    // into its children. Returns false, leaving `out` unchanged, if the node from `b`
+    // is a leaf: the points of such pairs are matched by compare().
+    bool expand(Pair const& pair, std::vector<Pair>& out) const {
+        auto [na, nb] = pair;
+        if (b_.nodes[nb].isLeaf()) {
+            return false;
+        }
+        if (!a_.nodes[na].isLeaf() &&
+            SquaredDiagonal(a_.boxes[na]) >= SquaredDiagonal(b_.boxes[nb])) {
+            out.emplace_back((na << 1) + 2, nb);
+            out.emplace_back((na << 1) + 1, nb);
+        } else {
+            out.emplace_back(na, (nb << 1) + 2);
+            out.emplace_back(na, (nb << 1) + 1);
+        }
+        return true;
+    }
+
+    // Matches each point of a leaf of `b` against the subtree of `a` rooted at the
+    // other node of the pair. Once the pair is down to a single leaf of `b`, a range
+    // query per point prunes better than node boxes, because it can test split
+    // planes against the point itself.
+    template <typename F>
+    void compare(Pair const& pair, F&& emit) const {
+        auto [na, nb] = pair;
+        Box const& boxA = a_.boxes[na];
+        std::array<size_t, Tree::MAX_HEIGHT + 1> stack;
+        for (size_t j = Begin(b_.nodes, nb); j < b_.nodes[nb].right(); ++j) {
+            Point const& q = b_.points[j];
+            if (SquaredDistance(boxA, q.v) > dist_) {
+                continue;
+            }
+            size_t size = 0;
+            stack[size++] = na;
+            while (size > 0) {
+                size_t const node = stack[--size];
+                Node const& n = a_.nodes[node];
+                if (n.isLeaf()) {
+                    for (size_t i = Begin(a_.nodes, node); i < n.right(); ++i) {
+                        Point const& p = a_.points[i];
+                        double const d = SquaredEuclidianDistance(p.v, q.v);
+                        if (d <= dist_) {
+                            emit(Match{p.record, q.record, d});
+                        }
+                    }
+                    continue;
+                }
+                double const qd = q.v.coords[n.splitDim()];
+                bool const near = MinSquaredEuclidianDistance(qd, n.split) <= dist_;
+                if (near || qd >= n.split) {
+                    stack[size++] = (node << 1) + 2;
+                }
+                if (near || qd < n.split) {
+                    stack[size++] = (node << 1) + 1;
+                }
+            }
+        }
+    }
+};
+
+}  // namespace
+
+size_t CrossMatch(Tree const& a, Tree const& b, double dist, MatchSink& sink,
+                  size_t numThreads) {
+    LOG(INFO) << "cross-matching " << a.size() << " and " << b.size() << " points";
+    numThreads = ResolveThreadCount(numThreads);
+    Join const join{a, b, dist, numThreads};
+    std::vector<Join::Pair> const pairs = join.split(numThreads * PAIRS_PER_THREAD);
+    std::atomic<size_t> nextPair = 0;
+    std::atomic<size_t> numMatches = 0;
+    std::mutex mutex;
+    FirstException error;
+    // one chunk per thread; pairs are handed out dynamically
+    ParallelFor(numThreads, numThreads, [&](size_t, size_t, size_t) {
+        error.run([&] {
+            std::vector<Join::Pair> stack;
+            std::vector<Match> batch;
+            batch.reserve(BATCH_SIZE);
+            size_t count = 0;
+            auto flush = [&] {
+                if (!batch.empty()) {
+                    // Record a failure of the sink before releasing the lock, so
+                    // that no batch is delivered after it.
+                    std::lock_guard<std::mutex> lock{mutex};
+                    if (!error.failed()) {
+                        error.run([&] { sink.match(batch); });
+                    }
+                }
+                count += batch.size();
+                batch.clear();
+            };
+            // stop handing out pairs once any thread has failed
+            for (size_t p = nextPair++; p < pairs.size() && !error.failed();
+                 p = nextPair++) {
+                join.run(pairs[p], stack, [&](Match const& match) {
+                    batch.push_back(match);
+                    if (batch.size() == BATCH_SIZE) {
+                        flush();
+                    }
+                });
+            }
+            flush();
+            numMatches += count;
+        });
+    });
+    error.rethrow();
+    LOG(INFO) << "found " << numMatches.load() << " matches";
+    return numMatches;
+}
+
+}  // namespace optics
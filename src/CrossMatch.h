@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "Tree.h"
+
+namespace optics {
+
+// A pair of points from two catalogues, identified by their originating records, and
+// the squared euclidian distance between their unit vectors.
+struct Match {
+    char const* a;
+    char const* b;
+    double dist;
+};
+
+// Receives the matches found by CrossMatch() in batches, in no particular order.
+// Calls are serialized, so implementations need not be thread-safe, but they may
+// come from any of the matching threads. If match() throws, the remaining work is
+// abandoned, no further batches are delivered, and CrossMatch() rethrows the first
+// exception on the calling thread once all threads have stopped.
+struct MatchSink {
+    virtual ~MatchSink() = 0;
+
+    virtual void match(std::span<Match const> matches) = 0;
+};
+
+inline MatchSink::~MatchSink() = default;
+
+// Finds all pairs of points (p, q), with p in tree `a` and q in tree `b`, such that
+// the squared euclidian distance between p and q is at most `dist`, and streams them
+// to `sink` as (p.record, q.record, distance) triples. No records or points are
+// copied, and neither tree is modified.
+//
+// The trees are traversed together: pairs of nodes whose bounding boxes are farther
+// apart than the matching distance are pruned, and only pairs of leaves that may
+// contain matches are compared point by point. The work is split over `numThreads`
+// threads (all hardware threads if 0). Returns the number of matches.
+size_t CrossMatch(Tree const& a, Tree const& b, double dist, MatchSink& sink,
+                  size_t numThreads = 0);
+
+}  // namespace optics
@@ -0,0 +1,119 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "CrossMatch.h"
+#include "LonLat.h"
+#include "Tree.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+struct CollectingSink : MatchSink {
+    std::vector<std::tuple<char const*, char const*, double>> matches;
+
+    void match(std::span<Match const> batch) override {
+        for (Match const& m : batch) {
+            matches.emplace_back(m.a, m.b, m.dist);
+        }
+    }
+};
+
+// Generates points in a small patch of sky, half of them in tight groups around the
+// given centers so that some leaves have many matches. The record of the i-th point
+// is &records[i].
+void MakeCatalog(std::mt19937_64& rng, std::vector<LonLat> const& centers,
+                 std::vector<char>& records, std::vector<Point>& points) {
+    std::uniform_int_distribution<size_t> pick{0, centers.size() - 1};
+    points.resize(records.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (i % 2 == 0) {
+            points[i].v = LonLat::random(rng, 10.0, 12.0, -1.0, 1.0);
+        } else {
+            points[i].v = centers[pick(rng)].perturb(rng, 0.001);
+        }
+        points[i].record = &records[i];
+    }
+}
+
+TEST(CrossMatchTest, MatchesBruteForce) {
+    std::mt19937_64 rng(1234);
+    std::vector<char> recordsA(20000);
+    std::vector<char> recordsB(15000);
+    std::vector<Point> pointsA;
+    std::vector<Point> pointsB;
+    std::vector<LonLat> centers;
+    for (size_t i = 0; i < 2000; ++i) {
+        centers.push_back(LonLat::random(rng, 10.0, 12.0, -1.0, 1.0));
+    }
+    MakeCatalog(rng, centers, recordsA, pointsA);
+    MakeCatalog(rng, centers, recordsB, pointsB);
+    Tree const a{pointsA.data(), pointsA.size(), 16, 0.0};
+    Tree const b{pointsB.data(), pointsB.size(), 8, 0.0};
+    double const dist = SquaredEuclidianDistance(0.005);
+
+    CollectingSink expected;
+    for (Point const& q : pointsB) {
+        a.visitRange(q.v, dist, [&](size_t i, double d) {
+            expected.matches.emplace_back(pointsA[i].record, q.record, d);
+        });
+    }
+    ASSERT_GT(expected.matches.size(), pointsB.size());
+    std::sort(expected.matches.begin(), expected.matches.end());
+
+    for (size_t numThreads : {1, 4}) {
+        CollectingSink sink;
+        size_t const n = CrossMatch(a, b, dist, sink, numThreads);
+        EXPECT_EQ(n, sink.matches.size());
+        std::sort(sink.matches.begin(), sink.matches.end());
+        EXPECT_EQ(sink.matches, expected.matches);
+    }
+}
+
+// Throws from the given call to match(), and counts the calls after that
+struct ThrowingSink : MatchSink {
+    size_t callsLeft;
+    size_t callsAfterThrowing = 0;
+
+    explicit ThrowingSink(size_t n) : callsLeft{n} {}
+
+    void match(std::span<Match const>) override {
+        if (callsLeft == 0) {
+            ++callsAfterThrowing;
+        } else if (--callsLeft == 0) {
+            throw std::runtime_error("sink failed");
+        }
+    }
+};
+
+TEST(CrossMatchTest, SinkThrows) {
+    std::mt19937_64 rng(1234);
+    std::vector<char> records(20000);
+    std::vector<Point> points;
+    std::vector<LonLat> centers;
+    for (size_t i = 0; i < 2000; ++i) {
+        centers.push_back(LonLat::random(rng, 10.0, 12.0, -1.0, 1.0));
+    }
+    MakeCatalog(rng, centers, records, points);
+    Tree const tree{points.data(), points.size(), 16, 0.0};
+    double const dist = SquaredEuclidianDistance(0.005);
+    for (size_t numThreads : {1, 4}) {
+        for (size_t calls : {1, 3}) {
+            ThrowingSink sink{calls};
+            EXPECT_THROW(CrossMatch(tree, tree, dist, sink, numThreads),
+                         std::runtime_error);
+            EXPECT_EQ(sink.callsAfterThrowing, 0);
+        }
+    }
+}
+
+}  // namespace
+}  // namespace optics
@@ -0,0 +1,134 @@
+#include "Dbscan.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "Parallel.h"
+#include "UnionFind.h"
+
+namespace optics {
+
+Dbscan::Dbscan(Point* points, size_t numPoints, size_t minNeighbors, double epsilon,
+               double leafExtentThreshold, size_t pointsPerLeaf, TreeBuilder builder)
+    : points_{points},
+      numPoints_{numPoints},
+      minNeighbors_{minNeighbors},
+      epsilon_{std::abs(epsilon)},
+      tree_{points, numPoints, pointsPerLeaf, leafExtentThreshold, builder},
+      core_(numPoints, 0) {
+    if (minNeighbors == 0) {
+        throw std::invalid_argument("minimum number of neighbors must be > 0");
+    }
+}
+
+void Dbscan::run(ClusterPublisher& publisher, size_t numThreads) {
+    LOG(INFO) << "clustering " << numPoints_ << " points using DBSCAN";
+    numThreads = ResolveThreadCount(numThreads);
+    // Neighborhood sizes vary by orders of magnitude between dense clusters and the
+    // background, so threads claim small blocks of points rather than fixed ranges.
+    size_t const numBlocks = (numPoints_ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    auto forEachBlock = [&](auto&& fn) {
+        ParallelForDynamic(numBlocks, numThreads, [&](size_t thread, size_t b) {
+            fn(thread, b * BLOCK_SIZE, std::min(numPoints_, (b + 1) * BLOCK_SIZE));
+        });
+    };
+
+    // find core-objects; every point is within epsilon of itself
+    std::vector<size_t> coreCounts(numThreads, 0);
+    forEachBlock([&](size_t thread, size_t begin, size_t end) {
+        size_t numCore = 0;
+        for (size_t i = begin; i < end; ++i) {
+            size_t n = 0;
+            tree_.visitRange(points_[i].v, epsilon_, [&n](size_t, double) { ++n; });
+            core_[i] = n > minNeighbors_ ? 1 : 0;
+            numCore += core_[i];
+        }
+        coreCounts[thread] += numCore;
+    });
+    numCorePoints_ = 0;
+    for (size_t count : coreCounts) {
+        numCorePoints_ += count;
+    }
+
+    // Merge core-objects within epsilon of each other, following every link from
+    // the larger of its points only, and attach other points to their nearest
+    // core-object. The cluster of a point is then identified by the smallest
+    // core-object of its cluster, and a noise point by itself.
+    UnionFind clusters{numPoints_, numThreads};
+    std::vector<size_t> labels(numPoints_);
+    forEachBlock([&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Vec3 const& v = points_[i].v;
+            if (core_[i] != 0) {
+                tree_.visitRange(v, epsilon_, [&](size_t j, double) {
+                    if (j < i && core_[j] != 0) {
+                        clusters.unite(i, j);
+                    }
+                });
+                continue;
+            }
+            // a point attached to itself is noise
+            double nearestDist = std::numeric_limits<double>::infinity();
+            size_t nearest = i;
+            tree_.visitRange(v, epsilon_, [&](size_t j, double d) {
+                if (core_[j] == 0) {
+                    return;
+                }
+                if (d < nearestDist || (d == nearestDist && j < nearest)) {
+                    nearestDist = d;
+                    nearest = j;
+                }
+            });
+            labels[i] = nearest;
+        }
+    });
+    ParallelFor(numPoints_, numThreads, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (core_[i] != 0) {
+                labels[i] = clusters.find(i);
+            } else if (labels[i] != i) {
+                labels[i] = clusters.find(labels[i]);
+            }
+        }
+    });
+
+    // Group the points of each cluster in point order, clusters in label order.
+    std::vector<size_t> offsets(numPoints_ + 1, 0);
+    for (size_t i = 0; i < numPoints_; ++i) {
+        ++offsets[labels[i] + 1];
+    }
+    for (size_t i = 0; i < numPoints_; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<size_t> members(numPoints_);
+    for (size_t i = 0; i < numPoints_; ++i) {
+        members[offsets[labels[i]]++] = i;
+    }
+    size_t numClusters = 0;
+    size_t begin = 0;
+    for (size_t label = 0; label < numPoints_; ++label) {
+        // offsets[label] is now the end of the cluster with that label
+        size_t const end = offsets[label];
+        if (end == begin) {
+            continue;
+        }
+        size_t const* const cluster = members.data() + begin;
+        records_.clear();
+        for (size_t m = 0; m < end - begin; ++m) {
+            records_.push_back(points_[cluster[m]].record);
+        }
+        publisher.publishSummarized(
+            records_,
+            Summarize(end - begin, [&](size_t m) { return points_[cluster[m]].v; }));
+        ++numClusters;
+        begin = end;
+    }
+    LOG(INFO) << "found " << numCorePoints_ << " core-objects in " << numClusters
+              << " clusters, including noise";
+}
+
+}  // namespace optics
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ClusterPublisher.h"
+#include "Tree.h"
+
+namespace optics {
+
+// Finds the DBSCAN clusters of the points at epsilon, which are the flat clusters
+// published by Optics at the same epsilon, without ordering the points. For details,
+// see the following paper:
+//
+// "A Density-Based Algorithm for Discovering Clusters in Large Spatial Databases with
+// Noise". Martin Ester, Hans-Peter Kriegel, Jorg Sander, Xiaowei Xu (1996).
+// Proceedings of the Second International Conference on Knowledge Discovery and Data
+// Mining. AAAI Press. pp. 226-231.
+//
+// Unlike OPTICS, every step runs in parallel over the points:
+//
+// 1. The epsilon-neighborhood of every point is counted to find the core-objects,
+//    the points with at least minNeighbors other points within epsilon.
+// 2. The neighborhoods are visited again: core-objects within epsilon of each other
+//    are merged with a lock-free UnionFind, and each other point is attached to its
+//    nearest core-object, if any.
+// 3. The points are grouped by the smallest core-object of their cluster, and the
+//    clusters are published in the order of those core-objects.
+//
+// The clusters are those of Optics up to the assignment of border points (points
+// that are not core-objects, but lie within epsilon of one). Here, a border point
+// always belongs to the cluster of its nearest core-object, while Optics assigns it
+// to the first cluster whose ordering reaches it, or publishes it on its own if the
+// point scan reaches it before any of its core-objects. As with Optics, noise points
+// are published as clusters of a single record.
+class Dbscan {
+   public:
+    // See Optics for the meaning of the parameters. The tree is built with `builder`,
+    // and the points are reordered.
+    Dbscan(Point* points, size_t numPoints, size_t minNeighbors, double epsilon,
+           double leafExtentThreshold, size_t pointsPerLeaf,
+           TreeBuilder builder = TreeBuilder::NTH_ELEMENT);
+
+    // Clusters the points on `numThreads` threads (0 means all hardware threads).
+    // Each cluster is published with a summary, in which reachability-distances are
+    // NaN. Clusters are published from the calling thread.
+    void run(ClusterPublisher& publisher, size_t numThreads = 0);
+
+    // Returns true if the i-th (tree ordered) point was found to be a core-object by
+    // the last run.
+    bool isCore(size_t i) const { return core_[i] != 0; }
+
+    size_t numCorePoints() const { return numCorePoints_; }
+    size_t minNeighbors() const { return minNeighbors_; }
+    double epsilon() const { return epsilon_; }
+    Tree const& tree() const { return tree_; }
+
+   private:
+    // Number of consecutive points claimed at a time by a thread
+    static constexpr size_t BLOCK_SIZE = 1024;
+
+    Point* points_;  // unowned
+    size_t numPoints_;
+    size_t minNeighbors_;
+    double epsilon_;
+    Tree tree_;
+    std::vector<uint8_t> core_;
+    size_t numCorePoints_ = 0;
+    std::vector<char const*> records_;
+};
+
+}  // namespace optics
@@ -0,0 +1,109 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "ClusterPublisher.h"
+#include "Dbscan.h"
+#include "Optics.h"
+#include "TestCatalog.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+TEST(DbscanTest, MatchesOptics) {
+    TestCatalog const catalog{20000};
+    std::vector<Point> const& input = catalog.points;
+
+    std::vector<Point> opticsPoints = input;
+    CollectingPublisher expected;
+    Optics{opticsPoints.data(), opticsPoints.size(), MinNeighbors, Epsilon, 0.0, 16}
+        .run(expected);
+
+    std::vector<Point> points = input;
+    Dbscan dbscan{points.data(), points.size(), MinNeighbors, Epsilon, 0.0, 16};
+    CollectingPublisher actual;
+    dbscan.run(actual, 1);
+
+    // core-objects have at least MinNeighbors other points within epsilon
+    std::map<char const*, size_t> index;
+    for (size_t i = 0; i < points.size(); ++i) {
+        index[points[i].record] = i;
+    }
+    for (size_t i = 0; i < points.size(); i += 7) {
+        size_t n = 0;
+        for (Point const& p : points) {
+            n += SquaredEuclidianDistance(p.v, points[i].v) <= Epsilon ? 1 : 0;
+        }
+        ASSERT_EQ(dbscan.isCore(i), n > MinNeighbors) << i;
+    }
+    EXPECT_GT(dbscan.numCorePoints(), 0u);
+    EXPECT_LT(dbscan.numCorePoints(), points.size());
+    auto isCore = [&](char const* record) { return dbscan.isCore(index.at(record)); };
+
+    // Clusters agree on core-objects, and every point is published exactly once.
+    EXPECT_EQ(Normalized(actual.clusters, isCore),
+              Normalized(expected.clusters, isCore));
+    std::vector<char const*> published;
+    for (auto const& cluster : actual.clusters) {
+        published.insert(published.end(), cluster.begin(), cluster.end());
+    }
+    std::sort(published.begin(), published.end());
+    EXPECT_EQ(std::adjacent_find(published.begin(), published.end()), published.end());
+    EXPECT_EQ(published.size(), points.size());
+
+    // Noise is noise for both, and border points are within epsilon of a core-object
+    // of their cluster.
+    auto const all = Normalized(expected.clusters);
+    for (auto const& cluster : actual.clusters) {
+        if (cluster.size() == 1) {
+            EXPECT_TRUE(std::binary_search(all.begin(), all.end(), cluster));
+            continue;
+        }
+        for (char const* border : cluster) {
+            if (isCore(border)) {
+                continue;
+            }
+            Vec3 const& v = points[index.at(border)].v;
+            EXPECT_TRUE(std::any_of(cluster.begin(), cluster.end(), [&](char const* r) {
+                return isCore(r) &&
+                       SquaredEuclidianDistance(points[index.at(r)].v, v) <= Epsilon;
+            }));
+        }
+    }
+
+    // summaries describe the published records
+    ASSERT_EQ(actual.summaries.size(), actual.clusters.size());
+    for (size_t c = 0; c < actual.clusters.size(); ++c) {
+        ClusterSummary const& summary = actual.summaries[c];
+        EXPECT_EQ(summary.size, actual.clusters[c].size());
+        EXPECT_TRUE(std::isnan(summary.meanReach));
+        for (char const* record : actual.clusters[c]) {
+            Vec3 const& v = points[index.at(record)].v;
+            EXPECT_LE(SquaredEuclidianDistance(summary.center, v), summary.radius);
+        }
+    }
+
+    // the clusters do not depend on the number of threads
+    CollectingPublisher parallel;
+    dbscan.run(parallel, 3);
+    EXPECT_EQ(parallel.clusters, actual.clusters);
+}
+
+TEST(DbscanTest, InvalidArguments) {
+    TestCatalog catalog{100};
+    std::vector<Point>& points = catalog.points;
+    EXPECT_THROW((Dbscan{points.data(), points.size(), 0, Epsilon, 0.0, 16}),
+                 std::invalid_argument);
+    EXPECT_THROW((Dbscan{points.data(), 0, MinNeighbors, Epsilon, 0.0, 16}),
+                 std::invalid_argument);
+}
+
+}  // namespace
+}  // namespace optics
@@ -0,0 +1,67 @@
+#include "Duplicates.h"
+
+#include <absl/log/log.h>
+
+#include <cmath>
+#include <vector>
+
+namespace optics {
+
+namespace {
+
+// Target number of points per leaf of the 3-d tree used to find duplicates
+constexpr size_t POINTS_PER_LEAF = 16;
+
+}  // namespace
+
+size_t CollapseDuplicates(Point* points, size_t numPoints, double tolerance,
+                          Duplicates& duplicates) {
+    LOG(INFO) << "collapsing duplicates of " << numPoints << " points";
+    // Building the tree reorders the points: tag each with its input position.
+    for (size_t i = 0; i < numPoints; ++i) {
+        points[i].state = i;
+    }
+    Tree tree{points, numPoints, POINTS_PER_LEAF, 0.0};
+    tolerance = std::abs(tolerance);
+    std::vector<size_t> rows(numPoints);
+    for (size_t i = 0; i < numPoints; ++i) {
+        rows[i] = points[i].state;
+        points[i].state = UNPROCESSED;
+    }
+    duplicates.offsets.assign(1, 0);
+    duplicates.records.clear();
+    duplicates.rows.clear();
+    // index of the representative of each weighted point
+    std::vector<size_t> representatives;
+    for (size_t i = 0; i < numPoints; ++i) {
+        if (points[i].state != UNPROCESSED) {
+            continue;
+        }
+        size_t const g = representatives.size();
+        representatives.push_back(i);
+        points[i].state = g;
+        duplicates.records.push_back(points[i].record);
+        duplicates.rows.push_back(rows[i]);
+        for (size_t j = tree.inRange(points[i].v, tolerance); j != NOT_FOUND;
+             j = points[j].next) {
+            if (points[j].state == UNPROCESSED) {
+                points[j].state = g;
+                duplicates.records.push_back(points[j].record);
+                duplicates.rows.push_back(rows[j]);
+            }
+        }
+        duplicates.offsets.push_back(duplicates.records.size());
+    }
+    // Representatives are in increasing index order, so they can be moved to the
+    // front of the array in place.
+    size_t const n = representatives.size();
+    for (size_t g = 0; g < n; ++g) {
+        points[g] = points[representatives[g]];
+        points[g].next = NOT_FOUND;
+    }
+    LOG(INFO) << "collapsed " << numPoints << " points into " << n
+              << " weighted points";
+    return n;
+}
+
+}  // namespace optics
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "Tree.h"
+
+namespace optics {
+
+// The records of the points that were collapsed into each weighted point by
+// CollapseDuplicates(). The weight of a point is its number of member records.
+struct Duplicates {
+    // members of the i-th point are records[offsets[i]] to records[offsets[i + 1] - 1]
+    std::vector<size_t> offsets = {0};
+    std::vector<char const*> records;
+    // position of the point of each member record in the input of
+    // CollapseDuplicates(), parallel to records
+    std::vector<size_t> rows;
+
+    size_t size() const { return offsets.size() - 1; }
+    size_t weight(size_t i) const { return offsets[i + 1] - offsets[i]; }
+    std::span<char const* const> members(size_t i) const {
+        return {records.data() + offsets[i], weight(i)};
+    }
+};
+
+// Collapses points whose unit vectors are within squared euclidian distance
+// `tolerance` of each other into weighted points. With a tolerance of 0, only points
+// with identical unit vectors are collapsed. Otherwise, points are greedily assigned
+// to the first (in an arbitrary order) uncollapsed point within the tolerance, which
+// becomes their representative, so that members are guaranteed to lie within the
+// tolerance of their representative but not of each other.
+//
+// The representatives are moved to the front of the array and their number is
+// returned. The state of the i-th representative is set to i, and the records of its
+// members are duplicates.members(i), starting with the record of the representative
+// itself. Optics relies on the positions of the representatives to match points to
+// their members after building its spatial index.
+size_t CollapseDuplicates(Point* points, size_t numPoints, double tolerance,
+                          Duplicates& duplicates);
+
+}  // namespace optics
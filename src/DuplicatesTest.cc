@@ -0,0 +1,80 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "Duplicates.h"
+#include "LonLat.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+TEST(DuplicatesTest, CollapsesIdenticalPoints) {
+    std::mt19937_64 rng(1234);
+    std::vector<char> records(10000);
+    std::vector<Point> points;
+    std::vector<size_t> sources;
+    for (size_t i = 0; points.size() < records.size(); ++i) {
+        Vec3 const v = LonLat::random(rng);
+        size_t const weight = std::uniform_int_distribution<size_t>{1, 4}(rng);
+        for (size_t j = 0; j < weight && points.size() < records.size(); ++j) {
+            Point& p = points.emplace_back();
+            p.v = v;
+            p.record = &records[points.size() - 1];
+            sources.push_back(i);
+        }
+    }
+    Duplicates duplicates;
+    size_t const n = CollapseDuplicates(points.data(), points.size(), 0.0, duplicates);
+    ASSERT_EQ(n, sources.back() + 1);
+    ASSERT_EQ(duplicates.size(), n);
+    ASSERT_EQ(duplicates.records.size(), records.size());
+    std::vector<int> seen(records.size(), 0);
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(points[i].state, i);
+        auto const members = duplicates.members(i);
+        ASSERT_FALSE(members.empty());
+        EXPECT_EQ(members[0], points[i].record);
+        size_t const source = sources[members[0] - records.data()];
+        for (char const* record : members) {
+            ++seen[record - records.data()];
+            EXPECT_EQ(sources[record - records.data()], source);
+        }
+    }
+    EXPECT_THAT(seen, testing::Each(1));
+    // rows are the input positions of the members
+    ASSERT_EQ(duplicates.rows.size(), records.size());
+    for (size_t r = 0; r < records.size(); ++r) {
+        EXPECT_EQ(duplicates.records[r], &records[duplicates.rows[r]]);
+    }
+}
+
+TEST(DuplicatesTest, CollapsesPointsWithinTolerance) {
+    std::mt19937_64 rng(1234);
+    std::vector<char> records(10000);
+    std::vector<Point> points(records.size());
+    std::vector<Vec3> coords(records.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        coords[i] = LonLat::random(rng, 0.0, 1.0, 0.0, 1.0);
+        points[i].v = coords[i];
+        points[i].record = &records[i];
+    }
+    double const tolerance = SquaredEuclidianDistance(0.01);
+    Duplicates duplicates;
+    size_t const n =
+        CollapseDuplicates(points.data(), points.size(), tolerance, duplicates);
+    EXPECT_LT(n, points.size());
+    ASSERT_EQ(duplicates.records.size(), records.size());
+    for (size_t i = 0; i < n; ++i) {
+        for (char const* record : duplicates.members(i)) {
+            Vec3 const& v = coords[record - records.data()];
+            EXPECT_LE(SquaredEuclidianDistance(points[i].v, v), tolerance);
+        }
+    }
+}
+
+}  // namespace
+}  // namespace optics
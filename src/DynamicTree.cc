@@ -0,0 +1,268 @@
+#include "DynamicTree.h"
+
+#include <absl/log/check.h>
+#include <absl/log/log.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace optics {
+
+DynamicTree::DynamicTree(size_t pointsPerLeaf, double leafExtentThreshold)
+    : pointsPerLeaf_{pointsPerLeaf}, leafExtentThreshold_{leafExtentThreshold} {
+    if (pointsPerLeaf == 0) {
+        throw std::invalid_argument("target number of points per leaf must be > 0");
+    }
+    nodes_.emplace_back();
+}
+
+DynamicTree::DynamicTree(std::vector<Point> points, size_t pointsPerLeaf,
+                         double leafExtentThreshold)
+    : DynamicTree{pointsPerLeaf, leafExtentThreshold} {
+    if (points.empty()) {
+        return;
+    }
+    points_ = std::move(points);
+    erased_.assign(points_.size(), 0);
+    Tree const tree{points_.data(), points_.size(), pointsPerLeaf, leafExtentThreshold};
+    nodes_.clear();
+    nodes_.reserve(2 * tree.numNodes());
+    adopt(tree.nodes(), 0);
+}
+
+size_t DynamicTree::adopt(NodeView const& nodes, size_t node) {
+    size_t const n = allocateNode();
+    if (nodes[node].isLeaf()) {
+        size_t const left = (node & (node + 1)) != 0 ? nodes[node - 1].right() : 0;
+        nodes_[n].first = left;
+        nodes_[n].second = nodes[node].right();
+        nodes_[n].size = nodes_[n].second - left;
+        nodes_[n].built = nodes_[n].size;
+        return n;
+    }
+    size_t const left = adopt(nodes, (node << 1) + 1);
+    size_t const right = adopt(nodes, (node << 1) + 2);
+    nodes_[n].split = nodes[node].split;
+    nodes_[n].dim = static_cast<uint32_t>(nodes[node].splitDim());
+    nodes_[n].first = left;
+    nodes_[n].second = right;
+    nodes_[n].size = nodes_[left].size + nodes_[right].size;
+    return n;
+}
+
+size_t DynamicTree::allocateNode() {
+    if (freeNodes_.empty()) {
+        nodes_.emplace_back();
+        return nodes_.size() - 1;
+    }
+    size_t const n = freeNodes_.back();
+    freeNodes_.pop_back();
+    nodes_[n] = Node{};
+    return n;
+}
+
+size_t DynamicTree::allocateList() {
+    if (freeLists_.empty()) {
+        lists_.emplace_back();
+        return lists_.size() - 1;
+    }
+    size_t const l = freeLists_.back();
+    freeLists_.pop_back();
+    return l;
+}
+
+bool DynamicTree::unbalanced(size_t node) const {
+    Node const& n = nodes_[node];
+    if (n.erased > n.size && n.erased > pointsPerLeaf_) {
+        return true;
+    }
+    if (n.isLeaf()) {
+        size_t const entries = n.size + n.erased;
+        return entries > 2 * std::max(n.built, pointsPerLeaf_);
+    }
+    size_t const largest = std::max(nodes_[n.first].size, nodes_[n.second].size);
+    return n.size > 2 * pointsPerLeaf_ &&
+           static_cast<double>(largest) > MAX_CHILD_FRACTION * n.size;
+}
+
+void DynamicTree::rebalance(std::vector<size_t> const& path) {
+    for (size_t k = 0; k < path.size(); ++k) {
+        if (unbalanced(path[k])) {
+            // the rebuild drops the tombstones of the subtree
+            size_t const erased = nodes_[path[k]].erased;
+            rebuild(path[k]);
+            for (size_t a = 0; a < k; ++a) {
+                nodes_[path[a]].erased -= erased;
+            }
+            return;
+        }
+    }
+}
+
+size_t DynamicTree::insert(Point const& point) {
+    size_t const id = points_.size();
+    points_.push_back(point);
+    erased_.push_back(0);
+    std::vector<size_t> path;
+    size_t node = ROOT;
+    while (true) {
+        path.push_back(node);
+        Node& n = nodes_[node];
+        ++n.size;
+        if (n.isLeaf()) {
+            break;
+        }
+        // points equal to the split may lie on either side
+        node = point.v.coords[n.dim] < n.split ? n.first : n.second;
+    }
+    if (nodes_[node].list == NOT_FOUND) {
+        size_t const list = allocateList();
+        nodes_[node].list = list;
+    }
+    lists_[nodes_[node].list].push_back(id);
+    rebalance(path);
+    return id;
+}
+
+bool DynamicTree::locate(size_t node, size_t id, std::vector<size_t>& path) const {
+    Node const& n = nodes_[node];
+    path.push_back(node);
+    if (n.isLeaf()) {
+        if ((id >= n.first && id < n.second) ||
+            (n.list != NOT_FOUND &&
+             std::find(lists_[n.list].begin(), lists_[n.list].end(), id) !=
+                 lists_[n.list].end())) {
+            return true;
+        }
+    } else {
+        double const vd = points_[id].v.coords[n.dim];
+        if ((vd <= n.split && locate(n.first, id, path)) ||
+            (vd >= n.split && locate(n.second, id, path))) {
+            return true;
+        }
+    }
+    path.pop_back();
+    return false;
+}
+
+void DynamicTree::erase(size_t id) {
+    if (!contains(id)) {
+        throw std::invalid_argument(fmt::format("no point with id {}", id));
+    }
+    std::vector<size_t> path;
+    CHECK(locate(ROOT, id, path)) << "point " << id << " is not in the tree";
+    erased_[id] = 1;
+    for (size_t node : path) {
+        --nodes_[node].size;
+        ++nodes_[node].erased;
+    }
+    rebalance(path);
+}
+
+void DynamicTree::rebuild() {
+    rebuild(ROOT);
+    LOG(INFO) << "rebuilt dynamic 3d tree of " << size() << " points";
+}
+
+void DynamicTree::gather(size_t node, std::vector<size_t>& ids) {
+    Node const n = nodes_[node];
+    if (n.isLeaf()) {
+        for (size_t id = n.first; id < n.second; ++id) {
+            if (erased_[id] == 0) {
+                ids.push_back(id);
+            }
+        }
+        if (n.list != NOT_FOUND) {
+            for (size_t id : lists_[n.list]) {
+                if (erased_[id] == 0) {
+                    ids.push_back(id);
+                }
+            }
+            lists_[n.list].clear();
+            freeLists_.push_back(n.list);
+        }
+    } else {
+        gather(n.first, ids);
+        gather(n.second, ids);
+        freeNodes_.push_back(n.first);
+        freeNodes_.push_back(n.second);
+    }
+}
+
+void DynamicTree::rebuild(size_t node) {
+    std::vector<size_t> ids;
+    ids.reserve(nodes_[node].size);
+    gather(node, ids);
+    DCHECK_EQ(ids.size(), nodes_[node].size);
+    nodes_[node] = Node{};
+    build(node, ids.data(), ids.data() + ids.size());
+    ++numRebuilds_;
+    rebuiltPoints_ += ids.size();
+}
+
+void DynamicTree::build(size_t node, size_t* first, size_t* last) {
+    size_t const n = last - first;
+    Vec3 lo{std::numeric_limits<double>::infinity(),
+            std::numeric_limits<double>::infinity(),
+            std::numeric_limits<double>::infinity()};
+    Vec3 hi = -lo;
+    for (size_t* id = first; id != last; ++id) {
+        lo = Min(lo, points_[*id].v);
+        hi = Max(hi, points_[*id].v);
+    }
+    Vec3 const extent = hi - lo;
+    size_t dim = 0;
+    for (size_t d = 1; d < 3; ++d) {
+        if (extent.coords[d] > extent.coords[dim]) {
+            dim = d;
+        }
+    }
+    if (n <= pointsPerLeaf_ || !(extent.coords[dim] > leafExtentThreshold_)) {
+        std::sort(first, last);
+        size_t const list = allocateList();
+        lists_[list].assign(first, last);
+        nodes_[node].list = list;
+        nodes_[node].size = n;
+        nodes_[node].built = n;
+        return;
+    }
+    size_t* const median = first + (n >> 1);
+    std::nth_element(first, median, last, [this, dim](size_t a, size_t b) {
+        return points_[a].v.coords[dim] < points_[b].v.coords[dim];
+    });
+    double const split = points_[*median].v.coords[dim];
+    size_t const left = allocateNode();
+    size_t const right = allocateNode();
+    build(left, first, median);
+    build(right, median, last);
+    Node& parent = nodes_[node];
+    parent.split = split;
+    parent.dim = static_cast<uint32_t>(dim);
+    parent.first = left;
+    parent.second = right;
+    parent.size = n;
+}
+
+size_t DynamicTree::inRange(Vec3 const& v, double dist) {
+    size_t head = NOT_FOUND;
+    size_t tail = NOT_FOUND;
+    OPTICS_STATS(QueryStats stats; stats.queries = 1);
+    visitRange(v, dist, [&](size_t id, double d) {
+        OPTICS_STATS(++stats.hits);
+        points_[id].dist = d;
+        if (tail == NOT_FOUND) {
+            head = id;
+        } else {
+            points_[tail].next = id;
+        }
+        tail = id;
+    });
+    if (tail != NOT_FOUND) {
+        points_[tail].next = NOT_FOUND;
+    }
+    OPTICS_STATS(stats_ += stats);
+    return head;
+}
+
+}  // namespace optics
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "Stats.h"
+#include "Tree.h"
+#include "Vec3.h"
+
+namespace optics {
+
+// A 3-d tree that supports inserting and erasing points, for catalogues that change
+// by small increments, such as a reference catalogue receiving a nightly stream of
+// detections. Range queries have the contract of Tree::inRange().
+//
+// Unlike Tree, a DynamicTree owns its points, and identifies them by ids that are
+// stable until the point is erased. The points the tree is constructed with are
+// reordered exactly like in a Tree, so that their ids are their positions in tree
+// order and each leaf of the initial tree holds a contiguous range of ids. Inserted
+// points are appended, and each leaf keeps the ids of the points added to it in an
+// overflow list. Erased points are only marked as such (tombstones), and are skipped
+// by queries.
+//
+// Subtrees are rebuilt from their remaining points when they get out of balance:
+// when a leaf has grown to twice its size at the time it was built, when a child
+// holds more than MAX_CHILD_FRACTION of the points of its parent, or when a subtree
+// holds more tombstones than points. Only the highest such subtree on the path of an
+// update is rebuilt, like in a scapegoat tree, so that updates cost O(log^2 n)
+// amortized point moves rather than the O(n log n) of rebuilding the whole tree.
+// Leaves of rebuilt subtrees list their points in id order.
+//
+// Like Tree, a DynamicTree must only be queried by a single thread at a time, except
+// with visitRange().
+class DynamicTree {
+   public:
+    static constexpr double MAX_CHILD_FRACTION = 0.75;
+
+    // Creates an empty tree. See Tree for the meaning of the parameters.
+    DynamicTree(size_t pointsPerLeaf, double leafExtentThreshold);
+
+    // Creates a tree over the given points, which are reordered by building a Tree
+    // over them. The id of each point is its position after reordering.
+    DynamicTree(std::vector<Point> points, size_t pointsPerLeaf,
+                double leafExtentThreshold);
+
+    // Returns the number of points in the tree, excluding erased points.
+    size_t size() const { return nodes_[ROOT].size; }
+
+    // Returns the number of ids handed out, including those of erased points. Ids are
+    // in [0, numIds()).
+    size_t numIds() const { return points_.size(); }
+
+    // Returns true if `id` identifies a point that has not been erased.
+    bool contains(size_t id) const { return id < points_.size() && erased_[id] == 0; }
+
+    // Returns the point with the given id. References are invalidated by insert().
+    Point& operator[](size_t id) { return points_[id]; }
+    Point const& operator[](size_t id) const { return points_[id]; }
+
+    // Adds a point to the tree and returns its id.
+    size_t insert(Point const& point);
+
+    // Removes the point with the given id from the tree. Throws if there is no such
+    // point. Ids are never reused.
+    void erase(size_t id);
+
+    // Rebuilds the whole tree from its remaining points, dropping all tombstones.
+    void rebuild();
+
+    // Locates all points within squared euclidian distance `dist` of `v`, and returns
+    // the id of the first one, or NOT_FOUND. The ids of the remaining points are
+    // available by following Point::next, as for Tree::inRange().
+    size_t inRange(Vec3 const& v, double dist);
+
+    // Calls fn(id, d) for every point within squared euclidian distance d <= `dist`
+    // of `v`, without modifying the points.
+    template <typename F>
+    void visitRange(Vec3 const& v, double dist, F&& fn) const;
+
+    // Returns the number of subtree rebuilds and the number of points they moved
+    // since construction.
+    size_t numRebuilds() const { return numRebuilds_; }
+    size_t rebuiltPoints() const { return rebuiltPoints_; }
+
+    // Returns range query counters accumulated since construction or the last call to
+    // resetStats(). Always zero unless compiled with OPTICS_ENABLE_STATS.
+    QueryStats const& stats() const { return stats_; }
+    void resetStats() { stats_ = QueryStats{}; }
+
+   private:
+    static constexpr size_t ROOT = 0;
+    static constexpr uint32_t LEAF = 3;
+
+    struct Node {
+        double split = std::numeric_limits<double>::quiet_NaN();
+        // dimension of the splitting value, or LEAF
+        uint32_t dim = LEAF;
+        // children of an internal node, or range of ids of the points a leaf was
+        // adopted with from the initial Tree
+        size_t first = 0;
+        size_t second = 0;
+        // index of the overflow list of a leaf in lists_, or NOT_FOUND
+        size_t list = NOT_FOUND;
+        // number of points and tombstones in the subtree
+        size_t size = 0;
+        size_t erased = 0;
+        // number of points in a leaf when it was built
+        size_t built = 0;
+
+        bool isLeaf() const { return dim == LEAF; }
+    };
+
+    std::vector<Point> points_;
+    std::vector<uint8_t> erased_;
+    std::vector<Node> nodes_;
+    std::vector<size_t> freeNodes_;
+    std::vector<std::vector<size_t>> lists_;
+    std::vector<size_t> freeLists_;
+    size_t pointsPerLeaf_;
+    double leafExtentThreshold_;
+    size_t numRebuilds_ = 0;
+    size_t rebuiltPoints_ = 0;
+    QueryStats stats_;
+
+    size_t adopt(NodeView const& nodes, size_t node);
+    size_t allocateNode();
+    size_t allocateList();
+    bool unbalanced(size_t node) const;
+    bool locate(size_t node, size_t id, std::vector<size_t>& path) const;
+    void rebalance(std::vector<size_t> const& path);
+    void gather(size_t node, std::vector<size_t>& ids);
+    void rebuild(size_t node);
+    void build(size_t node, size_t* first, size_t* last);
+};
+
+template <typename F>
+void DynamicTree::visitRange(Vec3 const& v, double dist, F&& fn) const {
+    std::array<size_t, 2 * sizeof(size_t) * 8> stack;
+    size_t size = 0;
+    stack[size++] = ROOT;
+    std::vector<size_t> deep;
+    while (size > 0 || !deep.empty()) {
+        size_t node;
+        if (size > 0) {
+            node = stack[--size];
+        } else {
+            node = deep.back();
+            deep.pop_back();
+        }
+        Node const& n = nodes_[node];
+        if (n.size == 0) {
+            continue;
+        }
+        if (n.isLeaf()) {
+            auto visit = [&](size_t id) {
+                double const d = SquaredEuclidianDistance(v, points_[id].v);
+                if (d <= dist && erased_[id] == 0) {
+                    fn(id, d);
+                }
+            };
+            for (size_t id = n.first; id < n.second; ++id) {
+                visit(id);
+            }
+            if (n.list != NOT_FOUND) {
+                for (size_t id : lists_[n.list]) {
+                    visit(id);
+                }
+            }
+            continue;
+        }
+        double const vd = v.coords[n.dim];
+        bool const both = MinSquaredEuclidianDistance(vd, n.split) <= dist;
+        // Rebuilt subtrees are balanced, but nothing bounds the height of the tree
+        // between rebuilds: spill to the heap if the stack is full.
+        auto push = [&](size_t child) {
+            if (size < stack.size()) {
+                stack[size++] = child;
+            } else {
+                deep.push_back(child);
+            }
+        };
+        if (both) {
+            push(n.second);
+            push(n.first);
+        } else {
+            push(vd < n.split ? n.first : n.second);
+        }
+    }
+}
+
+}  // namespace optics
@@ -0,0 +1,119 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "DynamicTree.h"
+#include "LonLat.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+// Returns the ids found by a range query, sorted.
+std::vector<size_t> Found(DynamicTree& tree, Vec3 const& v, double dist) {
+    std::vector<size_t> found;
+    for (size_t id = tree.inRange(v, dist); id != NOT_FOUND; id = tree[id].next) {
+        EXPECT_EQ(tree[id].dist, SquaredEuclidianDistance(v, tree[id].v));
+        found.push_back(id);
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+std::vector<size_t> Expected(DynamicTree const& tree, Vec3 const& v, double dist) {
+    std::vector<size_t> expected;
+    for (size_t id = 0; id < tree.numIds(); ++id) {
+        if (tree.contains(id) && SquaredEuclidianDistance(v, tree[id].v) <= dist) {
+            expected.push_back(id);
+        }
+    }
+    return expected;
+}
+
+TEST(DynamicTreeTest, InsertAndErase) {
+    std::mt19937_64 rng(1234);
+    std::vector<Point> points(20000);
+    for (Point& p : points) {
+        p.v = LonLat::random(rng);
+    }
+    DynamicTree tree{std::move(points), 8, 0.0};
+    ASSERT_EQ(tree.size(), 20000);
+    ASSERT_EQ(tree.numRebuilds(), 0);
+    // insert clumps, including exact duplicates, which all land in a few leaves and
+    // unbalance the tree, and erase random points
+    std::uniform_int_distribution<size_t> pickAction{0, 9};
+    LonLat center = LonLat::random(rng);
+    size_t live = tree.size();
+    for (size_t step = 0; step < 30000; ++step) {
+        size_t const action = pickAction(rng);
+        if (action < 6) {
+            if (step % 1000 == 0) {
+                center = LonLat::random(rng);
+            }
+            Point p;
+            p.v = action == 0 ? Vec3{center} : Vec3{center.perturb(rng, 0.01)};
+            size_t const id = tree.insert(p);
+            EXPECT_EQ(id, tree.numIds() - 1);
+            ++live;
+        } else {
+            std::uniform_int_distribution<size_t> pickId{0, tree.numIds() - 1};
+            size_t id = pickId(rng);
+            while (!tree.contains(id)) {
+                id = pickId(rng);
+            }
+            tree.erase(id);
+            EXPECT_FALSE(tree.contains(id));
+            --live;
+        }
+        ASSERT_EQ(tree.size(), live);
+        if (step % 100 == 0) {
+            double const dist = SquaredEuclidianDistance(step % 200 == 0 ? 0.05 : 1.0);
+            Vec3 const v = step % 300 == 0 ? Vec3{LonLat::random(rng)} : Vec3{center};
+            EXPECT_EQ(Found(tree, v, dist), Expected(tree, v, dist));
+        }
+    }
+    EXPECT_GT(tree.numRebuilds(), 0);
+    // Partial rebuilds move a few points per update, far fewer than rebuilding the
+    // whole tree after each update would.
+    EXPECT_LT(tree.rebuiltPoints(), 100 * 30000);
+    EXPECT_THROW(tree.erase(tree.numIds()), std::invalid_argument);
+
+    tree.rebuild();
+    EXPECT_EQ(tree.size(), live);
+    for (int q = 0; q < 100; ++q) {
+        Vec3 const v = LonLat::random(rng);
+        double const dist = SquaredEuclidianDistance(2.0);
+        EXPECT_EQ(Found(tree, v, dist), Expected(tree, v, dist));
+    }
+}
+
+TEST(DynamicTreeTest, StartsEmpty) {
+    std::mt19937_64 rng(1234);
+    DynamicTree tree{4, 0.0};
+    EXPECT_EQ(tree.size(), 0);
+    EXPECT_EQ(tree.inRange(Vec3{1.0, 0.0, 0.0}, 4.0), NOT_FOUND);
+    for (int i = 0; i < 5000; ++i) {
+        Point p;
+        p.v = LonLat::random(rng);
+        tree.insert(p);
+    }
+    for (size_t id = 0; id < 5000; id += 2) {
+        tree.erase(id);
+    }
+    EXPECT_EQ(tree.size(), 2500);
+    for (int q = 0; q < 100; ++q) {
+        Vec3 const v = LonLat::random(rng);
+        double const dist = SquaredEuclidianDistance(5.0);
+        EXPECT_EQ(Found(tree, v, dist), Expected(tree, v, dist));
+    }
+    EXPECT_THROW(tree.erase(0), std::invalid_argument);
+    EXPECT_THROW((DynamicTree{0, 0.0}), std::invalid_argument);
+}
+
+}  // namespace
+}  // namespace optics
@@ -0,0 +1,73 @@
+// Writes a synthetic sky catalogue for load and accuracy testing. For example:
+//
+//     optics-gen --output=sky.csv --num_points=100000000 --num_clusters=100000
+//         --noise_fraction=0.3 --labels
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/log/log.h>
+
+#include <cstdint>
+#include <exception>
+#include <string>
+
+#include "SkyGenerator.h"
+
+ABSL_FLAG(std::string, output, "", "Output file path");
+ABSL_FLAG(std::string, format, "csv", "Output format: csv or binary");
+ABSL_FLAG(bool, labels, false, "Emit ground truth cluster labels (-1 for noise)");
+ABSL_FLAG(uint64_t, seed, 1, "Random number generator seed");
+ABSL_FLAG(uint64_t, num_points, 1000000, "Number of sources to generate");
+ABSL_FLAG(uint64_t, num_clusters, 1000, "Number of Gaussian clusters");
+ABSL_FLAG(double, noise_fraction, 0.5, "Fraction of uniformly distributed sources");
+ABSL_FLAG(double, min_sigma, 1.0, "Minimum cluster standard deviation (arcsec)");
+ABSL_FLAG(double, max_sigma, 10.0, "Maximum cluster standard deviation (arcsec)");
+ABSL_FLAG(double, size_exponent, 1.5,
+          "Pareto shape of relative cluster sizes (0 for equal sizes)");
+ABSL_FLAG(double, polar_fraction, 0.05, "Fraction of clusters in the polar caps");
+ABSL_FLAG(double, pole_cap_lat, 85.0, "Minimum |latitude| of polar cap clusters (deg)");
+ABSL_FLAG(double, wrap_fraction, 0.05,
+          "Fraction of clusters near the longitude 0/360 discontinuity");
+ABSL_FLAG(double, wrap_width, 0.5,
+          "Maximum distance of wrap-around cluster centers from longitude 0 (deg)");
+ABSL_FLAG(uint64_t, threads, 0, "Number of threads (0 for all hardware threads)");
+
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
+
+    std::string const output = absl::GetFlag(FLAGS_output);
+    std::string const format = absl::GetFlag(FLAGS_format);
+    if (output.empty()) {
+        LOG(ERROR) << "--output must be specified";
+        return 1;
+    }
+    if (format != "csv" && format != "binary") {
+        LOG(ERROR) << "--format must be csv or binary";
+        return 1;
+    }
+
+    optics::SkyGeneratorConfig config;
+    config.seed = absl::GetFlag(FLAGS_seed);
+    config.numPoints = absl::GetFlag(FLAGS_num_points);
+    config.numClusters = absl::GetFlag(FLAGS_num_clusters);
+    config.noiseFraction = absl::GetFlag(FLAGS_noise_fraction);
+    config.minClusterSigma = absl::GetFlag(FLAGS_min_sigma) / 3600.0;
+    config.maxClusterSigma = absl::GetFlag(FLAGS_max_sigma) / 3600.0;
+    config.clusterSizeExponent = absl::GetFlag(FLAGS_size_exponent);
+    config.polarClusterFraction = absl::GetFlag(FLAGS_polar_fraction);
+    config.poleCapLat = absl::GetFlag(FLAGS_pole_cap_lat);
+    config.wrapClusterFraction = absl::GetFlag(FLAGS_wrap_fraction);
+    config.wrapWidth = absl::GetFlag(FLAGS_wrap_width);
+
+    try {
+        optics::SkyGenerator generator{config};
+        generator.write(output,
+                        format == "csv" ? optics::CatalogFormat::CSV
+                                        : optics::CatalogFormat::BINARY,
+                        absl::GetFlag(FLAGS_labels), absl::GetFlag(FLAGS_threads));
+    } catch (std::exception const& e) {
+        LOG(ERROR) << e.what();
+        return 1;
+    }
+    return 0;
+}
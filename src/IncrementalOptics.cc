@@ -0,0 +1,186 @@
+#include "IncrementalOptics.h"
+
+#include <absl/log/log.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "CoreDistance.h"
+
+namespace optics {
+
+IncrementalOptics::IncrementalOptics(std::vector<Point> points, size_t minNeighbors,
+                                     double epsilon, double leafExtentThreshold,
+                                     size_t pointsPerLeaf)
+    : tree_{std::move(points), pointsPerLeaf, leafExtentThreshold},
+      minNeighbors_{minNeighbors},
+      epsilon_{std::abs(epsilon)},
+      coreDistances_(tree_.numIds(), std::numeric_limits<double>::infinity()),
+      clusterOf_(tree_.numIds(), NOT_FOUND) {
+    if (minNeighbors == 0) {
+        throw std::invalid_argument("minimum number of neighbors must be > 0");
+    }
+    std::vector<size_t> starts(tree_.numIds());
+    for (size_t i = 0; i < starts.size(); ++i) {
+        tree_[i].reach = std::numeric_limits<double>::infinity();
+        tree_[i].state = UNPROCESSED;
+        starts[i] = i;
+    }
+    order(starts);
+    LOG(INFO) << "ordered " << size() << " points into " << numClusters()
+              << " clusters";
+}
+
+std::vector<size_t> IncrementalOptics::update(std::span<Point const> inserted,
+                                              std::span<size_t const> erased) {
+    std::vector<size_t> changed(erased.begin(), erased.end());
+    std::sort(changed.begin(), changed.end());
+    for (size_t k = 0; k < changed.size(); ++k) {
+        if (!tree_.contains(changed[k]) || (k > 0 && changed[k] == changed[k - 1])) {
+            throw std::invalid_argument(
+                fmt::format("no point with id {} to erase", changed[k]));
+        }
+    }
+    // The clusters of erased points lose a point, and are always reordered.
+    std::vector<size_t> affected;
+    for (size_t id : changed) {
+        affected.push_back(clusterOf_[id]);
+        tree_.erase(id);
+    }
+    std::vector<size_t> ids;
+    ids.reserve(inserted.size());
+    for (Point p : inserted) {
+        p.reach = std::numeric_limits<double>::infinity();
+        p.state = UNPROCESSED;
+        ids.push_back(tree_.insert(p));
+    }
+    changed.insert(changed.end(), ids.begin(), ids.end());
+    coreDistances_.resize(tree_.numIds(), std::numeric_limits<double>::infinity());
+    clusterOf_.resize(tree_.numIds(), NOT_FOUND);
+
+    // Find the clusters of the points within 2 epsilon of a changed point, i.e. at a
+    // squared distance of at most 4 epsilon. Erased points are found by position.
+    for (size_t id : changed) {
+        tree_.visitRange(tree_[id].v, 4.0 * epsilon_, [&](size_t j, double) {
+            if (clusterOf_[j] != NOT_FOUND) {
+                affected.push_back(clusterOf_[j]);
+            }
+        });
+    }
+    std::sort(affected.begin(), affected.end());
+    affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+
+    // Reorder the remaining points of the affected clusters and the inserted points,
+    // starting from points in id order like a full run.
+    std::vector<size_t> starts = ids;
+    for (size_t c : affected) {
+        for (size_t id : clusters_[c]) {
+            if (tree_.contains(id)) {
+                starts.push_back(id);
+            }
+        }
+        std::vector<size_t>{}.swap(clusters_[c]);
+        ++freeSlots_;
+    }
+    for (size_t id : starts) {
+        tree_[id].reach = std::numeric_limits<double>::infinity();
+        tree_[id].state = UNPROCESSED;
+    }
+    std::sort(starts.begin(), starts.end());
+    order(starts);
+    if (2 * freeSlots_ > clusters_.size()) {
+        compact();
+    }
+    return ids;
+}
+
+void IncrementalOptics::publish(ClusterPublisher& publisher) const {
+    std::vector<char const*> records;
+    for (std::vector<size_t> const& cluster : clusters_) {
+        if (cluster.empty()) {
+            continue;
+        }
+        records.clear();
+        for (size_t id : cluster) {
+            records.push_back(tree_[id].record);
+        }
+        publisher.publish(records);
+    }
+}
+
+void IncrementalOptics::order(std::vector<size_t> const& starts) {
+    reorderedPoints_ = 0;
+    if (starts.empty()) {
+        return;
+    }
+    // only the points being reordered can become seeds
+    SeedList seeds{&tree_[0], tree_.numIds(), starts.size()};
+    for (size_t start : starts) {
+        if (tree_[start].state != UNPROCESSED) {
+            continue;
+        }
+        tree_[start].state = PROCESSED;
+        std::vector<size_t> cluster{start};
+        expandClusterOrder(start, seeds);
+        while (!seeds.empty()) {
+            // expand cluster around seed with smallest reachability-distance
+            size_t const i = seeds.pop();
+            expandClusterOrder(i, seeds);
+            cluster.push_back(i);
+        }
+        for (size_t id : cluster) {
+            clusterOf_[id] = clusters_.size();
+        }
+        reorderedPoints_ += cluster.size();
+        clusters_.push_back(std::move(cluster));
+    }
+}
+
+void IncrementalOptics::expandClusterOrder(size_t i, SeedList& seeds) {
+    // find epsilon neighborhood of point i
+    size_t const range = tree_.inRange(tree_[i].v, epsilon_);
+    // compute core-distance
+    distances_.resize(minNeighbors_);
+    CoreDistanceHeap heap{distances_.data(), minNeighbors_};
+    for (size_t j = range; j != NOT_FOUND; j = tree_[j].next) {
+        if (j != i) {
+            heap.add(tree_[j].dist);
+        }
+    }
+    double const coreDist = heap.coreDistance();
+    coreDistances_[i] = coreDist;
+    if (coreDist == std::numeric_limits<double>::infinity()) {
+        return;
+    }
+    // point i is a core-object. Update reachability-distance of all points in the
+    // epsilon-neighborhood of point i; points of clusters that are not reordered are
+    // marked as processed.
+    for (size_t j = range; j != NOT_FOUND; j = tree_[j].next) {
+        if (tree_[j].state != PROCESSED) {
+            seeds.update(j, std::max(coreDist, tree_[j].dist));
+        }
+    }
+}
+
+void IncrementalOptics::compact() {
+    size_t slot = 0;
+    for (std::vector<size_t>& cluster : clusters_) {
+        if (cluster.empty()) {
+            continue;
+        }
+        for (size_t id : cluster) {
+            clusterOf_[id] = slot;
+        }
+        if (&clusters_[slot] != &cluster) {
+            clusters_[slot] = std::move(cluster);
+        }
+        ++slot;
+    }
+    clusters_.resize(slot);
+    freeSlots_ = 0;
+}
+
+}  // namespace optics
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "ClusterPublisher.h"
+#include "DynamicTree.h"
+#include "SeedList.h"
+#include "Tree.h"
+
+namespace optics {
+
+// Maintains the OPTICS clusters of a catalogue that changes by batches of inserted
+// and erased points, without reordering the whole catalogue after each batch.
+//
+// Inserting or erasing a point p can only change the core-distances of points within
+// epsilon of p, and therefore only the reachability-distances, and the clusters, of
+// points within 2 epsilon of p. (Distances are euclidian distances between unit
+// vectors, which obey the triangle inequality.) A cluster without such points keeps
+// its points, since none of its points gains or loses neighbors or density-connected
+// points. An update therefore only reorders the clusters that have a point within
+// 2 epsilon of a changed point, along with the inserted points, with the usual
+// OPTICS expansion over the whole tree. Points of other clusters are marked as
+// processed, so that the expansion never enters them. The reordered clusters replace
+// the clusters they were obtained from in the cluster ordering.
+//
+// The clusters are then those of a full run over the remaining points, up to the
+// order of clusters and the assignment of border points that are density-reachable
+// from several clusters, like for Optics runs over differently ordered points.
+class IncrementalOptics {
+   public:
+    // Orders the given points. Their ids, used by update() and coreDistance(), are
+    // their positions in the DynamicTree built over them.
+    IncrementalOptics(std::vector<Point> points, size_t minNeighbors, double epsilon,
+                      double leafExtentThreshold, size_t pointsPerLeaf);
+
+    // Inserts and erases points, and reorders the clusters they affect. Returns the
+    // ids of the inserted points. Throws if an erased id does not identify a point.
+    std::vector<size_t> update(std::span<Point const> inserted,
+                               std::span<size_t const> erased);
+
+    // Publishes every cluster, in cluster order.
+    void publish(ClusterPublisher& publisher) const;
+
+    // Returns the number of points, excluding erased points.
+    size_t size() const { return tree_.size(); }
+    // Returns the number of non-empty clusters, including clusters of noise points.
+    size_t numClusters() const { return clusters_.size() - freeSlots_; }
+    // Returns the points of the clusters, including erased points, by id.
+    DynamicTree const& tree() const { return tree_; }
+
+    // Returns the core-distance of the point with the given id, which is infinite if
+    // the point is not a core-object.
+    double coreDistance(size_t id) const { return coreDistances_[id]; }
+
+    // Returns the number of points ordered by the last update, or by construction.
+    size_t reorderedPoints() const { return reorderedPoints_; }
+
+   private:
+    DynamicTree tree_;
+    size_t minNeighbors_;
+    double epsilon_;
+    std::vector<double> coreDistances_;
+    // ids of the points of each cluster in order, in cluster order; the clusters of
+    // updated regions are emptied and replaced by clusters appended to the end
+    std::vector<std::vector<size_t>> clusters_;
+    size_t freeSlots_ = 0;
+    // index of the cluster of each point in clusters_
+    std::vector<size_t> clusterOf_;
+    std::vector<double> distances_;
+    size_t reorderedPoints_ = 0;
+
+    void order(std::vector<size_t> const& starts);
+    void expandClusterOrder(size_t i, SeedList& seeds);
+    void compact();
+};
+
+}  // namespace optics
@@ -0,0 +1,128 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "IncrementalOptics.h"
+#include "LonLat.h"
+#include "Optics.h"
+#include "SkyGenerator.h"
+#include "TestCatalog.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+// Returns the clusters of a full run over the points of the incremental clustering.
+std::vector<std::vector<char const*>> Rerun(IncrementalOptics const& incremental) {
+    std::vector<Point> points;
+    DynamicTree const& tree = incremental.tree();
+    for (size_t id = 0; id < tree.numIds(); ++id) {
+        if (tree.contains(id)) {
+            Point& p = points.emplace_back();
+            p.v = tree[id].v;
+            p.record = tree[id].record;
+        }
+    }
+    CollectingPublisher publisher;
+    Optics{points.data(), points.size(), MinNeighbors, Epsilon, 0.0, 16}.run(publisher);
+    return Normalized(publisher.clusters);
+}
+
+std::vector<std::vector<char const*>> Clusters(IncrementalOptics const& incremental) {
+    CollectingPublisher publisher;
+    incremental.publish(publisher);
+    return Normalized(publisher.clusters);
+}
+
+TEST(IncrementalOpticsTest, MatchesFullRun) {
+    size_t const numPoints = 20000;
+    // records of the initial points, followed by records of inserted points
+    TestCatalog catalog{numPoints, 1000};
+    IncrementalOptics optics{catalog.points, MinNeighbors, Epsilon, 0.0, 16};
+    EXPECT_EQ(optics.size(), numPoints);
+    EXPECT_EQ(optics.reorderedPoints(), numPoints);
+    EXPECT_EQ(Clusters(optics), Rerun(optics));
+
+    // Grow a cluster, add a new cluster and noise, erase a whole cluster along with
+    // random noise points.
+    std::mt19937_64 rng(1234);
+    size_t nextRecord = numPoints;
+    auto makePoint = [&](LonLat const& p) {
+        Point point;
+        point.v = p;
+        point.record = &catalog.records[nextRecord++];
+        return point;
+    };
+    LonLat grown;
+    for (SyntheticSource const& s : catalog.sources) {
+        if (s.label == 0) {
+            grown = s.p;
+            break;
+        }
+    }
+    LonLat const center = LonLat::random(rng);
+    std::vector<Point> inserted;
+    for (int k = 0; k < 200; ++k) {
+        inserted.push_back(makePoint(grown.perturb(rng, 1.0 / 3600.0)));
+    }
+    for (int k = 0; k < 100; ++k) {
+        inserted.push_back(makePoint(center.perturb(rng, 1.0 / 3600.0)));
+    }
+    for (int k = 0; k < 50; ++k) {
+        inserted.push_back(makePoint(LonLat::random(rng)));
+    }
+    std::vector<size_t> erased;
+    std::uniform_int_distribution<size_t> pick{0, 3};
+    for (size_t id = 0; id < optics.tree().numIds(); ++id) {
+        int64_t const l = catalog.label(optics.tree()[id].record);
+        if (l == 3 || (l == NOISE_LABEL && pick(rng) == 0)) {
+            erased.push_back(id);
+        }
+    }
+    std::vector<size_t> ids = optics.update(inserted, erased);
+    ASSERT_EQ(ids.size(), inserted.size());
+    EXPECT_EQ(optics.size(), numPoints + inserted.size() - erased.size());
+    for (size_t k = 0; k < ids.size(); ++k) {
+        EXPECT_EQ(optics.tree()[ids[k]].record, inserted[k].record);
+    }
+    EXPECT_EQ(Clusters(optics), Rerun(optics));
+    // Only the clusters near updates are reordered.
+    EXPECT_LT(optics.reorderedPoints(), optics.size() / 2);
+
+    // Erase most of the new cluster, which dissolves into noise.
+    erased.assign(ids.begin() + 200, ids.begin() + 295);
+    ids = optics.update({}, erased);
+    EXPECT_TRUE(ids.empty());
+    EXPECT_EQ(Clusters(optics), Rerun(optics));
+    EXPECT_LT(optics.reorderedPoints(), 100);
+    for (size_t id : erased) {
+        EXPECT_FALSE(optics.tree().contains(id));
+    }
+
+    // Repeated updates reuse the slots of reordered clusters.
+    for (int step = 0; step < 20; ++step) {
+        inserted.clear();
+        for (int k = 0; k < 10; ++k) {
+            inserted.push_back(makePoint(grown.perturb(rng, 2.0 / 3600.0)));
+        }
+        optics.update(inserted, {});
+    }
+    EXPECT_EQ(Clusters(optics), Rerun(optics));
+
+    EXPECT_THROW(optics.update({}, erased), std::invalid_argument);
+    size_t live = 0;
+    while (!optics.tree().contains(live)) {
+        ++live;
+    }
+    size_t const twice[] = {live, live};
+    EXPECT_THROW(optics.update({}, twice), std::invalid_argument);
+    EXPECT_THROW((IncrementalOptics{{}, 0, Epsilon, 0.0, 16}), std::invalid_argument);
+}
+
+}  // namespace
+}  // namespace optics
@@ -0,0 +1,47 @@
+#include "Labels.h"
+
+#include <absl/cleanup/cleanup.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+
+namespace optics {
+
+LabelFile::LabelFile(std::filesystem::path const& path, size_t numRows) {
+    if (numRows == 0) {
+        throw std::invalid_argument("label file must hold at least one row");
+    }
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error(
+            fmt::format("failed to open {}: errno={}", path.string(), errno));
+    }
+    absl::Cleanup const closer = [fd] { ::close(fd); };
+    size_t const size = numRows * sizeof(int64_t);
+    if (::ftruncate(fd, static_cast<off_t>(size)) == -1) {
+        throw std::runtime_error(
+            fmt::format("failed to resize {}: errno={}", path.string(), errno));
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(
+            fmt::format("failed to mmap {}: errno={}", path.string(), errno));
+    }
+    labels_ = std::span<int64_t>{static_cast<int64_t*>(data), numRows};
+    std::fill(labels_.begin(), labels_.end(), NOISE_LABEL);
+}
+
+LabelFile::~LabelFile() { ::munmap(labels_.data(), labels_.size_bytes()); }
+
+void LabelFile::sync() {
+    if (::msync(labels_.data(), labels_.size_bytes(), MS_SYNC) == -1) {
+        throw std::runtime_error(fmt::format("failed to sync labels: errno={}", errno));
+    }
+}
+
+}  // namespace optics
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace optics {
+
+// Label of rows that belong to no cluster, both in generated catalogues and in the
+// labels written by BasicOptics::run().
+constexpr int64_t NOISE_LABEL = -1;
+
+// A file of native-endian 64-bit signed cluster labels, one per input row, that is
+// memory mapped so that BasicOptics::run() can write labels straight to it. The
+// label of row i is at byte offset 8i, so the file can be joined with the input by
+// row number without parsing.
+class LabelFile {
+    std::span<int64_t> labels_;
+
+   public:
+    // Creates (or truncates) the file at `path` with room for `numRows` labels, all
+    // initially NOISE_LABEL.
+    LabelFile(std::filesystem::path const& path, size_t numRows);
+
+    LabelFile(LabelFile const&) = delete;
+    LabelFile(LabelFile&&) = delete;
+    LabelFile& operator=(LabelFile const&) = delete;
+    LabelFile& operator=(LabelFile&&) = delete;
+
+    // Unmaps the file. Labels reach the disk whenever the kernel writes back the
+    // pages, or earlier with sync().
+    ~LabelFile();
+
+    std::span<int64_t> labels() const { return labels_; }
+
+    // Writes the labels to disk, and throws if that fails.
+    void sync();
+};
+
+}  // namespace optics
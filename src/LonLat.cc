@@ -101,7 +101,7 @@ LonLat LonLat::fromCsv(std::string_view csv, char delim) {
                       ? csv.end()
                       : csv.begin() + secondDelimOrNewline;
     auto latResult = fast_float::from_chars(lonEnd + 1, latEnd, lat);
-    if (latResult.ec != std::errc{} || latResult.ptr != lonEnd || lat < -90.0 ||
+    if (latResult.ec != std::errc{} || latResult.ptr != latEnd || lat < -90.0 ||
         lat > 90.0) {
         throw std::invalid_argument(fmt::format(
             "second field of csv line {} (delim={}) is not a valid latitude", csv,
@@ -0,0 +1,221 @@
+#include "Numa.h"
+
+#include <fmt/core.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace optics {
+
+namespace {
+
+constexpr size_t BITS_PER_WORD = sizeof(unsigned long) * 8;
+
+constexpr size_t HUGE_PAGE_2M = static_cast<size_t>(1) << 21;
+constexpr size_t HUGE_PAGE_1G = static_cast<size_t>(1) << 30;
+
+std::atomic<HugePages> hugePages{HugePages::TRANSPARENT};
+std::atomic<bool> mapMemoryFailure{false};
+
+size_t RoundUp(size_t size, size_t pageSize) {
+    return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+size_t RegularPageSize() {
+    static size_t const pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return pageSize;
+}
+
+// Maps memory from the hugetlbfs pool, or returns an empty block if the pool does
+// not have enough free pages of the given size.
+MemoryBlock MapHugeTlb(size_t size, size_t pageSize) {
+    size = RoundUp(size, pageSize);
+    // the page size is encoded as its base 2 logarithm
+    int const flag = std::countr_zero(pageSize) << MAP_HUGE_SHIFT;
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flag, -1, 0);
+    if (data == MAP_FAILED) {
+        return MemoryBlock{};
+    }
+    return MemoryBlock{data, size, pageSize};
+}
+
+// Maps `size` bytes of regular pages aligned to `alignment`, a multiple of the
+// regular page size, by over-allocating and trimming both ends.
+void* MapAligned(size_t size, size_t alignment) {
+    size_t const padded = size + alignment - RegularPageSize();
+    void* data = ::mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(
+            fmt::format("failed to map {} bytes of memory: errno={}", size, errno));
+    }
+    char* const begin = static_cast<char*>(data);
+    char* const aligned = reinterpret_cast<char*>(
+        RoundUp(reinterpret_cast<uintptr_t>(begin), alignment));
+    if (aligned != begin) {
+        ::munmap(begin, aligned - begin);
+    }
+    size_t const tail = padded - (aligned - begin) - size;
+    if (tail != 0) {
+        ::munmap(aligned + size, tail);
+    }
+    return aligned;
+}
+
+// Parses a sysfs list such as "0-3,8,10-11".
+std::vector<int> ParseList(std::string const& list) {
+    std::vector<int> ids;
+    char const* p = list.data();
+    char const* const end = p + list.size();
+    while (p < end) {
+        int first = 0;
+        auto result = std::from_chars(p, end, first);
+        if (result.ec != std::errc{}) {
+            break;
+        }
+        int last = first;
+        p = result.ptr;
+        if (p < end && *p == '-') {
+            result = std::from_chars(p + 1, end, last);
+            if (result.ec != std::errc{}) {
+                break;
+            }
+            p = result.ptr;
+        }
+        for (int id = first; id <= last; ++id) {
+            ids.push_back(id);
+        }
+        if (p < end && *p == ',') {
+            ++p;
+        } else {
+            break;
+        }
+    }
+    return ids;
+}
+
+std::vector<int> ReadList(char const* path) {
+    std::ifstream in{path};
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        return {};
+    }
+    return ParseList(line);
+}
+
+bool SetPolicy(void* data, size_t size, int mode, std::vector<int> const& nodes) {
+    if (nodes.empty()) {
+        return false;
+    }
+    int maxNode = 0;
+    for (int node : nodes) {
+        maxNode = std::max(maxNode, node);
+    }
+    std::vector<unsigned long> mask(maxNode / BITS_PER_WORD + 1, 0);
+    for (int node : nodes) {
+        mask[node / BITS_PER_WORD] |= 1ul << (node % BITS_PER_WORD);
+    }
+    long const rc = ::syscall(SYS_mbind, data, size, mode, mask.data(),
+                              mask.size() * BITS_PER_WORD + 1, 0);
+    return rc == 0;
+}
+
+}  // namespace
+
+std::vector<int> NumaNodes() {
+    std::vector<int> nodes = ReadList("/sys/devices/system/node/online");
+    if (nodes.empty()) {
+        nodes.push_back(0);
+    }
+    return nodes;
+}
+
+std::vector<int> NumaNodeCpus(int node) {
+    std::vector<int> cpus =
+        ReadList(fmt::format("/sys/devices/system/node/node{}/cpulist", node).c_str());
+    if (cpus.empty()) {
+        int const n = static_cast<int>(ResolveThreadCount(0));
+        for (int cpu = 0; cpu < n; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+bool PinThreadToNumaNode(int node) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : NumaNodeCpus(node)) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool InterleaveMemory(void* data, size_t size) {
+    return SetPolicy(data, size, MPOL_INTERLEAVE, NumaNodes());
+}
+
+bool PreferMemoryNode(void* data, size_t size, int node) {
+    return SetPolicy(data, size, MPOL_PREFERRED, {node});
+}
+
+void SetHugePages(HugePages mode) { hugePages.store(mode, std::memory_order_relaxed); }
+
+HugePages GetHugePages() { return hugePages.load(std::memory_order_relaxed); }
+
+void SetMapMemoryFailure(bool fail) {
+    mapMemoryFailure.store(fail, std::memory_order_relaxed);
+}
+
+MemoryBlock MapMemory(size_t size) {
+    if (mapMemoryFailure.load(std::memory_order_relaxed)) {
+        throw std::runtime_error(
+            fmt::format("failed to map {} bytes of memory: errno={}", size, ENOMEM));
+    }
+    HugePages const mode = GetHugePages();
+    if (mode == HugePages::EXPLICIT) {
+        if (size >= HUGE_PAGE_1G) {
+            MemoryBlock block = MapHugeTlb(size, HUGE_PAGE_1G);
+            if (block.data != nullptr) {
+                return block;
+            }
+        }
+        if (size >= HUGE_PAGE_2M) {
+            MemoryBlock block = MapHugeTlb(size, HUGE_PAGE_2M);
+            if (block.data != nullptr) {
+                return block;
+            }
+        }
+    }
+    if (mode != HugePages::NONE && size >= HUGE_PAGE_2M) {
+        size = RoundUp(size, HUGE_PAGE_2M);
+        void* data = MapAligned(size, HUGE_PAGE_2M);
+        // failure only means that the kernel does not support transparent huge pages
+        ::madvise(data, size, MADV_HUGEPAGE);
+        return MemoryBlock{data, size, HUGE_PAGE_2M};
+    }
+    size = RoundUp(size, RegularPageSize());
+    return MemoryBlock{MapAligned(size, RegularPageSize()), size, RegularPageSize()};
+}
+
+void UnmapMemory(MemoryBlock const& block) { ::munmap(block.data, block.size); }
+
+}  // namespace optics
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Parallel.h"
+
+namespace optics {
+
+// Returns the ids of the online NUMA nodes, or {0} if the system does not expose
+// NUMA topology.
+std::vector<int> NumaNodes();
+
+// Returns the ids of the CPUs belonging to the given NUMA node, or all CPUs if the
+// system does not expose NUMA topology.
+std::vector<int> NumaNodeCpus(int node);
+
+// Restricts the calling thread to the CPUs of the given NUMA node. Returns false if
+// that is not possible.
+bool PinThreadToNumaNode(int node);
+
+// Sets the NUMA memory policy for the pages spanned by [data, data + size), which
+// must be page aligned: pages are interleaved across all NUMA nodes, or preferably
+// placed on the given node. The policy only affects pages that have not been
+// touched yet. Returns false if the policy could not be set, which is harmless on
+// systems with a single NUMA node.
+bool InterleaveMemory(void* data, size_t size);
+bool PreferMemoryNode(void* data, size_t size, int node);
+
+// Which pages back the memory returned by MapMemory(). With hundreds of millions of
+// points, random accesses to points, tree nodes and seed list entries mostly miss
+// the TLB when memory is mapped with 4 KB pages.
+enum class HugePages {
+    // regular pages only
+    NONE,
+    // transparent huge pages, requested with madvise(MADV_HUGEPAGE) for mappings of
+    // at least 2 MB. Mappings are 2 MB aligned so that they can be fully backed by
+    // huge pages, which the kernel provides when it can.
+    TRANSPARENT,
+    // pages from the pre-reserved hugetlbfs pool: 1 GB pages for mappings of at least
+    // 1 GB, and 2 MB pages for mappings of at least 2 MB, falling back to transparent
+    // huge pages when the pool has too few free pages. The pool must be large enough
+    // on every NUMA node that memory may be placed on: faults on a node without free
+    // reserved pages are fatal.
+    EXPLICIT,
+};
+
+// Sets or returns the process wide huge page mode used by subsequent calls to
+// MapMemory(). The default is HugePages::TRANSPARENT.
+void SetHugePages(HugePages mode);
+HugePages GetHugePages();
+
+// A memory mapping. `size` is the number of bytes requested, rounded up to a multiple
+// of `pageSize`.
+struct MemoryBlock {
+    void* data = nullptr;
+    size_t size = 0;
+    size_t pageSize = 0;
+};
+
+// Maps anonymous, page aligned memory according to the current huge page mode, and
+// unmaps it. MapMemory() throws on failure.
+MemoryBlock MapMemory(size_t size);
+void UnmapMemory(MemoryBlock const& block);
+
+// Makes subsequent calls to MapMemory() fail as if the system were out of memory,
+// until called with false. For testing how failures are handled.
+void SetMapMemoryFailure(bool fail);
+
+// How the pages of a NumaArray are distributed over NUMA nodes.
+enum class MemoryPlacement {
+    // Pages are placed on the node of the thread that first touches them. The array
+    // is initialized in parallel by threads that split it into equal contiguous
+    // chunks, like ParallelFor(), so that subsequent parallel work with the same
+    // partitioning mostly accesses local memory.
+    FIRST_TOUCH,
+    // Pages are interleaved across all nodes, so that threads on every node see the
+    // same average memory latency.
+    INTERLEAVE,
+    // The array is allocated on the heap and initialized by the calling thread. For
+    // small arrays, a mapping of their own and parallel initialization cost more
+    // than placing their few pages saves.
+    HEAP,
+};
+
+// Arrays smaller than this are allocated with MemoryPlacement::HEAP by
+// InterleaveIfLarge().
+constexpr size_t MIN_INTERLEAVE_BYTES = static_cast<size_t>(4) << 20;
+
+// Returns the placement of an array of `size` objects of type T that threads on all
+// nodes access at random, such as the nodes of a 3-d tree: INTERLEAVE if it spans
+// at least MIN_INTERLEAVE_BYTES, HEAP otherwise.
+template <typename T>
+MemoryPlacement InterleaveIfLarge(size_t size) {
+    return size * sizeof(T) >= MIN_INTERLEAVE_BYTES ? MemoryPlacement::INTERLEAVE
+                                                    : MemoryPlacement::HEAP;
+}
+
+// A fixed size array of trivially destructible objects, allocated directly with mmap
+// so that its pages can be placed on NUMA nodes independently of the heap.
+template <typename T>
+class NumaArray {
+    static_assert(std::is_trivially_destructible_v<T>);
+
+   public:
+    NumaArray() = default;
+
+    // Allocates and default constructs `size` elements.
+    NumaArray(size_t size, MemoryPlacement placement, size_t numThreads = 0)
+        : block_{placement == MemoryPlacement::HEAP ? AllocateHeap(bytes(size))
+                                                    : MapMemory(bytes(size))},
+          size_{size} {
+        T* const data = this->data();
+        if (placement == MemoryPlacement::HEAP) {
+            for (size_t i = 0; i < size; ++i) {
+                new (data + i) T{};
+            }
+            return;
+        }
+        if (placement == MemoryPlacement::INTERLEAVE) {
+            InterleaveMemory(block_.data, block_.size);
+        }
+        ParallelFor(size, numThreads, [data](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                new (data + i) T{};
+            }
+        });
+    }
+
+    // Allocates `size` elements, preferably on the given node, and initializes them
+    // with fn(data, size) on the calling thread.
+    template <typename F>
+    NumaArray(size_t size, int node, F&& fn)
+        : block_{MapMemory(bytes(size))}, size_{size} {
+        PreferMemoryNode(block_.data, block_.size, node);
+        fn(data(), size);
+    }
+
+    NumaArray(NumaArray const&) = delete;
+    NumaArray& operator=(NumaArray const&) = delete;
+
+    NumaArray(NumaArray&& other) noexcept
+        : block_{std::exchange(other.block_, MemoryBlock{})},
+          size_{std::exchange(other.size_, 0)} {}
+
+    NumaArray& operator=(NumaArray&& other) noexcept {
+        if (this != &other) {
+            release();
+            block_ = std::exchange(other.block_, MemoryBlock{});
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    ~NumaArray() { release(); }
+
+    T* data() { return static_cast<T*>(block_.data); }
+    T const* data() const { return static_cast<T const*>(block_.data); }
+    size_t size() const { return size_; }
+    T& operator[](size_t i) { return data()[i]; }
+    T const& operator[](size_t i) const { return data()[i]; }
+
+    // Returns the size of the pages backing this array, or 0 if it is empty or on the
+    // heap. With transparent huge pages, this is the page size that was requested.
+    size_t pageSize() const { return block_.pageSize; }
+
+   private:
+    // alignment of heap allocated arrays: a cache line
+    static constexpr std::align_val_t HEAP_ALIGNMENT{64};
+    static_assert(alignof(T) <= 64);
+
+    // A block with a page size of 0 is a heap allocation.
+    MemoryBlock block_;
+    size_t size_ = 0;
+
+    static size_t bytes(size_t size) { return size == 0 ? 1 : size * sizeof(T); }
+
+    static MemoryBlock AllocateHeap(size_t size) {
+        return MemoryBlock{::operator new(size, HEAP_ALIGNMENT), size, 0};
+    }
+
+    void release() {
+        if (block_.data == nullptr) {
+            return;
+        }
+        if (block_.pageSize == 0) {
+            ::operator delete(block_.data, HEAP_ALIGNMENT);
+        } else {
+            UnmapMemory(block_);
+        }
+    }
+};
+
+// A standard allocator that maps every allocation with MapMemory(), so that
+// containers such as the caller owned std::vector<Point> passed to Optics are backed
+// by huge pages. Intended for a few large, long lived allocations: each one is a
+// separate mapping.
+template <typename T>
+struct HugePageAllocator {
+    static_assert(alignof(T) <= 64);
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(HugePageAllocator<U> const&) {}
+
+    // The block is recorded in front of the elements, which start one cache line into
+    // the mapping, because unmapping huge pages requires the exact mapping size.
+    T* allocate(size_t n) {
+        MemoryBlock const block = MapMemory(HEADER + n * sizeof(T));
+        new (block.data) MemoryBlock{block};
+        return reinterpret_cast<T*>(static_cast<char*>(block.data) + HEADER);
+    }
+
+    void deallocate(T* p, size_t) {
+        void* const data = reinterpret_cast<char*>(p) - HEADER;
+        MemoryBlock const block = *static_cast<MemoryBlock*>(data);
+        UnmapMemory(block);
+    }
+
+    template <typename U>
+    bool operator==(HugePageAllocator<U> const&) const {
+        return true;
+    }
+
+   private:
+    static constexpr size_t HEADER = 64;
+    static_assert(sizeof(MemoryBlock) <= HEADER);
+};
+
+}  // namespace optics
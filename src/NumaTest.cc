@@ -0,0 +1,103 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "Numa.h"
+#include "Tree.h"
+#include "TreeReplicas.h"
+
+namespace optics {
+namespace {
+
+TEST(NumaTest, Topology) {
+    std::vector<int> const nodes = NumaNodes();
+    ASSERT_FALSE(nodes.empty());
+    for (int node : nodes) {
+        EXPECT_FALSE(NumaNodeCpus(node).empty());
+    }
+}
+
+TEST(NumaTest, NumaArray) {
+    for (auto placement : {MemoryPlacement::FIRST_TOUCH, MemoryPlacement::INTERLEAVE,
+                           MemoryPlacement::HEAP}) {
+        NumaArray<Point> points{100000, placement, 4};
+        ASSERT_EQ(points.size(), 100000);
+        for (size_t i = 0; i < points.size(); ++i) {
+            ASSERT_EQ(points[i].state, UNPROCESSED);
+            ASSERT_EQ(points[i].next, NOT_FOUND);
+        }
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(points.data()) % alignof(Point), 0);
+        EXPECT_EQ(points.pageSize() == 0, placement == MemoryPlacement::HEAP);
+        NumaArray<Point> moved = std::move(points);
+        EXPECT_EQ(moved.size(), 100000);
+        EXPECT_EQ(points.data(), nullptr);
+        // move assignment releases the previous array
+        moved = NumaArray<Point>{10, placement};
+        EXPECT_EQ(moved[9].state, UNPROCESSED);
+    }
+    EXPECT_EQ(InterleaveIfLarge<Point>(1000), MemoryPlacement::HEAP);
+    EXPECT_EQ(InterleaveIfLarge<Point>(MIN_INTERLEAVE_BYTES / sizeof(Point)),
+              MemoryPlacement::INTERLEAVE);
+    int const node = NumaNodes().front();
+    NumaArray<size_t> local{1000, node, [](size_t* data, size_t n) {
+                                for (size_t i = 0; i < n; ++i) {
+                                    data[i] = i;
+                                }
+                            }};
+    EXPECT_EQ(local[999], 999);
+}
+
+TEST(NumaTest, HugePages) {
+    HugePages const previous = GetHugePages();
+    size_t const twoMB = static_cast<size_t>(1) << 21;
+    for (auto mode : {HugePages::NONE, HugePages::TRANSPARENT, HugePages::EXPLICIT}) {
+        SetHugePages(mode);
+        for (size_t size : {size_t{1}, size_t{100000}, 3 * twoMB + 1}) {
+            MemoryBlock const block = MapMemory(size);
+            ASSERT_NE(block.data, nullptr);
+            EXPECT_GE(block.size, size);
+            EXPECT_EQ(block.size % block.pageSize, 0);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(block.data) % block.pageSize, 0);
+            if (mode == HugePages::NONE || size < twoMB) {
+                EXPECT_LT(block.pageSize, twoMB);
+            } else {
+                EXPECT_EQ(block.pageSize, twoMB);
+            }
+            static_cast<char*>(block.data)[size - 1] = 1;
+            UnmapMemory(block);
+        }
+        NumaArray<Point> points{twoMB, MemoryPlacement::INTERLEAVE};
+        EXPECT_EQ(points[twoMB - 1].next, NOT_FOUND);
+        std::vector<Point, HugePageAllocator<Point>> vector(100000);
+        vector.resize(200000);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(vector.data()) % alignof(Point), 0);
+        EXPECT_EQ(vector.back().state, UNPROCESSED);
+    }
+    SetHugePages(previous);
+}
+
+TEST(NumaTest, ReplicaMappingFailure) {
+    std::vector<Point> points(10000);
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> coord{-1.0, 1.0};
+    for (Point& p : points) {
+        p.v = Vec3{coord(rng), coord(rng), coord(rng)};
+    }
+    Tree tree{points.data(), points.size(), 32, 0.0};
+    // the failure to map the memory of a replica reaches the caller
+    SetMapMemoryFailure(true);
+    EXPECT_THAT([&] { TreeReplicas(tree, {NumaNodes().front()}); },
+                testing::ThrowsMessage<std::runtime_error>(
+                    testing::HasSubstr("failed to map")));
+    SetMapMemoryFailure(false);
+    TreeReplicas replicas{tree, {NumaNodes().front()}};
+    EXPECT_EQ(replicas.size(), 1);
+}
+
+}  // namespace
+}  // namespace optics
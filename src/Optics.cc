@@ -1,31 +1,479 @@
 #include "Optics.h"
 
+#include <absl/cleanup/cleanup.h>
 #include <absl/log/check.h>
 #include <absl/log/log.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <functional>
+#include <limits>
 #include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "Checkpoint.h"
+#include "CoreDistance.h"
+#include "Parallel.h"
+#include "UnionFind.h"
 
 namespace optics {
 
-Optics::Optics(Point *points, size_t numPoints, size_t minNeighbors, double epsilon,
-               double leafExtentThreshold, size_t pointsPerLeaf)
+namespace {
+
+// Number of points processed between checks of the clock for progress reporting and
+// checkpointing.
+constexpr size_t PERIODIC_STRIDE = 4096;
+
+// Number of consecutive points claimed at a time by a thread linking the points of
+// epsilon-connected components
+constexpr size_t LINK_BLOCK_SIZE = 1024;
+
+// Reports progress to an observer at most once per interval.
+class ProgressReporter {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    ProgressReporter(ProgressObserver *observer, Clock::duration interval,
+                     size_t numPoints, size_t processed)
+        : observer_{observer},
+          interval_{interval},
+          start_{Clock::now()},
+          last_{start_},
+          lastProcessed_{processed},
+          numPoints_{numPoints} {}
+
+    void maybeReport(Clock::time_point now, size_t processed, size_t seedListSize,
+                     size_t clustersPublished) {
+        if (observer_ != nullptr && now - last_ >= interval_) {
+            report(now, processed, seedListSize, clustersPublished);
+        }
+    }
+
+    void finish(size_t processed, size_t clustersPublished) {
+        if (observer_ != nullptr) {
+            report(Clock::now(), processed, 0, clustersPublished);
+        }
+    }
+
+   private:
+    ProgressObserver *observer_;
+    Clock::duration interval_;
+    Clock::time_point start_;
+    Clock::time_point last_;
+    size_t lastProcessed_;
+    size_t numPoints_;
+
+    void report(Clock::time_point now, size_t processed, size_t seedListSize,
+                size_t clustersPublished) {
+        Progress progress;
+        progress.pointsProcessed = processed;
+        progress.numPoints = numPoints_;
+        progress.seedListSize = seedListSize;
+        progress.clustersPublished = clustersPublished;
+        progress.elapsedSeconds = std::chrono::duration<double>(now - start_).count();
+        double const seconds = std::chrono::duration<double>(now - last_).count();
+        progress.pointsPerSecond =
+            seconds > 0.0 ? (processed - lastProcessed_) / seconds : 0.0;
+        progress.remainingSeconds =
+            processed == numPoints_ ? 0.0
+            : progress.pointsPerSecond > 0.0
+                ? (numPoints_ - processed) / progress.pointsPerSecond
+                : std::numeric_limits<double>::infinity();
+        last_ = now;
+        lastProcessed_ = processed;
+        observer_->onProgress(progress);
+    }
+};
+
+// Tags each point with its position, so that rows can be recovered after building a
+// spatial index has reordered the points.
+Point *TagRows(Point *points, size_t numPoints) {
+    if (points != nullptr) {
+        ParallelFor(numPoints, 0, [points](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                points[i].state = i;
+            }
+        });
+    }
+    return points;
+}
+
+}  // namespace
+
+template <typename Index>
+BasicOptics<Index>::BasicOptics(Point *points, size_t numPoints, size_t minNeighbors,
+                                double epsilon, double leafExtentThreshold,
+                                size_t pointsPerLeaf)
     : points_{points},
       numPoints_{numPoints},
-      tree_{points, numPoints, pointsPerLeaf, leafExtentThreshold},
+      index_{TagRows(points, numPoints), numPoints, pointsPerLeaf, leafExtentThreshold},
       seeds_{points, numPoints},
-      epsilon_{std::abs(epsilon)},
-      minNeighbors_{minNeighbors} {}
+      rows_(numPoints) {
+    ParallelFor(numPoints, 0, [this](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            rows_[i] = points_[i].state;
+        }
+    });
+    setParameters(minNeighbors, epsilon);
+    stats_.buildSeconds = index_.buildSeconds();
+}
+
+template <typename Index>
+BasicOptics<Index>::BasicOptics(Point *points, size_t numPoints, size_t minNeighbors,
+                                double epsilon, IndexParameters const &parameters)
+    : BasicOptics(points, numPoints, minNeighbors, epsilon,
+                  parameters.leafExtentThreshold, parameters.pointsPerLeaf) {}
+
+template <typename Index>
+BasicOptics<Index>::BasicOptics(Point *points, size_t numPoints, size_t minNeighbors,
+                                double epsilon)
+    : BasicOptics(points, numPoints, minNeighbors, epsilon,
+                  AutoTuneIndex<Index>(points, numPoints, std::abs(epsilon))) {}
 
-void Optics::run(ClusterPublisher &publisher) {
-    if (points_ == nullptr) {
-        throw std::runtime_error("OPTICS has already been run");
+template <typename Index>
+BasicOptics<Index>::BasicOptics(Point *points, size_t numPoints, Duplicates duplicates,
+                                size_t minNeighbors, double epsilon,
+                                double leafExtentThreshold, size_t pointsPerLeaf)
+    : BasicOptics{points, numPoints, minNeighbors, epsilon, leafExtentThreshold,
+                  pointsPerLeaf} {
+    if (duplicates.size() != numPoints) {
+        throw std::invalid_argument(
+            "duplicates must be provided for every weighted point");
+    }
+    if (duplicates.rows.size() != duplicates.records.size()) {
+        throw std::invalid_argument(
+            "weighted points must be obtained from CollapseDuplicates()");
+    }
+    // Building the tree reordered the points, whose original positions are the
+    // indexes of their members: reorder the members to match.
+    duplicates_.records.reserve(duplicates.records.size());
+    duplicates_.rows.reserve(duplicates.rows.size());
+    duplicates_.offsets.reserve(numPoints + 1);
+    for (size_t i = 0; i < numPoints; ++i) {
+        size_t const g = rows_[i];
+        auto const members = duplicates.members(g);
+        duplicates_.records.insert(duplicates_.records.end(), members.begin(),
+                                   members.end());
+        auto const rows = duplicates.rows.begin() + duplicates.offsets[g];
+        duplicates_.rows.insert(duplicates_.rows.end(), rows, rows + members.size());
+        duplicates_.offsets.push_back(duplicates_.records.size());
     }
+    rows_ = std::move(duplicates_.rows);
+    duplicates_.rows.clear();
+    weighted_ = true;
+}
 
+template <typename Index>
+void BasicOptics<Index>::run(ClusterPublisher &publisher) {
     LOG(INFO) << "clustering " << numPoints_ << " points using OPTICS";
-    std::vector<char const *> cluster;
-    size_t scanFrom = 0;
+    reset();
+    OrderingState state;
+    state.numPoints = numPoints_;
+    state.minNeighbors = minNeighbors_;
+    state.epsilon = epsilon_;
+    cluster_.clear();
+    order(&publisher, state, true);
+}
+
+template <typename Index>
+void BasicOptics<Index>::run(ClusterPublisher &publisher, size_t minNeighbors,
+                             double epsilon) {
+    setParameters(minNeighbors, epsilon);
+    run(publisher);
+}
+
+template <typename Index>
+void BasicOptics<Index>::run(std::span<int64_t> labels) {
+    if (labels.size() != rows_.size()) {
+        throw std::invalid_argument("one label must be provided per input row");
+    }
+    LOG(INFO) << "labeling " << rows_.size() << " rows using OPTICS";
+    reset();
+    OrderingState state;
+    state.numPoints = numPoints_;
+    state.minNeighbors = minNeighbors_;
+    state.epsilon = epsilon_;
+    cluster_.clear();
+    labels_ = labels;
+    // Checkpoints can only be resumed by publishing clusters.
+    order(nullptr, state, false);
+    labels_ = {};
+}
+
+template <typename Index>
+void BasicOptics<Index>::runParallel(ClusterPublisher &publisher, size_t numThreads) {
+    if (weighted_) {
+        throw std::invalid_argument("parallel runs do not support weighted points");
+    }
+    LOG(INFO) << "clustering " << numPoints_
+              << " points using OPTICS over epsilon-connected components";
+    OPTICS_STATS(auto const start = std::chrono::steady_clock::now());
+    numThreads = ResolveThreadCount(numThreads);
+    reset();
+    clustersPublished_ = 0;
+
+    // Link the points within epsilon of each other. Every link is found from both of
+    // its points: only follow it from the larger one. Neighborhood sizes vary by
+    // orders of magnitude between dense clusters and the background, so threads
+    // claim small blocks of points rather than fixed ranges.
+    UnionFind components{numPoints_, numThreads};
+    size_t const numBlocks = (numPoints_ + LINK_BLOCK_SIZE - 1) / LINK_BLOCK_SIZE;
+    ParallelForDynamic(numBlocks, numThreads, [&](size_t, size_t b) {
+        size_t const end = std::min(numPoints_, (b + 1) * LINK_BLOCK_SIZE);
+        for (size_t i = b * LINK_BLOCK_SIZE; i < end; ++i) {
+            index_.visitRange(points_[i].v, epsilon_, [&](size_t j, double) {
+                if (j < i) {
+                    components.unite(i, j);
+                }
+            });
+        }
+    });
+    // Gather the points of each component in point order. The root of a component
+    // is its first point.
+    std::vector<size_t> roots(numPoints_);
+    ParallelFor(numPoints_, numThreads, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            roots[i] = components.find(i);
+        }
+    });
+    std::vector<size_t> offsets(numPoints_, 0);
+    for (size_t i = 0; i < numPoints_; ++i) {
+        ++offsets[roots[i]];
+    }
+    struct Component {
+        size_t begin;
+        size_t size;
+    };
+    std::vector<Component> sorted;
+    size_t offset = 0;
+    for (size_t i = 0; i < numPoints_; ++i) {
+        if (roots[i] == i) {
+            size_t const size = offsets[i];
+            sorted.push_back(Component{offset, size});
+            offsets[i] = offset;
+            offset += size;
+        }
+    }
+    std::vector<size_t> members(numPoints_);
+    for (size_t i = 0; i < numPoints_; ++i) {
+        members[offsets[roots[i]]++] = i;
+    }
+    std::vector<size_t>{}.swap(roots);
+    std::vector<size_t>{}.swap(offsets);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](Component const &a, Component const &b) {
+                         return a.size > b.size;
+                     });
+    // Tasks are ranges of components, largest first, of at least MIN_TASK_POINTS
+    // points unless they are the last one.
+    std::vector<size_t> tasks;
+    for (size_t c = 0, points = 0; c < sorted.size(); ++c) {
+        if (points == 0) {
+            tasks.push_back(c);
+        }
+        points += sorted[c].size;
+        if (points >= MIN_TASK_POINTS) {
+            points = 0;
+        }
+    }
+    tasks.push_back(sorted.size());
+    LOG(INFO) << "found " << sorted.size() << " epsilon-connected components, "
+              << "ordered by " << tasks.size() - 1 << " tasks";
+
+    // Order the components, keeping the clusters of each task until all tasks are
+    // done: the publisher is only called from this thread.
+    std::vector<ComponentWorker> workers(numThreads);
+    std::vector<ComponentOrdering> orderings(tasks.size() - 1);
+    FirstException error;
+    ParallelForDynamic(tasks.size() - 1, numThreads, [&](size_t thread, size_t t) {
+        if (error.failed()) {
+            return;
+        }
+        error.run([&] {
+            ComponentWorker &worker = workers[thread];
+            // tasks are claimed in order, so the first task of a thread holds its
+            // largest component
+            size_t const largest = sorted[tasks[t]].size;
+            if (!worker.seeds || worker.seeds->capacity() < largest) {
+                worker.seeds.emplace(points_, numPoints_, largest);
+            }
+            for (size_t c = tasks[t]; c < tasks[t + 1]; ++c) {
+                orderComponent(worker, orderings[t], members.data() + sorted[c].begin,
+                               sorted[c].size);
+            }
+        });
+    });
+    error.rethrow();
+    std::vector<size_t>{}.swap(members);
+    for (ComponentOrdering &ordering : orderings) {
+        size_t begin = 0;
+        for (size_t end : ordering.ends) {
+            cluster_.assign(ordering.order.begin() + begin,
+                            ordering.order.begin() + end);
+            summary_ = ClusterSummary{};
+            reachSum_ = 0.0;
+            for (size_t i : cluster_) {
+                summarize(i);
+            }
+            publish(&publisher);
+            begin = end;
+        }
+        ComponentOrdering{}.swap(ordering);
+    }
+    cluster_.clear();
+    OPTICS_STATS({
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        stats_.orderingSeconds = elapsed.count() - stats_.publishSeconds;
+        for (ComponentWorker const &worker : workers) {
+            if (worker.seeds) {
+                stats_.seeds += worker.seeds->stats();
+            }
+        }
+    });
+    LOG(INFO) << "finished clustering";
+}
+
+template <typename Index>
+void BasicOptics<Index>::run(std::span<int64_t> labels, size_t minNeighbors,
+                             double epsilon) {
+    setParameters(minNeighbors, epsilon);
+    run(labels);
+}
+
+template <typename Index>
+void BasicOptics<Index>::resume(ClusterPublisher &publisher,
+                                std::filesystem::path const &path) {
+    LOG(INFO) << "resuming OPTICS clustering of " << numPoints_ << " points from "
+              << path;
+    // Check the parameters before restoring any point.
+    OrderingState const header = ReadCheckpointState(path);
+    if (header.minNeighbors != minNeighbors_ || header.epsilon != epsilon_) {
+        throw std::runtime_error(
+            "checkpoint was created with different OPTICS parameters");
+    }
+    std::vector<size_t> heap(numPoints_);
+    OrderingState state =
+        ReadCheckpoint(path, points_, numPoints_, heap.data(), cluster_);
+    resetStats();
+    seeds_.restore(heap.data(), state.seedListSize);
+    LOG(INFO) << "resuming after " << state.pointsProcessed << " points and "
+              << state.clustersPublished << " clusters";
+    order(&publisher, state, true);
+}
+
+template <typename Index>
+void BasicOptics<Index>::setParameters(size_t minNeighbors, double epsilon) {
+    if (minNeighbors == 0) {
+        throw std::invalid_argument("minimum number of neighbors must be > 0");
+    }
+    if (minNeighbors > distancesCapacity_) {
+        distances_ = std::make_unique<double[]>(minNeighbors);
+        distancesCapacity_ = minNeighbors;
+    }
+    minNeighbors_ = minNeighbors;
+    epsilon_ = std::abs(epsilon);
+}
+
+template <typename Index>
+void BasicOptics<Index>::reset() {
+    // Mark all points as unprocessed. Run in parallel so that resetting doesn't
+    // dominate short runs over large inputs.
+    ParallelFor(numPoints_, 0, [this](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            points_[i].reach = std::numeric_limits<double>::infinity();
+            points_[i].state = UNPROCESSED;
+        }
+    });
+    seeds_.clear();
+    resetStats();
+}
+
+template <typename Index>
+void BasicOptics<Index>::resetStats() {
+    index_.resetStats();
+    seeds_.resetStats();
+    double const buildSeconds = stats_.buildSeconds;
+    stats_ = OpticsStats{};
+    stats_.buildSeconds = buildSeconds;
+}
+
+template <typename Index>
+void BasicOptics<Index>::setMixedPrecision(bool enabled) {
+    if constexpr (std::is_same_v<Index, Tree>) {
+        index_.setMixedPrecision(enabled);
+    }
+}
+
+template <typename Index>
+void BasicOptics<Index>::compactRecords(std::string_view input, char terminator,
+                                        size_t numThreads) {
+    if (weighted_) {
+        // members are already stored in point order
+        recordArena_ =
+            RecordArena{duplicates_.records, input, terminator, numThreads};
+        for (size_t i = 0; i < numPoints_; ++i) {
+            points_[i].record = duplicates_.members(i).front();
+        }
+        return;
+    }
+    std::vector<char const *> records(numPoints_);
+    for (size_t i = 0; i < numPoints_; ++i) {
+        records[i] = points_[i].record;
+    }
+    recordArena_ = RecordArena{records, input, terminator, numThreads};
+    for (size_t i = 0; i < numPoints_; ++i) {
+        points_[i].record = records[i];
+    }
+}
+
+template <typename Index>
+void BasicOptics<Index>::setProgressObserver(ProgressObserver *observer,
+                                             std::chrono::milliseconds interval) {
+    observer_ = observer;
+    progressInterval_ = interval;
+}
+
+template <typename Index>
+void BasicOptics<Index>::setCheckpoint(std::filesystem::path const &path,
+                                       std::chrono::milliseconds interval) {
+    checkpointPath_ = path;
+    checkpointInterval_ = interval;
+}
+
+template <typename Index>
+void BasicOptics<Index>::order(ClusterPublisher *publisher, OrderingState &state,
+                               bool checkpoint) {
+    using Clock = std::chrono::steady_clock;
+
+    OPTICS_STATS(auto const start = Clock::now());
+    ProgressReporter progress{observer_, progressInterval_, numPoints_,
+                              state.pointsProcessed};
+    std::unique_ptr<CheckpointWriter> checkpointer;
+    Clock::time_point nextCheckpoint;
+    if (checkpoint && !checkpointPath_.empty()) {
+        checkpointer = std::make_unique<CheckpointWriter>(checkpointPath_);
+        nextCheckpoint = Clock::now() + checkpointInterval_;
+    }
+    bool const periodic = observer_ != nullptr || checkpointer != nullptr;
+    size_t countdown = PERIODIC_STRIDE;
+    size_t scanFrom = state.scanFrom;
+    size_t processed = state.pointsProcessed;
+    clustersPublished_ = state.clustersPublished;
+    clusterStartCore_ = state.clusterStartCore != 0;
+    // Summaries are only published, not used for labeling. Summarize the points of
+    // a cluster restored from a checkpoint, if any.
+    bool const summarizing = publisher != nullptr;
+    summary_ = ClusterSummary{};
+    reachSum_ = 0.0;
+    if (summarizing) {
+        for (size_t i : cluster_) {
+            summarize(i);
+        }
+    }
 
     while (true) {
         size_t i;
@@ -41,52 +489,315 @@ void Optics::run(ClusterPublisher &publisher) {
                 break;
             }
             points_[i].state = PROCESSED;
-            expandClusterOrder(i);
-            if (cluster.size() > 0) {
+            bool const core = expandClusterOrder(i);
+            if (cluster_.size() > 0) {
                 // clusters of size 1 are generated for noise sources
-                publisher.publish(cluster);
-                cluster.clear();
+                publish(publisher);
+                cluster_.clear();
+                summary_ = ClusterSummary{};
+                reachSum_ = 0.0;
+            }
+            cluster_.push_back(i);
+            clusterStartCore_ = core;
+            if (summarizing) {
+                summarize(i);
             }
-            cluster.push_back(points_[i].record);
         } else {
             // expand cluster around seed with smallest reachability-distance
             i = seeds_.pop();
             expandClusterOrder(i);
             DCHECK(points_[i].reach != std::numeric_limits<double>::infinity());
-            cluster.push_back(points_[i].record);
+            cluster_.push_back(i);
+            if (summarizing) {
+                summarize(i);
+            }
+        }
+        ++processed;
+        if (periodic && --countdown == 0) {
+            countdown = PERIODIC_STRIDE;
+            Clock::time_point const now = Clock::now();
+            progress.maybeReport(now, processed, seeds_.size(), clustersPublished_);
+            if (checkpointer && now >= nextCheckpoint) {
+                state.scanFrom = scanFrom;
+                state.pointsProcessed = processed;
+                state.clustersPublished = clustersPublished_;
+                state.seedListSize = seeds_.size();
+                state.clusterSize = cluster_.size();
+                state.clusterStartCore = clusterStartCore_ ? 1 : 0;
+                if (checkpointer->write(state, points_, seeds_.heap(),
+                                        cluster_.data())) {
+                    nextCheckpoint = now + checkpointInterval_;
+                }
+            }
         }
     }
 
-    publisher.publish(cluster);
-    points_ = nullptr;
+    publish(publisher);
+    if (checkpointer) {
+        // the checkpoint is obsolete once clustering completes
+        checkpointer->wait();
+        std::error_code ec;
+        std::filesystem::remove(checkpointPath_, ec);
+    }
+    progress.finish(processed, clustersPublished_);
+    OPTICS_STATS({
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        stats_.orderingSeconds = elapsed.count() - stats_.publishSeconds;
+        stats_.query = index_.stats();
+        stats_.seeds = seeds_.stats();
+    });
     LOG(INFO) << "finished clustering";
 }
 
-void Optics::expandClusterOrder(size_t i) {
+template <typename Index>
+void BasicOptics<Index>::publish(ClusterPublisher *publisher) {
+    OPTICS_STATS(auto const start = std::chrono::steady_clock::now());
+    auto emit = [this, publisher](ClusterSummary const &summary) {
+        publisher->publishSummarized(records_, summary);
+        ++clustersPublished_;
+        OPTICS_STATS(++stats_.clusters);
+    };
+    if (publisher == nullptr) {
+        // Label clusters as if they were published, without gathering records.
+        size_t const first = cluster_[0];
+        size_t const weight = weighted_ ? duplicates_.weight(first) : 1;
+        if (cluster_.size() == 1 && (weight == 1 || !clusterStartCore_)) {
+            label(NOISE_LABEL, first);
+            clustersPublished_ += weight;
+            OPTICS_STATS(stats_.clusters += weight);
+        } else {
+            int64_t const cluster = static_cast<int64_t>(clustersPublished_);
+            for (size_t i : cluster_) {
+                label(cluster, i);
+            }
+            ++clustersPublished_;
+            OPTICS_STATS(++stats_.clusters);
+        }
+    } else if (weighted_ && cluster_.size() == 1 &&
+               duplicates_.weight(cluster_[0]) > 1 && !clusterStartCore_) {
+        // The members of a noise point are not density-reachable from each other,
+        // so each is a cluster of its own.
+        ClusterSummary summary;
+        summary.size = 1;
+        summary.sum = summary.center = summary.min = summary.max = summary_.min;
+        for (char const *record : duplicates_.members(cluster_[0])) {
+            records_.assign(1, record);
+            emit(summary);
+        }
+    } else {
+        FinishSummary(summary_, cluster_.size(),
+                      [this](size_t m) { return points_[cluster_[m]].v; });
+        records_.clear();
+        for (size_t i : cluster_) {
+            if (weighted_) {
+                auto const members = duplicates_.members(i);
+                records_.insert(records_.end(), members.begin(), members.end());
+            } else {
+                records_.push_back(points_[i].record);
+            }
+        }
+        if (cluster_.size() > 1) {
+            summary_.meanReach = reachSum_ / static_cast<double>(cluster_.size() - 1);
+        }
+        emit(summary_);
+    }
+    OPTICS_STATS({
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        stats_.publishSeconds += elapsed.count();
+    });
+}
+
+template <typename Index>
+void BasicOptics<Index>::summarize(size_t i) {
+    if (summary_.size != 0) {
+        double const reach = points_[i].reach;
+        if (std::isnan(summary_.minReach)) {
+            summary_.minReach = reach;
+            summary_.maxReach = reach;
+        } else {
+            summary_.minReach = std::min(summary_.minReach, reach);
+            summary_.maxReach = std::max(summary_.maxReach, reach);
+        }
+        reachSum_ += reach;
+    }
+    AddToSummary(summary_, points_[i].v, weighted_ ? duplicates_.weight(i) : 1);
+}
+
+template <typename Index>
+void BasicOptics<Index>::label(int64_t cluster, size_t i) {
+    if (weighted_) {
+        for (size_t m = duplicates_.offsets[i]; m < duplicates_.offsets[i + 1]; ++m) {
+            labels_[rows_[m]] = cluster;
+        }
+    } else {
+        labels_[rows_[i]] = cluster;
+    }
+}
+
+template <typename Index>
+void BasicOptics<Index>::pushWeighted(double dist, size_t weight, size_t k) {
+    if (heapWeight_ >= k && dist >= weightedHeap_.front().dist) {
+        // cannot be one of the k nearest neighbors
+        return;
+    }
+    weightedHeap_.push_back(WeightedDistance{dist, weight});
+    std::push_heap(weightedHeap_.begin(), weightedHeap_.end());
+    heapWeight_ += weight;
+    // drop the largest distances while the remainder still weighs at least k
+    while (heapWeight_ - weightedHeap_.front().weight >= k) {
+        heapWeight_ -= weightedHeap_.front().weight;
+        std::pop_heap(weightedHeap_.begin(), weightedHeap_.end());
+        weightedHeap_.pop_back();
+    }
+}
+
+template <typename Index>
+void BasicOptics<Index>::run(std::span<size_t const> minNeighbors,
+                             std::span<ClusterPublisher *const> publishers) {
+    if (minNeighbors.empty() || minNeighbors.size() != publishers.size()) {
+        throw std::invalid_argument(
+            "one publisher must be provided per minimum number of neighbors");
+    }
+    if (minNeighbors[0] == 0 ||
+        std::adjacent_find(minNeighbors.begin(), minNeighbors.end(),
+                           std::greater_equal<size_t>{}) != minNeighbors.end()) {
+        throw std::invalid_argument(
+            "minimum numbers of neighbors must be positive and strictly increasing");
+    }
+    size_t const original = minNeighbors_;
+    // Restore single ordering mode and free the neighborhood cache, even if an
+    // ordering or publisher throws. Core-distances are only kept if all orderings
+    // complete.
+    bool completed = false;
+    absl::Cleanup const restore = [this, original, &completed] {
+        expansion_ = Expansion::QUERY;
+        minNeighbors_ = original;
+        coreIndex_ = 0;
+        if (!completed) {
+            coreK_.clear();
+            coreDistances_.clear();
+        }
+        std::vector<Neighbor>{}.swap(neighborhoods_);
+        std::vector<size_t>{}.swap(neighborhoodBegin_);
+        std::vector<size_t>{}.swap(neighborhoodEnd_);
+    };
+    setParameters(minNeighbors.back(), epsilon_);
+    coreK_.assign(minNeighbors.begin(), minNeighbors.end());
+    coreDistances_.assign(coreK_.size(), std::vector<double>(numPoints_));
+    neighborhoodBegin_.assign(numPoints_, 0);
+    neighborhoodEnd_.assign(numPoints_, 0);
+    neighborhoods_.clear();
+
+    // The first ordering performs all range queries, and caches the neighborhoods
+    // and core-distances for all values of minNeighbors. Subsequent orderings replay
+    // them.
+    for (size_t m = 0; m < coreK_.size(); ++m) {
+        LOG(INFO) << "clustering " << numPoints_ << " points using OPTICS with "
+                  << coreK_[m] << " minimum neighbors"
+                  << (m == 0 ? "" : " (cached neighborhoods)");
+        minNeighbors_ = coreK_[m];
+        coreIndex_ = m;
+        expansion_ = m == 0 ? Expansion::QUERY_AND_CACHE : Expansion::REPLAY;
+        reset();
+        OrderingState state;
+        state.numPoints = numPoints_;
+        state.minNeighbors = minNeighbors_;
+        state.epsilon = epsilon_;
+        cluster_.clear();
+        order(publishers[m], state, false);
+    }
+    completed = true;
+}
+
+template <typename Index>
+std::span<double const> BasicOptics<Index>::coreDistances(size_t minNeighbors) const {
+    auto it = std::find(coreK_.begin(), coreK_.end(), minNeighbors);
+    if (it == coreK_.end()) {
+        throw std::invalid_argument("core-distances were not computed for the given "
+                                    "minimum number of neighbors");
+    }
+    return coreDistances_[it - coreK_.begin()];
+}
+
+template <typename Index>
+bool BasicOptics<Index>::expandClusterOrder(size_t i) {
+    if (expansion_ == Expansion::REPLAY) {
+        return replayNeighborhood(i);
+    }
+    bool const caching = expansion_ == Expansion::QUERY_AND_CACHE;
     // find epsilon neighborhood of point i
-    size_t const range = tree_.inRange(points_[i].v, epsilon_);
-    // compute core-distance
-    size_t n = 0;
+    size_t const range = index_.inRange(points_[i].v, epsilon_);
+    // compute core-distance, retaining the k smallest distances in a max-heap
+    size_t const k = caching ? coreK_.back() : minNeighbors_;
+    CoreDistanceHeap heap{distances_.get(), k};
     size_t j = range;
+    OPTICS_STATS(size_t numNeighbors = 0);
+    if (caching) {
+        neighborhoodBegin_[i] = neighborhoods_.size();
+    }
+    if (weighted_) {
+        // the other members of point i are neighbors at distance 0
+        weightedHeap_.clear();
+        heapWeight_ = 0;
+        if (duplicates_.weight(i) > 1) {
+            pushWeighted(0.0, duplicates_.weight(i) - 1, k);
+        }
+    }
     while (j != NOT_FOUND) {
         Point *p = points_ + j;
         if (j != i) {
+            OPTICS_STATS(++numNeighbors);
             double d = p->dist;
-            if (n < minNeighbors_) {
-                distances_[n++] = d;
-                std::push_heap(distances_.get(), distances_.get() + n);
-            } else if (distances_[0] > d) {
-                std::pop_heap(distances_.get(), distances_.get() + n);
-                distances_[n - 1] = d;
-                std::push_heap(distances_.get(), distances_.get() + n);
+            if (weighted_) {
+                pushWeighted(d, duplicates_.weight(j), k);
+            } else {
+                heap.add(d);
+            }
+            if (caching) {
+                neighborhoods_.push_back(Neighbor{j, d});
             }
         }
         j = p->next;
     }
-    if (n == minNeighbors_) {
+    OPTICS_STATS(++stats_.neighborhoodSizes[OpticsStats::histogramBin(numNeighbors)]);
+    double coreDist = std::numeric_limits<double>::infinity();
+    if (caching) {
+        neighborhoodEnd_[i] = neighborhoods_.size();
+        // the heap contains the n smallest distances; sort them to obtain the
+        // core-distance for every value of minNeighbors
+        if (weighted_) {
+            std::sort_heap(weightedHeap_.begin(), weightedHeap_.end());
+            size_t e = 0;
+            size_t weight = 0;
+            for (size_t m = 0; m < coreK_.size(); ++m) {
+                for (; e < weightedHeap_.size() && weight < coreK_[m]; ++e) {
+                    weight += weightedHeap_[e].weight;
+                }
+                coreDistances_[m][i] = weight >= coreK_[m]
+                                           ? weightedHeap_[e - 1].dist
+                                           : std::numeric_limits<double>::infinity();
+            }
+        } else {
+            heap.sort();
+            for (size_t m = 0; m < coreK_.size(); ++m) {
+                coreDistances_[m][i] = heap.size() >= coreK_[m]
+                                           ? distances_[coreK_[m] - 1]
+                                           : std::numeric_limits<double>::infinity();
+            }
+        }
+        coreDist = coreDistances_[coreIndex_][i];
+    } else if (weighted_) {
+        if (heapWeight_ >= minNeighbors_) {
+            coreDist = weightedHeap_.front().dist;
+        }
+    } else {
+        coreDist = heap.coreDistance();
+    }
+    if (coreDist != std::numeric_limits<double>::infinity()) {
+        OPTICS_STATS(++stats_.corePoints);
         // point i is a core-object. Update reachability-distance of all points in the
         // epsilon-neighborhood of point i.
-        double const coreDist = distances_[0];
         j = range;
         while (j != NOT_FOUND) {
             Point *p = points_ + j;
@@ -95,7 +806,89 @@ void Optics::expandClusterOrder(size_t i) {
             }
             j = p->next;
         }
+        return true;
+    }
+    OPTICS_STATS(++stats_.nonCorePoints);
+    return false;
+}
+
+template <typename Index>
+void BasicOptics<Index>::orderComponent(ComponentWorker &worker,
+                                        ComponentOrdering &ordering,
+                                        size_t const *points, size_t size) {
+    if (size <= minNeighbors_) {
+        // no point has enough neighbors to be a core-object: each is noise
+        for (size_t k = 0; k < size; ++k) {
+            points_[points[k]].state = PROCESSED;
+            ordering.order.push_back(points[k]);
+            ordering.ends.push_back(ordering.order.size());
+        }
+        return;
+    }
+    for (size_t k = 0; k < size; ++k) {
+        size_t i = points[k];
+        if (points_[i].state != UNPROCESSED) {
+            continue;
+        }
+        points_[i].state = PROCESSED;
+        expandComponent(worker, i);
+        ordering.order.push_back(i);
+        while (!worker.seeds->empty()) {
+            // expand cluster around seed with smallest reachability-distance
+            i = worker.seeds->pop();
+            expandComponent(worker, i);
+            ordering.order.push_back(i);
+        }
+        ordering.ends.push_back(ordering.order.size());
+    }
+}
+
+template <typename Index>
+void BasicOptics<Index>::expandComponent(ComponentWorker &worker, size_t i) {
+    // Same as expandClusterOrder(), but with the scratch space of the worker, and
+    // range queries that do not modify the points.
+    worker.neighbors.clear();
+    index_.visitRange(points_[i].v, epsilon_, [&worker](size_t j, double d) {
+        worker.neighbors.push_back(Neighbor{j, d});
+    });
+    worker.distances.resize(minNeighbors_);
+    CoreDistanceHeap heap{worker.distances.data(), minNeighbors_};
+    for (Neighbor const &nb : worker.neighbors) {
+        if (nb.index != i) {
+            heap.add(nb.dist);
+        }
+    }
+    double const coreDist = heap.coreDistance();
+    if (coreDist == std::numeric_limits<double>::infinity()) {
+        return;
+    }
+    for (Neighbor const &nb : worker.neighbors) {
+        if (points_[nb.index].state != PROCESSED) {
+            worker.seeds->update(nb.index, std::max(coreDist, nb.dist));
+        }
+    }
+}
+
+template <typename Index>
+bool BasicOptics<Index>::replayNeighborhood(size_t i) {
+    double const coreDist = coreDistances_[coreIndex_][i];
+    OPTICS_STATS(++stats_.neighborhoodSizes[OpticsStats::histogramBin(
+                     neighborhoodEnd_[i] - neighborhoodBegin_[i])]);
+    if (coreDist == std::numeric_limits<double>::infinity()) {
+        OPTICS_STATS(++stats_.nonCorePoints);
+        return false;
+    }
+    OPTICS_STATS(++stats_.corePoints);
+    for (size_t e = neighborhoodBegin_[i]; e < neighborhoodEnd_[i]; ++e) {
+        Neighbor const &nb = neighborhoods_[e];
+        if (points_[nb.index].state != PROCESSED) {
+            seeds_.update(nb.index, std::max(coreDist, nb.dist));
+        }
     }
+    return true;
 }
 
+template class BasicOptics<Tree>;
+template class BasicOptics<PixelIndex>;
+
 }  // namespace optics
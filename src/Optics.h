@@ -1,10 +1,24 @@
 #pragma once
 
+#include <chrono>
 #include <cstddef>
+#include <filesystem>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
 
+#include "AutoTune.h"
+#include "Checkpoint.h"
 #include "ClusterPublisher.h"
+#include "Duplicates.h"
+#include "Labels.h"
+#include "PixelIndex.h"
+#include "ProgressObserver.h"
+#include "RecordArena.h"
 #include "SeedList.h"
+#include "Stats.h"
 #include "Tree.h"
 
 namespace optics {
@@ -15,23 +29,259 @@ namespace optics {
 // Mihael Ankerst, Markus M. Breunig, Hans-Peter Kriegel, Jorg Sander (1999).
 // ACM SIGMOD international conference on Management of data.
 // ACM Press. pp. 49-60.
-class Optics {
+//
+// An Optics object can be run any number of times, for example to sweep over
+// parameter values. The 3-d tree and all scratch buffers are built or allocated once
+// and reused by subsequent runs. The tree does not depend on epsilon or the minimum
+// number of neighbors, so these may be changed freely between runs.
+//
+// Epsilon-neighborhoods are found with a spatial index, which is a 3-d tree (Tree)
+// for Optics. BasicOptics<PixelIndex> uses a HEALPix pixel index instead, which can
+// be faster for uniformly distributed inputs. The index is constructed from the
+// points, the target number of points per leaf (or pixel), and the leaf extent
+// threshold. It must provide buildSeconds(), stats(), resetStats(), and inRange()
+// with the contract of Tree::inRange().
+template <typename Index>
+class BasicOptics {
    public:
-    Optics(Point* points, size_t numPoints, size_t minNeighbors, double epsilon,
-           double leafExtentThreshold, size_t pointsPerLeaf);
+    BasicOptics(Point* points, size_t numPoints, size_t minNeighbors, double epsilon,
+                double leafExtentThreshold, size_t pointsPerLeaf);
+
+    BasicOptics(Point* points, size_t numPoints, size_t minNeighbors, double epsilon,
+                IndexParameters const& parameters);
+
+    // Picks the index parameters with AutoTuneIndex(), which samples the points and
+    // times trial range queries at epsilon. Later runs with a much different epsilon
+    // may be slower than with parameters tuned for it.
+    BasicOptics(Point* points, size_t numPoints, size_t minNeighbors, double epsilon);
 
+    // Clusters weighted points obtained from CollapseDuplicates(). Each point counts
+    // as many points as it has members when computing core-distances, so that a point
+    // of weight w has w - 1 neighbors at distance 0, and is expanded into the records
+    // of its members when published. This gives the same clusters as clustering the
+    // original points when only identical unit vectors were collapsed, up to the
+    // assignment of border points that are density-reachable from several clusters.
+    BasicOptics(Point* points, size_t numPoints, Duplicates duplicates,
+                size_t minNeighbors, double epsilon, double leafExtentThreshold,
+                size_t pointsPerLeaf);
+
+    // Clusters the points using the current parameters. Each cluster is published
+    // along with a ClusterSummary accumulated as its points are ordered, in which
+    // the members of a weighted point lie at the position of the point.
     void run(ClusterPublisher& publisher);
 
+    // Changes the minimum number of neighbors and epsilon (a squared euclidian
+    // distance), then clusters the points.
+    void run(ClusterPublisher& publisher, size_t minNeighbors, double epsilon);
+
+    // Clusters the points like run(publisher), but orders parts of the catalogue that
+    // cannot reach each other in parallel, on `numThreads` threads (0 means all
+    // hardware threads).
+    //
+    // A pre-pass of parallel range queries finds the connected components of the
+    // epsilon-graph, which links each point to the points within epsilon of it, with a
+    // lock-free UnionFind. No point is density-reachable from a point of another
+    // component, so each component is ordered by a single thread with a seed list of
+    // its own, exactly as run() orders it. Threads claim components largest first.
+    // Components of fewer than MIN_TASK_POINTS points are batched into tasks of at
+    // least that many points, and components too small to hold a core-object are
+    // published as noise without any range query.
+    //
+    // As for run(), the publisher is only called from the calling thread, and
+    // exceptions it throws propagate to the caller. Clusters are published once all
+    // components have been ordered, which keeps the cluster ordering of every point
+    // in memory, in the order of the tasks (components largest first) rather than in
+    // point order. This order does not depend on the number of threads.
+    //
+    // The pre-pass costs about as much as the range queries of a sequential run, so
+    // this only pays off with several threads. Throws for weighted points. Progress
+    // reporting and checkpointing are not supported, and ignored.
+    void runParallel(ClusterPublisher& publisher, size_t numThreads = 0);
+
+    // Clusters the points using the current parameters, and writes the label of the
+    // cluster of each input row to labels[row] rather than publishing records. The
+    // rows of the points are their positions in the array passed to the constructor,
+    // or those of the members of weighted points in the input of
+    // CollapseDuplicates(). There must be numRows() labels.
+    //
+    // Clusters are labeled with the number of clusters that run(ClusterPublisher&)
+    // would publish before them, so labels increase in cluster order but are not
+    // contiguous. Rows that run(ClusterPublisher&) would publish as clusters of a
+    // single record are labeled NOISE_LABEL. No memory is allocated per cluster, and
+    // the labels may be a LabelFile.
+    void run(std::span<int64_t> labels);
+
+    // Changes the minimum number of neighbors and epsilon, then labels the rows.
+    void run(std::span<int64_t> labels, size_t minNeighbors, double epsilon);
+
+    // Clusters the points once for each of several minimum numbers of neighbors, which
+    // must be positive and strictly increasing, publishing the clusters obtained with
+    // minNeighbors[m] to publishers[m].
+    //
+    // Epsilon-neighborhoods are only computed once: the first ordering caches every
+    // neighborhood along with the core-distances for all values of minNeighbors, and
+    // the remaining orderings are derived from the cache without range queries. The
+    // cache requires 16 bytes per neighbor and is released before returning.
+    void run(std::span<size_t const> minNeighbors,
+             std::span<ClusterPublisher* const> publishers);
+
+    // Returns the core-distance of each (tree ordered) point computed by the most
+    // recent multi-valued run() for the given minimum number of neighbors. Points
+    // that are not core-objects have an infinite core-distance. Throws if no such
+    // core-distances were computed.
+    std::span<double const> coreDistances(size_t minNeighbors) const;
+
+    // Continues a run that was interrupted, from a checkpoint written by an earlier
+    // Optics object constructed over the same input points and parameters. Clusters
+    // published before the checkpoint was taken are not published again; the number
+    // of such clusters is available via ReadCheckpointState().
+    void resume(ClusterPublisher& publisher, std::filesystem::path const& path);
+
+    // Registers an observer that run() reports progress to roughly every `interval`,
+    // and once on completion. Pass nullptr to stop reporting. The observer must
+    // outlive any subsequent calls to run().
+    void setProgressObserver(ProgressObserver* observer,
+                             std::chrono::milliseconds interval);
+
+    // Makes run() and resume() checkpoint the cluster ordering to the given file
+    // roughly every `interval`. The checkpoint is removed once clustering completes.
+    // Pass an empty path to disable checkpointing.
+    void setCheckpoint(std::filesystem::path const& path,
+                       std::chrono::milliseconds interval);
+
+    // Enables or disables mixed precision range queries (see
+    // Tree::setMixedPrecision()), which do not change results. Only supported by 3-d
+    // trees: other indexes ignore this setting.
+    void setMixedPrecision(bool enabled);
+
+    // Copies the records of all points (or of all members of weighted points) into
+    // an arena owned by this object, in the order of the points in the spatial index,
+    // and repoints the records of the points to the copies (see RecordArena). Records
+    // must lie within `input` and end with `terminator`. Clusters then publish
+    // pointers into the arena, and `input` may be released.
+    void compactRecords(std::string_view input, char terminator = '\n',
+                        size_t numThreads = 0);
+
+    // Returns the number of input rows labeled by run(std::span<int64_t>).
+    size_t numRows() const { return rows_.size(); }
+    size_t minNeighbors() const { return minNeighbors_; }
+    double epsilon() const { return epsilon_; }
+
+    // Returns statistics for the tree build and the most recent call to run(). Counters
+    // are always zero unless compiled with OPTICS_ENABLE_STATS.
+    OpticsStats const& stats() const { return stats_; }
+
+    // Minimum number of points ordered by a task of runParallel()
+    static constexpr size_t MIN_TASK_POINTS = 4096;
+
    private:
+    // How expandClusterOrder() obtains epsilon-neighborhoods
+    enum class Expansion {
+        QUERY,
+        // query, and cache neighborhoods and core-distances for all of coreK_
+        QUERY_AND_CACHE,
+        // replay cached neighborhoods and core-distances for coreK_[coreIndex_]
+        REPLAY,
+    };
+
+    struct Neighbor {
+        size_t index;
+        double dist;
+    };
+
+    // State of a thread ordering components in runParallel()
+    struct ComponentWorker {
+        std::optional<SeedList> seeds;
+        std::vector<Neighbor> neighbors;
+        std::vector<double> distances;
+    };
+
+    // The clusters of the components ordered by a task of runParallel(): their
+    // points in cluster order, and the end of each cluster among them.
+    struct ComponentOrdering {
+        std::vector<size_t> order;
+        std::vector<size_t> ends;
+
+        void swap(ComponentOrdering& other) {
+            order.swap(other.order);
+            ends.swap(other.ends);
+        }
+    };
+
+    struct WeightedDistance {
+        double dist;
+        size_t weight;
+
+        bool operator<(WeightedDistance const& other) const {
+            return dist < other.dist;
+        }
+    };
+
     Point* points_;  // unowned
     size_t numPoints_;
-    Tree tree_;
+    Index index_;
     SeedList seeds_;
     std::unique_ptr<double[]> distances_;
-    double epsilon_;
-    size_t minNeighbors_;
+    size_t distancesCapacity_ = 0;
+    double epsilon_ = 0.0;
+    size_t minNeighbors_ = 0;
+    OpticsStats stats_;
+    ProgressObserver* observer_ = nullptr;
+    std::chrono::steady_clock::duration progressInterval_{};
+    size_t clustersPublished_ = 0;
+    std::filesystem::path checkpointPath_;
+    std::chrono::steady_clock::duration checkpointInterval_{};
+    // indices of the points in the cluster being assembled
+    std::vector<size_t> cluster_;
+    // records of the cluster being published
+    std::vector<char const*> records_;
+    // input row of each (tree ordered) point, or of each member of weighted points
+    std::vector<size_t> rows_;
+    // destination of the labels of the current run, if any
+    std::span<int64_t> labels_;
+    // summary of the cluster being assembled, and the sum of its reach distances
+    ClusterSummary summary_;
+    double reachSum_ = 0.0;
+    // whether the first point of the cluster being assembled is a core-object
+    bool clusterStartCore_ = false;
+    Expansion expansion_ = Expansion::QUERY;
+    std::vector<size_t> coreK_;
+    size_t coreIndex_ = 0;
+    std::vector<std::vector<double>> coreDistances_;
+    std::vector<Neighbor> neighborhoods_;
+    std::vector<size_t> neighborhoodBegin_;
+    std::vector<size_t> neighborhoodEnd_;
+    // members of each (tree ordered) point, if the points are weighted
+    bool weighted_ = false;
+    Duplicates duplicates_;
+    // max-heap of the smallest neighbor distances with a total weight of at least k
+    std::vector<WeightedDistance> weightedHeap_;
+    size_t heapWeight_ = 0;
+    RecordArena recordArena_;
 
-    void expandClusterOrder(size_t i);
+    void setParameters(size_t minNeighbors, double epsilon);
+    void reset();
+    void resetStats();
+    void order(ClusterPublisher* publisher, OrderingState& state, bool checkpoint);
+    // Expand the cluster ordering around point i, and return true if it is a
+    // core-object.
+    bool expandClusterOrder(size_t i);
+    bool replayNeighborhood(size_t i);
+    // Orders the points of an epsilon-connected component, in point order.
+    void orderComponent(ComponentWorker& worker, ComponentOrdering& ordering,
+                        size_t const* points, size_t size);
+    void expandComponent(ComponentWorker& worker, size_t i);
+    void pushWeighted(double dist, size_t weight, size_t k);
+    // Publishes the current cluster, or labels its rows if there is no publisher.
+    void publish(ClusterPublisher* publisher);
+    void label(int64_t cluster, size_t i);
+    // Adds point i, which just joined the cluster being assembled, to its summary.
+    void summarize(size_t i);
 };
 
+using Optics = BasicOptics<Tree>;
+
+extern template class BasicOptics<Tree>;
+extern template class BasicOptics<PixelIndex>;
+
 }  // namespace optics
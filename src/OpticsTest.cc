@@ -0,0 +1,694 @@
+#include <absl/cleanup/cleanup.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "ClusterPublisher.h"
+#include "Duplicates.h"
+#include "Labels.h"
+#include "Optics.h"
+#include "PixelIndex.h"
+#include "ProgressObserver.h"
+#include "Stats.h"
+#include "TestCatalog.h"
+#include "TestPath.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+struct CollectingObserver : ProgressObserver {
+    std::vector<Progress> reports;
+
+    void onProgress(Progress const& progress) override { reports.push_back(progress); }
+};
+
+TEST(OpticsTest, PublishesEveryPointOnce) {
+    TestCatalog catalog{20000};
+    Optics optics{catalog.points.data(), catalog.points.size(), MinNeighbors, Epsilon,
+                  0.0, 16};
+    CollectingPublisher publisher;
+    optics.run(publisher);
+    std::vector<int> seen(catalog.points.size(), 0);
+    for (auto const& cluster : publisher.clusters) {
+        EXPECT_FALSE(cluster.empty());
+        for (char const* record : cluster) {
+            ++seen[record - catalog.records.data()];
+        }
+    }
+    EXPECT_THAT(seen, testing::Each(1));
+}
+
+// Checks that re-running with different parameters gives the same results as a new
+// Optics object
+TEST(OpticsTest, Rerun) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    std::vector<Point> points = catalog.points;
+    Optics optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    CollectingPublisher first;
+    optics.run(first);
+    for (auto [minNeighbors, epsilon] : {std::make_pair(MinNeighbors * 4, Epsilon),
+                                         std::make_pair(MinNeighbors, 0.25 * Epsilon),
+                                         std::make_pair(MinNeighbors, Epsilon)}) {
+        CollectingPublisher rerun;
+        optics.run(rerun, minNeighbors, epsilon);
+        EXPECT_EQ(optics.minNeighbors(), minNeighbors);
+        EXPECT_EQ(optics.epsilon(), epsilon);
+
+        std::vector<Point> fresh = catalog.points;
+        CollectingPublisher expected;
+        Optics{fresh.data(), n, minNeighbors, epsilon, 0.0, 16}.run(expected);
+        EXPECT_EQ(rerun.clusters, expected.clusters);
+    }
+    CollectingPublisher last;
+    optics.run(last);
+    EXPECT_EQ(last.clusters, first.clusters);
+}
+
+TEST(OpticsTest, FindsClusters) {
+    TestCatalog catalog{20000};
+    Optics optics{catalog.points.data(), catalog.points.size(), MinNeighbors, Epsilon,
+                  0.0, 16};
+    CollectingPublisher publisher;
+    optics.run(publisher);
+    size_t numLargeClusters = 0;
+    for (auto const& cluster : publisher.clusters) {
+        if (cluster.size() < 2) {
+            continue;
+        }
+        int64_t label = catalog.label(cluster[0]);
+        EXPECT_NE(label, NOISE_LABEL);
+        for (char const* record : cluster) {
+            EXPECT_EQ(catalog.label(record), label);
+        }
+        if (cluster.size() >= 100) {
+            ++numLargeClusters;
+        }
+    }
+    EXPECT_EQ(numLargeClusters, 20);
+}
+
+TEST(OpticsTest, Progress) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    Optics optics{catalog.points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    CollectingPublisher publisher;
+    CollectingObserver observer;
+    optics.setProgressObserver(&observer, std::chrono::milliseconds{0});
+    optics.run(publisher);
+    // the clock is checked once every few thousand points
+    ASSERT_GE(observer.reports.size(), 2);
+    EXPECT_LT(observer.reports.size(), n / 1000);
+    for (size_t i = 1; i < observer.reports.size(); ++i) {
+        auto const& prev = observer.reports[i - 1];
+        auto const& cur = observer.reports[i];
+        EXPECT_EQ(cur.numPoints, n);
+        EXPECT_GT(cur.pointsProcessed, prev.pointsProcessed);
+        EXPECT_GE(cur.clustersPublished, prev.clustersPublished);
+        EXPECT_GE(cur.elapsedSeconds, prev.elapsedSeconds);
+    }
+    auto const& last = observer.reports.back();
+    EXPECT_EQ(last.pointsProcessed, n);
+    EXPECT_EQ(last.clustersPublished, publisher.clusters.size());
+    EXPECT_EQ(last.seedListSize, 0);
+    EXPECT_EQ(last.remainingSeconds, 0.0);
+}
+
+// Checks that a multi-valued run gives the same results as separate runs
+TEST(OpticsTest, MultipleMinNeighbors) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    std::vector<size_t> const ks = {MinNeighbors, MinNeighbors * 2, MinNeighbors * 4};
+    std::vector<CollectingPublisher> publishers(ks.size());
+    std::vector<ClusterPublisher*> publisherPointers;
+    for (auto& p : publishers) {
+        publisherPointers.push_back(&p);
+    }
+    std::vector<Point> points = catalog.points;
+    Optics optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    optics.run(ks, publisherPointers);
+    EXPECT_EQ(optics.minNeighbors(), MinNeighbors);
+    for (size_t m = 0; m < ks.size(); ++m) {
+        std::vector<Point> fresh = catalog.points;
+        CollectingPublisher expected;
+        Optics{fresh.data(), n, ks[m], Epsilon, 0.0, 16}.run(expected);
+        EXPECT_EQ(publishers[m].clusters, expected.clusters);
+    }
+    auto core5 = optics.coreDistances(ks[0]);
+    auto core20 = optics.coreDistances(ks[2]);
+    ASSERT_EQ(core5.size(), n);
+    ASSERT_EQ(core20.size(), n);
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_LE(core5[i], core20[i]);
+    }
+    EXPECT_THROW(optics.coreDistances(7), std::invalid_argument);
+    std::vector<size_t> const unsorted = {10, 5};
+    EXPECT_THROW(optics.run(unsorted, std::span{publisherPointers}.first(2)),
+                 std::invalid_argument);
+}
+
+// Throws after publishing a given number of clusters
+struct ThrowingPublisher : CollectingPublisher {
+    size_t clustersLeft;
+
+    explicit ThrowingPublisher(size_t n) : clustersLeft{n} {}
+
+    void publish(std::vector<char const*> const& cluster) override {
+        if (clustersLeft-- == 0) {
+            throw std::runtime_error("publishing failed");
+        }
+        CollectingPublisher::publish(cluster);
+    }
+};
+
+// Checks that a failed multi-valued run leaves the object usable for single runs
+TEST(OpticsTest, MultipleMinNeighborsThrows) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    std::vector<size_t> const ks = {MinNeighbors, MinNeighbors * 2};
+    CollectingPublisher first;
+    ThrowingPublisher second{10};
+    std::vector<ClusterPublisher*> const publisherPointers = {&first, &second};
+    std::vector<Point> points = catalog.points;
+    Optics optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    EXPECT_THROW(optics.run(ks, publisherPointers), std::runtime_error);
+    EXPECT_EQ(optics.minNeighbors(), MinNeighbors);
+    EXPECT_THROW(optics.coreDistances(ks[0]), std::invalid_argument);
+
+    CollectingPublisher actual;
+    optics.run(actual);
+    std::vector<Point> fresh = catalog.points;
+    CollectingPublisher expected;
+    Optics{fresh.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(expected);
+    EXPECT_EQ(actual.clusters, expected.clusters);
+    EXPECT_EQ(first.clusters, expected.clusters);
+}
+
+TEST(OpticsTest, ClusterSummaries) {
+    TestCatalog catalog{20000};
+    std::vector<Point> points = catalog.points;
+    CollectingPublisher publisher;
+    Optics{points.data(), points.size(), MinNeighbors, Epsilon, 0.0, 16}.run(publisher);
+    ASSERT_EQ(publisher.summaries.size(), publisher.clusters.size());
+    for (size_t c = 0; c < publisher.clusters.size(); ++c) {
+        auto const& cluster = publisher.clusters[c];
+        ClusterSummary const& summary = publisher.summaries[c];
+        ASSERT_EQ(summary.size, cluster.size());
+        Vec3 sum;
+        Vec3 min = Vec3{catalog.sources[cluster[0] - catalog.records.data()].p};
+        Vec3 max = min;
+        for (char const* record : cluster) {
+            Vec3 const v{catalog.sources[record - catalog.records.data()].p};
+            sum = sum + v;
+            min = Min(min, v);
+            max = Max(max, v);
+        }
+        Vec3 const center = Normalize(sum);
+        EXPECT_LT(SquaredEuclidianDistance(summary.center, center), 1e-20);
+        EXPECT_LT(SquaredEuclidianDistance(summary.min, min), 1e-20);
+        EXPECT_LT(SquaredEuclidianDistance(summary.max, max), 1e-20);
+        double radius = 0.0;
+        for (char const* record : cluster) {
+            Vec3 const v{catalog.sources[record - catalog.records.data()].p};
+            radius = std::max(radius, SquaredEuclidianDistance(center, v));
+        }
+        EXPECT_NEAR(summary.radius, radius, 1e-12);
+        if (cluster.size() == 1) {
+            EXPECT_EQ(summary.radius, 0.0);
+            EXPECT_TRUE(std::isnan(summary.meanReach));
+        } else {
+            EXPECT_LE(summary.minReach, summary.meanReach);
+            EXPECT_LE(summary.meanReach, summary.maxReach);
+            EXPECT_LE(summary.maxReach, Epsilon);
+            // members of the generated clusters have standard deviations of at most
+            // 2 arcsec
+            EXPECT_LT(summary.radiusDegrees(), 60.0 / 3600.0);
+        }
+    }
+}
+
+// Returns the labels that run(std::span<int64_t>) should write for the given
+// published clusters, where the record of row r is &records[r].
+std::vector<int64_t> ExpectedLabels(
+    std::vector<std::vector<char const*>> const& clusters, char const* records,
+    size_t numRows) {
+    std::vector<int64_t> labels(numRows, NOISE_LABEL);
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        for (char const* record : clusters[c]) {
+            if (clusters[c].size() > 1) {
+                labels[record - records] = static_cast<int64_t>(c);
+            }
+        }
+    }
+    return labels;
+}
+
+// Checks that clustering collapsed duplicates gives the same results as clustering the
+// duplicates individually. Results may differ in general, since border points that
+// are density-reachable from several clusters are assigned in a different order.
+TEST(OpticsTest, WeightedPoints) {
+    TestCatalog catalog{20000};
+    std::mt19937_64 rng(1234);
+    std::uniform_int_distribution<size_t> numCopies{0, 3};
+    std::vector<char> records(4 * catalog.points.size());
+    std::vector<Point> points;
+    for (Point const& point : catalog.points) {
+        for (size_t c = numCopies(rng); c <= 3; ++c) {
+            points.push_back(point);
+            points.back().record = &records[points.size() - 1];
+        }
+    }
+    size_t const n = points.size();
+    std::vector<Point> copy = points;
+    CollectingPublisher expected;
+    Optics{copy.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(expected);
+
+    Duplicates duplicates;
+    size_t const numWeighted = CollapseDuplicates(points.data(), n, 0.0, duplicates);
+    EXPECT_EQ(numWeighted, catalog.points.size());
+    std::vector<size_t> const ks = {MinNeighbors, MinNeighbors * 4};
+    Optics optics{points.data(), numWeighted, std::move(duplicates), MinNeighbors,
+                  Epsilon, 0.0, 16};
+    CollectingPublisher actual;
+    optics.run(actual);
+    EXPECT_EQ(Normalized(actual.clusters), Normalized(expected.clusters));
+
+    // the multi-valued run weighs points in the same way as single runs
+    CollectingPublisher single4;
+    optics.run(single4, MinNeighbors * 4, Epsilon);
+    CollectingPublisher actual1;
+    CollectingPublisher actual4;
+    std::vector<ClusterPublisher*> const publishers = {&actual1, &actual4};
+    optics.run(ks, publishers);
+    EXPECT_EQ(actual1.clusters, actual.clusters);
+    EXPECT_EQ(actual4.clusters, single4.clusters);
+    if constexpr (STATS_ENABLED) {
+        // the replayed ordering runs no range queries, not even for noise
+        EXPECT_EQ(optics.stats().query.queries, 0u);
+    }
+
+    // members of weighted points are labeled by their rows before collapsing
+    ASSERT_EQ(optics.numRows(), n);
+    std::vector<int64_t> labels(n);
+    optics.run(labels, MinNeighbors, Epsilon);
+    EXPECT_EQ(labels, ExpectedLabels(actual.clusters, records.data(), n));
+}
+
+TEST(OpticsTest, Labels) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    std::vector<Point> points = catalog.points;
+    Optics optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    CollectingPublisher publisher;
+    optics.run(publisher);
+    std::vector<int64_t> const expected =
+        ExpectedLabels(publisher.clusters, catalog.records.data(), n);
+    ASSERT_EQ(optics.numRows(), n);
+    std::vector<int64_t> labels(n);
+    optics.run(labels);
+    EXPECT_EQ(labels, expected);
+    // labels agree with the generated clusters, which are well separated
+    for (size_t r = 0; r < n; ++r) {
+        for (size_t s = r + 1; s < std::min(n, r + 50); ++s) {
+            if (catalog.sources[r].label != NOISE_LABEL && labels[r] != NOISE_LABEL &&
+                labels[s] != NOISE_LABEL) {
+                EXPECT_EQ(catalog.sources[r].label == catalog.sources[s].label,
+                          labels[r] == labels[s]);
+            }
+        }
+    }
+    EXPECT_THROW(optics.run(std::span{labels}.first(n - 1)), std::invalid_argument);
+
+    auto const path = TestPath(".labels");
+    absl::Cleanup const remover = [&path] { std::filesystem::remove(path); };
+    {
+        LabelFile file{path, n};
+        optics.run(file.labels());
+        file.sync();
+    }
+    ASSERT_EQ(std::filesystem::file_size(path), n * sizeof(int64_t));
+    std::vector<int64_t> written(n);
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    ASSERT_NE(f, nullptr);
+    ASSERT_EQ(std::fread(written.data(), sizeof(int64_t), n, f), n);
+    std::fclose(f);
+    EXPECT_EQ(written, expected);
+}
+
+// Checks that clustering with a pixel index gives the same clusters as with a 3-d
+// tree. Cluster ordering and border point assignment depend on the order in which
+// points are visited, so clusters are only compared for compact, well separated
+// clusters.
+TEST(OpticsTest, PixelIndex) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    std::vector<Point> points = catalog.points;
+    CollectingPublisher expected;
+    Optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(expected);
+    points = catalog.points;
+    CollectingPublisher actual;
+    BasicOptics<PixelIndex>{points.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(
+        actual);
+    EXPECT_EQ(Normalized(actual.clusters), Normalized(expected.clusters));
+}
+
+// Checks that auto-tuned index parameters do not change the clusters. The tuned
+// parameters depend on timings, and the assignment of border points on the order of
+// the points in the index, so only the clusters of core-objects are compared.
+TEST(OpticsTest, AutoTunedIndex) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    std::vector<Point> points = catalog.points;
+    std::vector<bool> core(n);
+    {
+        Tree const tree{points.data(), n, 16, 0.0};
+        for (size_t i = 0; i < n; ++i) {
+            size_t neighbors = 0;
+            tree.visitRange(points[i].v, Epsilon, [&](size_t, double) { ++neighbors; });
+            core[points[i].record - catalog.records.data()] = neighbors > MinNeighbors;
+        }
+    }
+    auto coreClusters = [&](CollectingPublisher const& publisher) {
+        std::vector<std::vector<char const*>> clusters;
+        for (auto const& cluster : publisher.clusters) {
+            std::vector<char const*> members;
+            for (char const* record : cluster) {
+                if (core[record - catalog.records.data()]) {
+                    members.push_back(record);
+                }
+            }
+            if (!members.empty()) {
+                clusters.push_back(std::move(members));
+            }
+        }
+        return Normalized(clusters);
+    };
+    points = catalog.points;
+    CollectingPublisher expected;
+    Optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(expected);
+    points = catalog.points;
+    CollectingPublisher actual;
+    Optics{points.data(), n, MinNeighbors, Epsilon}.run(actual);
+    EXPECT_EQ(coreClusters(actual), coreClusters(expected));
+    // negative distances are accepted, as by the other constructors
+    points = catalog.points;
+    Optics negative{points.data(), n, MinNeighbors, -Epsilon};
+    EXPECT_EQ(negative.epsilon(), Epsilon);
+    CollectingPublisher negativeClusters;
+    negative.run(negativeClusters);
+    EXPECT_EQ(coreClusters(negativeClusters), coreClusters(expected));
+}
+
+// Checks that ordering epsilon-connected components in parallel gives the same
+// cluster orderings and summaries as a sequential run, whatever the number of threads
+// and for either index.
+template <typename Index>
+void CheckParallelComponents(size_t minNeighbors) {
+    TestCatalog catalog{20000};
+    std::vector<Point> points = catalog.points;
+    BasicOptics<Index> optics{points.data(), points.size(), minNeighbors, Epsilon, 0.0,
+                              16};
+    CollectingPublisher expected;
+    optics.run(expected);
+    std::vector<double> reach(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        reach[i] = points[i].reach;
+    }
+    // Orders clusters by their first record, keeping the order of their records.
+    auto sorted = [](CollectingPublisher const& publisher) {
+        std::vector<std::pair<std::vector<char const*>, size_t>> clusters;
+        for (size_t c = 0; c < publisher.clusters.size(); ++c) {
+            clusters.emplace_back(publisher.clusters[c], publisher.summaries[c].size);
+        }
+        std::sort(clusters.begin(), clusters.end());
+        return clusters;
+    };
+    std::vector<std::vector<char const*>> first;
+    for (size_t numThreads : {1, 3}) {
+        CollectingPublisher actual;
+        optics.runParallel(actual, numThreads);
+        EXPECT_EQ(sorted(actual), sorted(expected));
+        for (size_t i = 0; i < points.size(); ++i) {
+            ASSERT_EQ(points[i].reach, reach[i]);
+        }
+        // the publishing order does not depend on the number of threads
+        if (first.empty()) {
+            first = actual.clusters;
+        } else {
+            EXPECT_EQ(actual.clusters, first);
+        }
+    }
+    // publisher exceptions reach the caller, which can run again
+    for (size_t numThreads : {1, 3}) {
+        ThrowingPublisher throwing{10};
+        EXPECT_THROW(optics.runParallel(throwing, numThreads), std::runtime_error);
+        CollectingPublisher actual;
+        optics.runParallel(actual, numThreads);
+        EXPECT_EQ(actual.clusters, first);
+    }
+}
+
+TEST(OpticsTest, ParallelComponents) {
+    CheckParallelComponents<Tree>(MinNeighbors);
+    CheckParallelComponents<PixelIndex>(MinNeighbors);
+    // only noise
+    CheckParallelComponents<Tree>(1000);
+}
+
+// Returns the published clusters as lists of records, which end with a newline or at
+// the end of the input.
+std::vector<std::vector<std::string>> RecordText(
+    std::vector<std::vector<char const*>> const& clusters) {
+    std::vector<std::vector<std::string>> text;
+    for (auto const& cluster : clusters) {
+        auto& records = text.emplace_back();
+        for (char const* record : cluster) {
+            records.emplace_back(record, std::strcspn(record, "\n"));
+        }
+    }
+    return text;
+}
+
+TEST(OpticsTest, CompactRecords) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    // records are CSV lines, and the last one is not terminated
+    std::string input;
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < 2 * n; ++i) {
+        starts.push_back(input.size());
+        input += std::to_string(i) + ",record\n";
+    }
+    input.pop_back();
+    std::vector<Point> points = catalog.points;
+    for (size_t i = 0; i < n; ++i) {
+        points[i].record = input.data() + starts[2 * i];
+    }
+    std::vector<Point> copy = points;
+    CollectingPublisher expected;
+    Optics{copy.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(expected);
+    auto const expectedText = RecordText(expected.clusters);
+    std::vector<Point> weighted = points;
+    for (size_t i = 0; i < n; ++i) {
+        weighted.push_back(points[i]);
+        weighted.back().record = input.data() + starts[2 * i + 1];
+    }
+
+    copy = points;
+    Optics optics{copy.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    optics.compactRecords(input);
+    Duplicates duplicates;
+    size_t const numWeighted =
+        CollapseDuplicates(weighted.data(), weighted.size(), 0.0, duplicates);
+    Optics weightedOptics{weighted.data(), numWeighted, std::move(duplicates),
+                          MinNeighbors, Epsilon, 0.0, 16};
+    weightedOptics.compactRecords(input);
+    // published records must not refer to the input anymore
+    input.assign(input.size(), '?');
+    CollectingPublisher actual;
+    optics.run(actual);
+    EXPECT_EQ(RecordText(actual.clusters), expectedText);
+    CollectingPublisher weightedActual;
+    weightedOptics.run(weightedActual);
+    std::vector<std::string> published;
+    for (auto const& cluster : RecordText(weightedActual.clusters)) {
+        published.insert(published.end(), cluster.begin(), cluster.end());
+    }
+    std::sort(published.begin(), published.end());
+    std::vector<std::string> all;
+    for (size_t i = 0; i < 2 * n; ++i) {
+        all.push_back(std::to_string(i) + ",record");
+    }
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(published, all);
+}
+
+// Interrupts a run by throwing from a progress report
+struct InterruptingObserver : ProgressObserver {
+    size_t reportsLeft;
+
+    explicit InterruptingObserver(size_t n) : reportsLeft{n} {}
+
+    void onProgress(Progress const&) override {
+        if (--reportsLeft == 0) {
+            throw std::runtime_error("interrupted");
+        }
+    }
+};
+
+TEST(OpticsTest, CheckpointAndResume) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    auto const path = TestPath(".ckpt");
+    absl::Cleanup const remover = [&path] {
+        std::filesystem::remove(path);
+        std::filesystem::remove(path.string() + ".tmp");
+    };
+
+    std::vector<Point> points = catalog.points;
+    CollectingPublisher expected;
+    Optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16}.run(expected);
+
+    points = catalog.points;
+    CollectingPublisher interrupted;
+    {
+        Optics optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+        InterruptingObserver observer{3};
+        optics.setProgressObserver(&observer, std::chrono::milliseconds{0});
+        optics.setCheckpoint(path, std::chrono::milliseconds{0});
+        EXPECT_THROW(optics.run(interrupted), std::runtime_error);
+    }
+    ASSERT_TRUE(std::filesystem::exists(path));
+    OrderingState const state = ReadCheckpointState(path);
+    EXPECT_GT(state.pointsProcessed, 0);
+    EXPECT_LT(state.pointsProcessed, n);
+    ASSERT_LE(state.clustersPublished, interrupted.clusters.size());
+
+    points = catalog.points;
+    CollectingPublisher resumed;
+    Optics optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    optics.resume(resumed, path);
+
+    std::vector<std::vector<char const*>> actual(
+        interrupted.clusters.begin(),
+        interrupted.clusters.begin() + state.clustersPublished);
+    actual.insert(actual.end(), resumed.clusters.begin(), resumed.clusters.end());
+    EXPECT_EQ(actual, expected.clusters);
+}
+
+TEST(OpticsTest, ResumeRejectsCorruptCheckpoint) {
+    TestCatalog catalog{20000};
+    size_t const n = catalog.points.size();
+    auto const path = TestPath(".ckpt");
+    absl::Cleanup const remover = [&path] {
+        std::filesystem::remove(path);
+        std::filesystem::remove(path.string() + ".tmp");
+    };
+    std::vector<Point> points = catalog.points;
+    {
+        Optics optics{points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+        InterruptingObserver observer{3};
+        optics.setProgressObserver(&observer, std::chrono::milliseconds{0});
+        optics.setCheckpoint(path, std::chrono::milliseconds{0});
+        CollectingPublisher interrupted;
+        EXPECT_THROW(optics.run(interrupted), std::runtime_error);
+    }
+    OrderingState const state = ReadCheckpointState(path);
+    ASSERT_GT(state.seedListSize, 0);
+    ASSERT_GT(state.clusterSize, 0);
+    std::string data;
+    {
+        std::ifstream in{path, std::ios::binary};
+        data.assign(std::istreambuf_iterator<char>{in}, {});
+    }
+    // the checkpoint ends with the points, the seed list heap and the cluster
+    size_t const clusterOffset = data.size() - state.clusterSize * sizeof(size_t);
+    size_t const heapOffset = clusterOffset - state.seedListSize * sizeof(size_t);
+    size_t const pointsOffset = heapOffset - n * sizeof(Point);
+
+    // Resumes from the given checkpoint contents, checking that a rejected checkpoint
+    // leaves the points untouched.
+    auto resume = [&](std::string const& contents, size_t minNeighbors) {
+        {
+            std::ofstream out{path, std::ios::binary};
+            out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        }
+        points = catalog.points;
+        Optics optics{points.data(), n, minNeighbors, Epsilon, 0.0, 16};
+        std::vector<Point> const before = points;
+        CollectingPublisher resumed;
+        try {
+            optics.resume(resumed, path);
+        } catch (...) {
+            EXPECT_TRUE(std::equal(points.begin(), points.end(), before.begin(),
+                                   [](Point const& a, Point const& b) {
+                                       return a.state == b.state && a.reach == b.reach;
+                                   }));
+            throw;
+        }
+    };
+    auto resumeFrom = [&](size_t offset, size_t value) {
+        std::string corrupt = data;
+        std::memcpy(corrupt.data() + offset, &value, sizeof(value));
+        resume(corrupt, MinNeighbors);
+    };
+    EXPECT_THROW(resumeFrom(heapOffset, n), std::runtime_error);
+    EXPECT_THROW(resumeFrom(heapOffset, static_cast<size_t>(-3)), std::runtime_error);
+    EXPECT_THROW(resumeFrom(clusterOffset, n + 7), std::runtime_error);
+    EXPECT_THROW(resumeFrom(pointsOffset + offsetof(Point, state), n),
+                 std::runtime_error);
+    EXPECT_THROW(
+        resumeFrom(pointsOffset + offsetof(Point, state), state.seedListSize),
+        std::runtime_error);
+    EXPECT_THROW(resume(data, MinNeighbors + 1), std::runtime_error);
+}
+
+TEST(OpticsTest, Stats) {
+    if constexpr (!STATS_ENABLED) {
+        GTEST_SKIP() << "statistics are compiled out";
+    }
+    TestCatalog catalog{5000};
+    size_t const n = catalog.points.size();
+    Optics optics{catalog.points.data(), n, MinNeighbors, Epsilon, 0.0, 16};
+    CollectingPublisher publisher;
+    optics.run(publisher);
+    OpticsStats const& stats = optics.stats();
+    EXPECT_EQ(stats.query.queries, n);
+    EXPECT_GE(stats.query.nodesVisited, stats.query.leavesScanned);
+    EXPECT_GE(stats.query.distanceEvaluations, stats.query.hits);
+    // every point is in its own epsilon-neighborhood
+    EXPECT_GE(stats.query.hits, n);
+    EXPECT_EQ(stats.corePoints + stats.nonCorePoints, n);
+    EXPECT_EQ(std::accumulate(stats.neighborhoodSizes.begin(),
+                              stats.neighborhoodSizes.end(), size_t{0}),
+              n);
+    EXPECT_EQ(stats.clusters, publisher.clusters.size());
+    // every point apart from the first point in each cluster is popped from the seeds
+    EXPECT_EQ(stats.seeds.pops + stats.clusters, n);
+    EXPECT_EQ(stats.seeds.adds, stats.seeds.pops);
+    EXPECT_GE(stats.buildSeconds, 0.0);
+    EXPECT_GE(stats.orderingSeconds, 0.0);
+    EXPECT_GE(stats.publishSeconds, 0.0);
+}
+
+}  // namespace
+}  // namespace optics
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace optics {
+
+// Returns the number of threads to use for parallel work when the caller does not
+// specify one (i.e. passes 0).
+inline size_t ResolveThreadCount(size_t numThreads) {
+    if (numThreads != 0) {
+        return numThreads;
+    }
+    size_t const n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Splits [0, n) into at most `numThreads` contiguous chunks of near-equal size and
+// calls fn(thread, begin, end) for each chunk on its own thread. The calling thread
+// processes the first chunk. Passing numThreads == 0 uses all hardware threads.
+//
+// Exceptions must not escape `fn`: catch them with a FirstException.
+template <typename F>
+void ParallelFor(size_t n, size_t numThreads, F&& fn) {
+    numThreads = std::min(ResolveThreadCount(numThreads), std::max<size_t>(n, 1));
+    if (numThreads == 1) {
+        fn(static_cast<size_t>(0), static_cast<size_t>(0), n);
+        return;
+    }
+    std::vector<std::jthread> threads;
+    threads.reserve(numThreads - 1);
+    for (size_t t = 1; t < numThreads; ++t) {
+        threads.emplace_back([&fn, t, n, numThreads] {
+            fn(t, (n * t) / numThreads, (n * (t + 1)) / numThreads);
+        });
+    }
+    fn(static_cast<size_t>(0), static_cast<size_t>(0), n / numThreads);
+}
+
+// Calls fn(thread, i) for every i in [0, n) on at most `numThreads` threads, which
+// claim indexes one at a time in increasing order as they become idle. Unlike
+// ParallelFor(), this balances items of very different costs, especially when they
+// are ordered by decreasing cost. The calling thread participates. Passing
+// numThreads == 0 uses all hardware threads.
+//
+// Exceptions must not escape `fn`: catch them with a FirstException.
+template <typename F>
+void ParallelForDynamic(size_t n, size_t numThreads, F&& fn) {
+    numThreads = std::min(ResolveThreadCount(numThreads), std::max<size_t>(n, 1));
+    std::atomic<size_t> next{0};
+    ParallelFor(numThreads, numThreads,
+                [&fn, &next, n](size_t thread, size_t, size_t) {
+                    for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < n;
+                         i = next.fetch_add(1, std::memory_order_relaxed)) {
+                        fn(thread, i);
+                    }
+                });
+}
+
+// Records the first exception thrown by work running on several threads, so that
+// it can be rethrown on the calling thread once they have been joined. Threads poll
+// failed() to stop early once any of them has failed.
+class FirstException {
+   public:
+    // Calls fn(), recording the exception it throws if it is the first.
+    template <typename F>
+    void run(F&& fn) noexcept {
+        try {
+            fn();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+            failed_.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    bool failed() const { return failed_.load(std::memory_order_relaxed); }
+
+    // Rethrows the recorded exception, if any. Only call after joining the threads.
+    void rethrow() const {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+   private:
+    std::mutex mutex_;
+    std::exception_ptr error_;
+    std::atomic<bool> failed_{false};
+};
+
+}  // namespace optics
@@ -0,0 +1,269 @@
+#include "PixelIndex.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+#include <utility>
+
+#include "Parallel.h"
+
+namespace optics {
+
+namespace {
+
+constexpr double HALF_PI = 0.5 * std::numbers::pi;
+
+// Ring and longitude indexes of the southernmost corner of each base pixel
+constexpr int64_t JRLL[12] = {2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4};
+constexpr int64_t JPLL[12] = {1, 3, 5, 7, 0, 2, 4, 6, 1, 3, 5, 7};
+
+// Safety factor applied to the radius of the bounding sphere of each pixel, so that
+// rounding errors never prune a pixel containing a match.
+constexpr double RADIUS_MARGIN = 1.0 + 1e-9;
+
+// Moves bit i of the low 32 bits of x to bit 2i.
+uint64_t SpreadBits(uint64_t x) {
+    x &= 0xffffffffull;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+
+// Inverse of SpreadBits(): moves bit 2i of x to bit i.
+uint64_t CompressBits(uint64_t x) {
+    x &= 0x5555555555555555ull;
+    x = (x | (x >> 1)) & 0x3333333333333333ull;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+    x = (x | (x >> 16)) & 0x00000000ffffffffull;
+    return x;
+}
+
+size_t NumPixels(int order) { return static_cast<size_t>(12) << (2 * order); }
+
+// Index of the first pixel at the given order in PixelIndex::pixels_. The children
+// of the pixel at index i are at indexes 4i + 12 to 4i + 15.
+size_t FirstPixel(int order) {
+    return 12 * ((static_cast<size_t>(1) << (2 * order)) - 1) / 3;
+}
+
+Vec3 FromZPhi(double z, double phi) {
+    double const sth = std::sqrt((1.0 - z) * (1.0 + z));
+    return Vec3{sth * std::cos(phi), sth * std::sin(phi), z};
+}
+
+}  // namespace
+
+uint64_t VecToPixel(Vec3 const& v, int order) {
+    int64_t const nside = static_cast<int64_t>(1) << order;
+    double const norm = std::sqrt(v.dot(v));
+    double const z = v.z() / norm;
+    double const za = std::abs(z);
+    double tt = std::atan2(v.y(), v.x()) / HALF_PI;
+    if (tt < 0.0) {
+        tt += 4.0;
+    }
+    if (tt >= 4.0) {
+        tt -= 4.0;
+    }
+    int64_t face;
+    int64_t ix;
+    int64_t iy;
+    if (za <= 2.0 / 3.0) {
+        // equatorial region
+        double const temp1 = nside * (0.5 + tt);
+        double const temp2 = nside * (z * 0.75);
+        int64_t const jp = static_cast<int64_t>(temp1 - temp2);
+        int64_t const jm = static_cast<int64_t>(temp1 + temp2);
+        int64_t const ifp = jp >> order;
+        int64_t const ifm = jm >> order;
+        face = ifp == ifm ? (ifp | 4) : (ifp < ifm ? ifp : ifm + 8);
+        ix = jm & (nside - 1);
+        iy = nside - (jp & (nside - 1)) - 1;
+    } else {
+        // polar caps
+        int64_t const ntt = std::min<int64_t>(3, static_cast<int64_t>(tt));
+        double const tp = tt - ntt;
+        // sqrt(3 * (1 - za)), computed without cancellation close to the poles
+        double const sth = std::sqrt(v.x() * v.x() + v.y() * v.y()) / norm;
+        double const tmp = za < 0.99 ? nside * std::sqrt(3.0 * (1.0 - za))
+                                     : nside * sth / std::sqrt((1.0 + za) / 3.0);
+        int64_t const jp = std::min(nside - 1, static_cast<int64_t>(tp * tmp));
+        int64_t const jm = std::min(nside - 1, static_cast<int64_t>((1.0 - tp) * tmp));
+        if (z >= 0.0) {
+            face = ntt;
+            ix = nside - jm - 1;
+            iy = nside - jp - 1;
+        } else {
+            face = ntt + 8;
+            ix = jp;
+            iy = jm;
+        }
+    }
+    return (static_cast<uint64_t>(face) << (2 * order)) + SpreadBits(ix) +
+           (SpreadBits(iy) << 1);
+}
+
+Vec3 PixelCenter(uint64_t pixel, int order) {
+    int64_t const nside = static_cast<int64_t>(1) << order;
+    uint64_t const npface = static_cast<uint64_t>(1) << (2 * order);
+    int64_t const face = static_cast<int64_t>(pixel >> (2 * order));
+    int64_t const ix = static_cast<int64_t>(CompressBits(pixel & (npface - 1)));
+    int64_t const iy = static_cast<int64_t>(CompressBits((pixel & (npface - 1)) >> 1));
+    int64_t const nl4 = 4 * nside;
+    double const fact2 = 4.0 / static_cast<double>(NumPixels(order));
+    double const fact1 = static_cast<double>(nside << 1) * fact2;
+    // ring index, counted from the north pole
+    int64_t const jr = (JRLL[face] << order) - ix - iy - 1;
+    int64_t nr;
+    double z;
+    int64_t kshift;
+    if (jr < nside) {
+        nr = jr;
+        z = 1.0 - static_cast<double>(nr * nr) * fact2;
+        kshift = 0;
+    } else if (jr > 3 * nside) {
+        nr = nl4 - jr;
+        z = static_cast<double>(nr * nr) * fact2 - 1.0;
+        kshift = 0;
+    } else {
+        nr = nside;
+        z = static_cast<double>(2 * nside - jr) * fact1;
+        kshift = (jr - nside) & 1;
+    }
+    int64_t jp = (JPLL[face] * nr + ix - iy + 1 + kshift) / 2;
+    if (jp > nl4) {
+        jp -= nl4;
+    }
+    if (jp < 1) {
+        jp += nl4;
+    }
+    double const phi = (jp - (kshift + 1) * 0.5) * (HALF_PI / nr);
+    return FromZPhi(z, phi);
+}
+
+PixelIndex::PixelIndex(Point* points, size_t numPoints, size_t pointsPerPixel,
+                       double /* leafExtentThreshold */)
+    : points_(points), numPoints_(numPoints) {
+    if (points == nullptr || numPoints == 0) {
+        throw std::invalid_argument("no input points provided");
+    }
+    if (pointsPerPixel == 0) {
+        throw std::invalid_argument("target number of points per pixel must be > 0");
+    }
+    int k = 0;
+    while (k < MAX_ORDER && NumPixels(k + 1) <= 2 * numPoints / pointsPerPixel) {
+        ++k;
+    }
+    order_ = k;
+    OPTICS_STATS(auto const start = std::chrono::steady_clock::now());
+    build();
+    OPTICS_STATS(buildSeconds_ = std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count());
+}
+
+void PixelIndex::build() {
+    LOG(INFO) << "building pixel index of order " << order_ << " for " << numPoints_
+              << " points";
+    size_t const numPixels = NumPixels(order_);
+    std::vector<uint64_t> pixels(numPoints_);
+    ParallelFor(numPoints_, 0, [this, &pixels](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            pixels[i] = VecToPixel(points_[i].v, order_);
+        }
+    });
+    std::vector<size_t> offsets(numPixels + 1, 0);
+    for (uint64_t pixel : pixels) {
+        ++offsets[pixel + 1];
+    }
+    for (size_t p = 0; p < numPixels; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+    // Sort points by pixel in place, by swapping each point into the next free slot
+    // of its pixel until every slot holds a point of the right pixel.
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t p = 0; p < numPixels; ++p) {
+        while (next[p] < offsets[p + 1]) {
+            size_t const i = next[p];
+            uint64_t const pixel = pixels[i];
+            if (pixel == p) {
+                ++next[p];
+                continue;
+            }
+            size_t const j = next[pixel]++;
+            std::swap(points_[i], points_[j]);
+            std::swap(pixels[i], pixels[j]);
+        }
+    }
+    pixels_.resize(FirstPixel(order_ + 1));
+    // Bounding radii are computed from the points at the finest order only. Coarser
+    // pixels derive theirs from the bounding spheres of their 4 children, which costs
+    // O(pixels) rather than O(points) per order.
+    for (int k = order_; k >= 0; --k) {
+        Pixel* pixels = pixels_.data() + FirstPixel(k);
+        Pixel const* children = pixels_.data() + FirstPixel(k + 1);
+        int const shift = 2 * (order_ - k);
+        ParallelFor(NumPixels(k), 0, [&](size_t, size_t begin, size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+                Pixel& pixel = pixels[p];
+                pixel.center = PixelCenter(p, k);
+                pixel.begin = offsets[p << shift];
+                pixel.end = offsets[(p + 1) << shift];
+                double radius = 0.0;
+                if (k == order_) {
+                    double dist = 0.0;
+                    for (size_t i = pixel.begin; i < pixel.end; ++i) {
+                        Vec3 const& v = points_[i].v;
+                        dist = std::max(dist, SquaredEuclidianDistance(pixel.center, v));
+                    }
+                    radius = std::sqrt(dist);
+                } else {
+                    for (size_t c = 4 * p; c < 4 * p + 4; ++c) {
+                        Pixel const& child = children[c];
+                        if (child.begin == child.end) {
+                            continue;
+                        }
+                        double const d = std::sqrt(
+                            SquaredEuclidianDistance(pixel.center, child.center));
+                        radius = std::max(radius, d + child.radius);
+                    }
+                }
+                pixel.radius = RADIUS_MARGIN * radius;
+            }
+        });
+    }
+    LOG(INFO) << "built pixel index";
+}
+
+size_t PixelIndex::inRange(Vec3 const& v, double const dist) {
+    size_t head = NOT_FOUND;
+    size_t tail = NOT_FOUND;
+    QueryStats stats;
+    OPTICS_STATS(stats.queries = 1);
+    visit(v, dist, stats, [&](size_t i, double d) {
+        OPTICS_STATS(++stats.hits);
+        points_[i].dist = d;
+        if (tail == NOT_FOUND) {
+            head = i;
+        } else {
+            points_[tail].next = i;
+        }
+        tail = i;
+    });
+    if (tail != NOT_FOUND) {
+        points_[tail].next = NOT_FOUND;
+    }
+    OPTICS_STATS(stats_ += stats);
+    return head;
+}
+
+}  // namespace optics
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Stats.h"
+#include "Tree.h"
+#include "Vec3.h"
+
+namespace optics {
+
+// Returns the HEALPix pixel containing the unit vector v, in the nested numbering
+// scheme at the given order (resolution parameter nside = 2^order). There are
+// 12 * 4^order pixels of equal area. In the nested scheme, the children of pixel p at
+// order k + 1 are 4p to 4p + 3, so that the pixels covered by any coarser pixel are
+// contiguous.
+//
+// See "HEALPix: A Framework for High-Resolution Discretization and Fast Analysis of
+// Data Distributed on the Sphere", K. M. Gorski et al. (2005), ApJ 622, 759.
+uint64_t VecToPixel(Vec3 const& v, int order);
+
+// Returns the unit vector of the center of a nested HEALPix pixel.
+Vec3 PixelCenter(uint64_t pixel, int order);
+
+// A spatial index over an array of Point objects based on the HEALPix pixelization of
+// the unit sphere, which can be used instead of a Tree by BasicOptics.
+//
+// Points are sorted by the nested id of the pixel containing them at a fine order,
+// chosen to give about `pointsPerPixel` points per pixel for uniformly distributed
+// inputs, so that the points of any pixel at any coarser order are contiguous. Each
+// pixel stores its point range along with a bounding sphere around its center, and
+// the pixels of all orders form an implicit 4-ary tree with 12 roots. Range queries
+// descend this tree, pruning pixels whose bounding sphere does not intersect the
+// query ball, and scanning the points of pixels that lie entirely inside the ball
+// without descending further. The number of points per pixel cannot adapt to the
+// data, so strongly clustered inputs favor a 3-d tree.
+//
+// As with Tree, range query results are returned as a linked list embedded in the
+// points, so an index and its point array must only be used by a single thread at a
+// time. The index does not own the point array.
+class PixelIndex {
+   public:
+    static constexpr int MAX_ORDER = 20;
+
+    // Creates a new index over an array of points. Construction modifies the order of
+    // points in the array but not the points themselves. The leafExtentThreshold is
+    // ignored: it is only accepted so that PixelIndex can be constructed like a Tree.
+    PixelIndex(Point* points, size_t numPoints, size_t pointsPerPixel,
+               double leafExtentThreshold = 0.0);
+
+    size_t size() const { return numPoints_; }
+    int order() const { return order_; }
+    Point const* getPoints() const { return points_; }
+
+    // Returns range query counters accumulated since construction or the last call to
+    // resetStats(). Every pixel tested counts as a visited node, and every pixel whose
+    // points are scanned as a scanned leaf. Always zero unless compiled with
+    // OPTICS_ENABLE_STATS.
+    QueryStats const& stats() const { return stats_; }
+    void resetStats() { stats_ = QueryStats{}; }
+
+    // Returns the wall clock time taken to build the index in seconds. Always zero
+    // unless compiled with OPTICS_ENABLE_STATS.
+    double buildSeconds() const { return buildSeconds_; }
+
+    // Locates all points within squared euclidian distance `dist` of the query point
+    // `v`, with the same contract as Tree::inRange(). Results are reported in point
+    // order.
+    size_t inRange(Vec3 const& v, double dist);
+
+    // Calls fn(i, d) for every point i within squared euclidian distance d <= `dist`
+    // of the query point `v`, in point order. Unlike inRange(), this does not modify
+    // the points, so any number of threads may call it concurrently.
+    template <typename F>
+    void visitRange(Vec3 const& v, double dist, F&& fn) const {
+        QueryStats stats;
+        visit(v, dist, stats, std::forward<F>(fn));
+    }
+
+   private:
+    Point* points_;  // unowned
+    size_t numPoints_;
+    int order_;
+    // A pixel: its points, its center, and the euclidian radius of a sphere around
+    // the center that contains all of its points
+    struct Pixel {
+        Vec3 center;
+        double radius;
+        size_t begin;
+        size_t end;
+    };
+
+    // Pixels of every order up to order_, coarsest first, and in nested order within
+    // each order. The pixels of order k start at index 12 * (4^k - 1) / 3.
+    std::vector<Pixel> pixels_;
+    QueryStats stats_;
+    double buildSeconds_ = 0.0;
+
+    void build();
+
+    // Calls fn(i, d) for every point i within squared euclidian distance d <= `dist`
+    // of `v`, and accumulates traversal counters in `stats`.
+    template <typename F>
+    void visit(Vec3 const& v, double dist, QueryStats& stats, F&& fn) const;
+};
+
+template <typename F>
+void PixelIndex::visit(Vec3 const& v, double dist, [[maybe_unused]] QueryStats& stats,
+                       F&& fn) const {
+    double const radius = std::sqrt(dist);
+    // index of the first pixel of the finest order
+    size_t const firstLeaf = 12 * ((static_cast<size_t>(1) << (2 * order_)) - 1) / 3;
+    // Pixels are visited depth first, lowest pixel first, so that results are in
+    // point order. Each step pops one pixel and pushes at most 4.
+    std::array<size_t, 12 + 3 * MAX_ORDER> stack;
+    size_t size = 0;
+    for (size_t p = 12; p-- > 0;) {
+        stack[size++] = p;
+    }
+    while (size > 0) {
+        size_t const p = stack[--size];
+        Pixel const& pixel = pixels_[p];
+        if (pixel.begin == pixel.end) {
+            continue;
+        }
+        OPTICS_STATS(++stats.nodesVisited);
+        double const d = SquaredEuclidianDistance(v, pixel.center);
+        double const outer = radius + pixel.radius;
+        if (d > outer * outer) {
+            continue;
+        }
+        double const inner = radius - pixel.radius;
+        if (p < firstLeaf && (inner < 0.0 || d > inner * inner)) {
+            // the pixel straddles the query circle: visit its children
+            for (size_t c = 4 * p + 16; c-- > 4 * p + 12;) {
+                stack[size++] = c;
+            }
+            continue;
+        }
+        OPTICS_STATS(++stats.leavesScanned;
+                     stats.distanceEvaluations += pixel.end - pixel.begin);
+        for (size_t i = pixel.begin; i < pixel.end; ++i) {
+            double const d = SquaredEuclidianDistance(v, points_[i].v);
+            if (d <= dist) {
+                fn(i, d);
+            }
+        }
+    }
+}
+
+}  // namespace optics
@@ -0,0 +1,125 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <vector>
+
+#include "LonLat.h"
+#include "PixelIndex.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+double Angle(Vec3 const& a, Vec3 const& b) {
+    return 2.0 * std::asin(0.5 * std::sqrt(SquaredEuclidianDistance(a, b)));
+}
+
+TEST(PixelIndexTest, PixelCenters) {
+    for (int order : {0, 1, 2, 5}) {
+        for (uint64_t p = 0; p < (static_cast<uint64_t>(12) << (2 * order)); ++p) {
+            EXPECT_EQ(VecToPixel(PixelCenter(p, order), order), p);
+        }
+    }
+    std::mt19937_64 rng(1234);
+    for (int order : {10, 16, 20}) {
+        uint64_t const numPixels = static_cast<uint64_t>(12) << (2 * order);
+        std::uniform_int_distribution<uint64_t> pick{0, numPixels - 1};
+        for (int i = 0; i < 10000; ++i) {
+            uint64_t const p = pick(rng);
+            EXPECT_EQ(VecToPixel(PixelCenter(p, order), order), p);
+        }
+    }
+}
+
+TEST(PixelIndexTest, VecToPixel) {
+    std::mt19937_64 rng(1234);
+    std::vector<Vec3> points;
+    for (int i = 0; i < 100000; ++i) {
+        points.push_back(LonLat::random(rng));
+    }
+    // include points close to the poles and to the boundaries of the polar caps
+    for (int i = 0; i < 20000; ++i) {
+        points.push_back(LonLat::random(rng, 89.9, 90.0));
+        points.push_back(LonLat::random(rng, -90.0, -89.9));
+        points.push_back(LonLat::random(rng, 41.7, 42.1));
+        points.push_back(LonLat::random(rng, -42.1, -41.7));
+    }
+    for (Vec3 const& v : points) {
+        uint64_t parent = VecToPixel(v, 0);
+        ASSERT_LT(parent, 12);
+        for (int order = 1; order <= PixelIndex::MAX_ORDER; ++order) {
+            uint64_t const p = VecToPixel(v, order);
+            ASSERT_EQ(p >> 2, parent) << "order " << order;
+            parent = p;
+        }
+    }
+    // pixels are compact
+    for (int order : {0, 4, 8}) {
+        double const size = std::sqrt(4.0 * std::numbers::pi / (12 << (2 * order)));
+        for (Vec3 const& v : points) {
+            uint64_t const p = VecToPixel(v, order);
+            EXPECT_LT(Angle(v, PixelCenter(p, order)), 1.5 * size) << "order " << order;
+        }
+    }
+    // base pixels have equal areas
+    std::vector<size_t> counts(12, 0);
+    for (size_t i = 0; i < 120000; ++i) {
+        ++counts[VecToPixel(LonLat::random(rng), 0)];
+    }
+    EXPECT_THAT(counts, testing::Each(testing::AllOf(testing::Gt(9500),
+                                                      testing::Lt(10500))));
+}
+
+TEST(PixelIndexTest, InRange) {
+    std::mt19937_64 rng(1234);
+    std::vector<Point> points;
+    // uniformly distributed points and a few dense clumps
+    for (int i = 0; i < 50000; ++i) {
+        points.emplace_back().v = LonLat::random(rng);
+    }
+    for (int c = 0; c < 20; ++c) {
+        LonLat const center = LonLat::random(rng);
+        for (int i = 0; i < 1000; ++i) {
+            points.emplace_back().v = center.perturb(rng, 0.05);
+        }
+    }
+    for (size_t i = 0; i < points.size(); ++i) {
+        points[i].state = i;
+    }
+    PixelIndex index{points.data(), points.size(), 8};
+    ASSERT_GT(index.order(), 0);
+    for (double radius : {0.01, 0.1, 1.0, 20.0}) {
+        double const dist = SquaredEuclidianDistance(radius);
+        for (int q = 0; q < 500; ++q) {
+            Vec3 const v = q % 2 == 0 ? LonLat::random(rng) : points[q * 97].v;
+            std::vector<size_t> expected;
+            for (Point const& p : points) {
+                if (SquaredEuclidianDistance(v, p.v) <= dist) {
+                    expected.push_back(p.state);
+                }
+            }
+            std::vector<size_t> found;
+            size_t previous = NOT_FOUND;
+            for (size_t i = index.inRange(v, dist); i != NOT_FOUND;
+                 i = points[i].next) {
+                EXPECT_EQ(points[i].dist, SquaredEuclidianDistance(v, points[i].v));
+                // results are in point order
+                EXPECT_TRUE(previous == NOT_FOUND || previous < i);
+                previous = i;
+                found.push_back(points[i].state);
+            }
+            std::sort(expected.begin(), expected.end());
+            std::sort(found.begin(), found.end());
+            EXPECT_EQ(found, expected);
+        }
+    }
+}
+
+}  // namespace
+}  // namespace optics
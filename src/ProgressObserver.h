@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+namespace optics {
+
+// A snapshot of the progress of a long running clustering job.
+struct Progress {
+    size_t pointsProcessed = 0;
+    size_t numPoints = 0;
+    // current number of points in the OPTICS seed list
+    size_t seedListSize = 0;
+    size_t clustersPublished = 0;
+    // wall clock time since the start of the run (s)
+    double elapsedSeconds = 0.0;
+    // throughput since the previous report
+    double pointsPerSecond = 0.0;
+    // estimated time to completion at the current throughput (s), or infinity
+    double remainingSeconds = 0.0;
+};
+
+struct ProgressObserver {
+    virtual ~ProgressObserver() = 0;
+
+    // Called periodically from the thread running the clustering job, and once more
+    // when the job completes.
+    virtual void onProgress(Progress const &progress) = 0;
+};
+
+inline ProgressObserver::~ProgressObserver() = default;
+
+}  // namespace optics
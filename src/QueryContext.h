@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Stats.h"
+#include "Vec3.h"
+
+namespace optics {
+
+class Tree;
+
+// Remembers the 3-d tree leaves near a recent range query, so that nearby follow-up
+// queries can skip the descent from the root of the tree.
+//
+// When a query cannot reuse the cached leaves, the tree is traversed with a radius
+// widened by a margin, and every leaf intersecting the widened ball is cached along
+// with the bounds of its region of space (derived from the splits on its path). A
+// later query with radius r whose center is displaced by d from the original query
+// point lies entirely inside the widened ball as long as d + r does not exceed the
+// widened radius: it is answered by testing the cached leaf bounds against the query
+// ball and scanning the leaves that pass. The first scan of a leaf replaces its region
+// bounds with the bounding box of its points, which rejects more leaves. Results are
+// identical to those of a fresh query, including their order, since leaves are
+// cached in traversal order and only leaves without points in the ball are skipped.
+//
+// OPTICS expands clusters by popping seeds that are usually within epsilon of the
+// previously expanded point, so most queries can be answered from the cache when the
+// margin is of the order of epsilon. Descents over the upper nodes of a tree are
+// already cheap while they stay in cache, though, so a context does not pay off for
+// small neighborhoods (see BM_ConsecutiveQuery in optics-bench).
+//
+// A context may only be used with one tree, and a single thread at a time. Each
+// thread should use its own context.
+class QueryContext {
+   public:
+    // The cached leaves are those within (1 + widening) times the query radius.
+    explicit QueryContext(double widening = 1.0) : widening_{widening} {}
+
+    // Forgets the cached leaves.
+    void clear() { valid_ = false; }
+
+    // Returns counters for queries made with this context since construction or the
+    // last call to resetStats(). Always zero unless compiled with OPTICS_ENABLE_STATS.
+    QueryStats const& stats() const { return stats_; }
+    void resetStats() { stats_ = QueryStats{}; }
+
+   private:
+    friend class Tree;
+
+    // A leaf, and either the bounds of its region of space along each dimension, or
+    // once it has been scanned, the (tight) bounding box of its points
+    struct Leaf {
+        size_t begin;
+        size_t end;
+        Vec3 min;
+        Vec3 max;
+        bool tight;
+    };
+
+    double widening_;
+    bool valid_ = false;
+    Tree const* tree_ = nullptr;
+    Vec3 center_;
+    // euclidian (not squared) radius of the ball around center_ covered by leaves_
+    double radius_ = 0.0;
+    std::vector<Leaf> leaves_;
+    QueryStats stats_;
+};
+
+}  // namespace optics
@@ -0,0 +1,63 @@
+#include "RecordArena.h"
+
+#include <absl/log/log.h>
+#include <fmt/core.h>
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "Parallel.h"
+
+namespace optics {
+
+RecordArena::RecordArena(std::span<char const*> records, std::string_view input,
+                         char terminator, size_t numThreads) {
+    LOG(INFO) << "compacting " << records.size() << " records";
+    size_t const n = records.size();
+    char const* const begin = input.data();
+    char const* const end = begin + input.size();
+    // size of the copy of each record, then offset of each copy
+    std::vector<size_t> offsets(n + 1, 0);
+    std::atomic<bool> outside = false;
+    ParallelFor(n, numThreads, [&](size_t, size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            char const* record = records[i];
+            if (record == nullptr) {
+                continue;
+            }
+            if (record < begin || record >= end) {
+                outside = true;
+                return;
+            }
+            auto const* stop = static_cast<char const*>(
+                std::memchr(record, terminator, end - record));
+            offsets[i + 1] = (stop == nullptr ? end - record : stop - record) + 1;
+        }
+    });
+    if (outside) {
+        throw std::invalid_argument("records must lie within the input");
+    }
+    for (size_t i = 0; i < n; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    bytes_ = NumaArray<char>{offsets[n], MemoryPlacement::FIRST_TOUCH, numThreads};
+    char* const out = bytes_.data();
+    ParallelFor(n, numThreads, [&](size_t, size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            if (records[i] == nullptr) {
+                continue;
+            }
+            size_t const size = offsets[i + 1] - offsets[i];
+            char* const copy = out + offsets[i];
+            std::memcpy(copy, records[i], size - 1);
+            copy[size - 1] = terminator;
+            records[i] = copy;
+        }
+    });
+    LOG(INFO) << fmt::format("compacted records into {:.1f} MiB",
+                             static_cast<double>(offsets[n]) / (1 << 20));
+}
+
+}  // namespace optics
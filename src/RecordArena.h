@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+#include "Numa.h"
+
+namespace optics {
+
+// Contiguous copies of input records, such as the CSV lines that points were parsed
+// from, laid out in a chosen order.
+//
+// Points keep pointers to their records in the (possibly huge) memory mapped input.
+// Once the points have been reordered by building a spatial index, the records of a
+// cluster are scattered across the input, and publishing clusters page faults on
+// random reads. Copying the records in point order makes publication read mostly
+// sequential memory, and allows the input to be unmapped early.
+class RecordArena {
+   public:
+    RecordArena() = default;
+
+    // Copies the records in `records` to the arena, in order, in parallel, and
+    // replaces each pointer by a pointer to its copy. Every record must start within
+    // `input`, and extends to the first occurrence of `terminator` or to the end of
+    // the input. Copies always end with the terminator. Null records are left as is.
+    RecordArena(std::span<char const*> records, std::string_view input,
+                char terminator = '\n', size_t numThreads = 0);
+
+    // Returns the total size of the copied records in bytes.
+    size_t size() const { return bytes_.size(); }
+    char const* data() const { return bytes_.data(); }
+
+   private:
+    NumaArray<char> bytes_;
+};
+
+}  // namespace optics
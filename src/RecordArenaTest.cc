@@ -0,0 +1,37 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "RecordArena.h"
+
+namespace optics {
+namespace {
+
+TEST(RecordArenaTest, CopiesRecordsInOrder) {
+    std::string input = "a,1\nbb,2\nccc,3";
+    std::vector<char const*> records = {input.data() + 9, nullptr, input.data(),
+                                        input.data() + 4, input.data() + 9};
+    RecordArena const arena{records, input, '\n', 2};
+    input.assign(input.size(), '?');
+    EXPECT_EQ(std::string_view(arena.data(), arena.size()),
+              "ccc,3\na,1\nbb,2\nccc,3\n");
+    EXPECT_EQ(records[0], arena.data());
+    EXPECT_EQ(records[1], nullptr);
+    EXPECT_EQ(records[2], arena.data() + 6);
+    EXPECT_EQ(records[3], arena.data() + 10);
+    EXPECT_EQ(records[4], arena.data() + 15);
+}
+
+TEST(RecordArenaTest, RecordsOutsideInput) {
+    std::string const input = "a\nb\n";
+    std::string const other = "c\n";
+    std::vector<char const*> records = {input.data(), other.data()};
+    EXPECT_THROW((RecordArena{records, input}), std::invalid_argument);
+}
+
+}  // namespace
+}  // namespace optics
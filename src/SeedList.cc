@@ -3,6 +3,7 @@
 #include <absl/log/check.h>
 #include <absl/log/log.h>
 
+#include <algorithm>
 #include <cstdint>
 
 #include "Tree.h"
@@ -14,6 +15,7 @@ size_t SeedList::pop() {
     if (s == 0) {
         return NOT_FOUND;
     }
+    OPTICS_STATS(++stats_.pops);
     size_t smallest = heap_[0];
     points_[smallest].state = PROCESSED;
     size_ = --s;
@@ -28,8 +30,9 @@ size_t SeedList::pop() {
 }
 
 void SeedList::add(size_t i) {
-    DCHECK(i < capacity());
+    DCHECK(i < numPoints_);
     DCHECK(size() < capacity());
+    OPTICS_STATS(++stats_.adds);
     size_t s = size_;
     size_ = s + 1;
     if (s == 0) {
@@ -41,12 +44,13 @@ void SeedList::add(size_t i) {
 }
 
 void SeedList::update(size_t i, double reach) {
-    DCHECK(i < capacity());
+    DCHECK(i < numPoints_);
     size_t heapIndex = points_[i].state;
     if (heapIndex < PROCESSED) {
         DCHECK(heap_[heapIndex] == i);
         // the i-th point is already in the seed list
         if (reach < points_[i].reach) {
+            OPTICS_STATS(++stats_.decreases);
             points_[i].reach = reach;
             siftUp(heapIndex, i);
         }
@@ -59,7 +63,7 @@ void SeedList::update(size_t i, double reach) {
 
 void SeedList::siftUp(size_t heapIndex, size_t pointIndex) {
     DCHECK(heapIndex < size());
-    DCHECK(pointIndex < capacity());
+    DCHECK(pointIndex < numPoints_);
     double reach = points_[pointIndex].reach;
     while (heapIndex > 0) {
         size_t parentHeapIndex = (heapIndex - 1) >> 1;
@@ -70,13 +74,14 @@ void SeedList::siftUp(size_t heapIndex, size_t pointIndex) {
         heap_[heapIndex] = parentPointIndex;
         points_[parentPointIndex].state = heapIndex;
         heapIndex = parentHeapIndex;
+        OPTICS_STATS(++stats_.siftSteps);
     }
     heap_[heapIndex] = pointIndex;
     points_[pointIndex].state = heapIndex;
 }
 
 void SeedList::siftDown(size_t pointIndex) {
-    DCHECK(pointIndex < capacity());
+    DCHECK(pointIndex < numPoints_);
     double reach = points_[pointIndex].reach;
     size_t halfSize = size_ >> 1;
     size_t heapIndex = 0;
@@ -100,11 +105,19 @@ void SeedList::siftDown(size_t pointIndex) {
         heap_[heapIndex] = childPointIndex;
         points_[childPointIndex].state = heapIndex;
         heapIndex = childHeapIndex;
+        OPTICS_STATS(++stats_.siftSteps);
     }
     heap_[heapIndex] = pointIndex;
     points_[pointIndex].state = heapIndex;
 }
 
+void SeedList::restore(size_t const* heap, size_t size) {
+    DCHECK(size <= capacity());
+    std::copy(heap, heap + size, heap_.data());
+    size_ = size;
+    DCHECK(checkInvariants());
+}
+
 bool SeedList::checkInvariants() const {
     // check that each point knows its location in the seed list
     for (size_t i = 0; i < numPoints_; ++i) {
@@ -1,8 +1,9 @@
 #pragma once
 
 #include <cstddef>
-#include <memory>
 
+#include "Numa.h"
+#include "Stats.h"
 #include "Tree.h"
 
 namespace optics {
@@ -13,37 +14,65 @@ namespace optics {
 class SeedList {
    public:
     SeedList(Point* points, size_t numPoints)
-        : heap_{std::make_unique<size_t[]>(numPoints)},
+        : SeedList{points, numPoints, numPoints} {}
+
+    // Creates a seed list over an array of numPoints points that holds at most
+    // `capacity` of them at a time, such as the points of a subset that no expansion
+    // can leave. Several such seed lists may then share a point array, as long as
+    // they hold disjoint subsets of its points.
+    SeedList(Point* points, size_t numPoints, size_t capacity)
+        : heap_{capacity, MemoryPlacement::FIRST_TOUCH, 1},
           points_{points},
           size_{0},
           numPoints_{numPoints} {}
 
     bool empty() const { return size_ == 0; }
+    // Empties the seed list without modifying any points.
+    void clear() { size_ = 0; }
     size_t size() const { return size_; }
-    size_t capacity() const { return numPoints_; }
+    size_t capacity() const { return heap_.size(); }
+    size_t numPoints() const { return numPoints_; }
 
     // Finds the point with the smallest reachability-distance, removes it from the seed
     // list, and returns its index. If the seed list is empty, returns NOT_FOUND.
     size_t pop();
 
     // Adds the i-th point to this seed list. Assumes that:
-    // - i < capacity()
+    // - i < numPoints()
     // - size() < capacity()
     void add(size_t i);
 
     // Updates the reachability-distance of the i-th point. If it isn't already in the
     // seed list, it is added. Otherwise, if the new reachability-distance is smaller
     // than the current one, the i-th point's reachability-distance is updated. Assumes
-    // that i < capacity().
+    // that i < numPoints(), and that size() < capacity() if the point is added.
     void update(size_t i, double reach);
 
+    // Checks that the heap is valid and that the states of the points match it, which
+    // requires this to be the only seed list over its points.
     bool checkInvariants() const;
 
+    // Returns the heap of point indices backing this seed list. The first size()
+    // entries are valid.
+    size_t const* heap() const { return heap_.data(); }
+
+    // Replaces the contents of this seed list with a heap previously obtained from
+    // heap(). Assumes that the reachability-distances and states of the points have
+    // been restored to the values they had when the heap was obtained, and that
+    // size <= capacity().
+    void restore(size_t const* heap, size_t size);
+
+    // Returns counters accumulated since construction or the last call to
+    // resetStats(). Always zero unless compiled with OPTICS_ENABLE_STATS.
+    SeedListStats const& stats() const { return stats_; }
+    void resetStats() { stats_ = SeedListStats{}; }
+
    private:
-    std::unique_ptr<size_t[]> heap_;
+    NumaArray<size_t> heap_;
     Point* points_;  // unowned
     size_t size_;
     size_t numPoints_;
+    SeedListStats stats_;
 
     void siftUp(size_t heapIndex, size_t pointIndex);
     void siftDown(size_t pointIndex);
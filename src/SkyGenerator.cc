@@ -0,0 +1,218 @@
+#include "SkyGenerator.h"
+
+#include <absl/cleanup/cleanup.h>
+#include <absl/log/log.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "Parallel.h"
+#include "Vec3.h"
+
+namespace optics {
+
+namespace {
+
+// Stream identifier used to seed the generator for cluster parameters; block b uses b.
+constexpr uint64_t CLUSTER_STREAM = static_cast<uint64_t>(-1);
+
+std::mt19937_64 MakeRng(uint64_t seed, uint64_t stream) {
+    std::seed_seq seq{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                      static_cast<uint32_t>(stream),
+                      static_cast<uint32_t>(stream >> 32)};
+    return std::mt19937_64{seq};
+}
+
+void checkConfig(SkyGeneratorConfig const& c) {
+    if (c.noiseFraction < 0.0 || c.noiseFraction > 1.0) {
+        throw std::invalid_argument("noise fraction must be in [0, 1]");
+    }
+    if (c.numClusters == 0 && c.noiseFraction != 1.0) {
+        throw std::invalid_argument(
+            "noise fraction must be 1 when there are no clusters");
+    }
+    if (!(c.minClusterSigma > 0.0) || c.minClusterSigma > c.maxClusterSigma) {
+        throw std::invalid_argument("invalid cluster sigma range");
+    }
+    if (c.clusterSizeExponent < 0.0) {
+        throw std::invalid_argument("cluster size exponent must be >= 0");
+    }
+    if (c.polarClusterFraction < 0.0 || c.wrapClusterFraction < 0.0 ||
+        c.polarClusterFraction + c.wrapClusterFraction > 1.0) {
+        throw std::invalid_argument("invalid polar/wrap-around cluster fractions");
+    }
+    if (c.poleCapLat < 0.0 || c.poleCapLat > 90.0) {
+        throw std::invalid_argument("polar cap latitude must be in [0, 90]");
+    }
+    if (c.wrapWidth < 0.0 || c.wrapWidth > 180.0) {
+        throw std::invalid_argument("wrap-around width must be in [0, 180]");
+    }
+}
+
+// Draws a point from a circular 2-d Gaussian with the given standard deviation (deg)
+// in the tangent plane at `center`, projected back onto the sphere.
+LonLat gaussian(std::mt19937_64& rng, LonLat const& center, double sigma) {
+    std::normal_distribution<double> normal{0.0, RAD_PER_DEG * sigma};
+    Vec3 v = center;
+    v += normal(rng) * EastOf(center);
+    v += normal(rng) * NorthOf(center);
+    return Normalize(v).lonLat();
+}
+
+void writeFully(int fd, char const* data, size_t size,
+                std::filesystem::path const& path) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(
+                fmt::format("failed to write to {}: errno={}", path.c_str(), errno));
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void formatBlock(std::vector<SyntheticSource> const& sources, CatalogFormat format,
+                 bool labels, std::string& out) {
+    out.clear();
+    if (format == CatalogFormat::BINARY) {
+        size_t const recordSize = 2 * sizeof(double) + (labels ? sizeof(int64_t) : 0);
+        out.resize(sources.size() * recordSize);
+        char* p = out.data();
+        for (auto const& s : sources) {
+            std::memcpy(p, &s.p.lon, sizeof(double));
+            std::memcpy(p + sizeof(double), &s.p.lat, sizeof(double));
+            if (labels) {
+                std::memcpy(p + 2 * sizeof(double), &s.label, sizeof(int64_t));
+            }
+            p += recordSize;
+        }
+        return;
+    }
+    auto it = std::back_inserter(out);
+    for (auto const& s : sources) {
+        if (labels) {
+            fmt::format_to(it, "{:.9f},{:.9f},{}\n", s.p.lon, s.p.lat, s.label);
+        } else {
+            fmt::format_to(it, "{:.9f},{:.9f}\n", s.p.lon, s.p.lat);
+        }
+    }
+}
+
+}  // namespace
+
+SkyGenerator::SkyGenerator(SkyGeneratorConfig const& config) : config_(config) {
+    checkConfig(config_);
+    auto rng = MakeRng(config_.seed, CLUSTER_STREAM);
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    clusters_.reserve(config_.numClusters);
+    cdf_.reserve(config_.numClusters);
+    double total = 0.0;
+    for (size_t i = 0; i < config_.numClusters; ++i) {
+        Cluster c;
+        double u = uniform(rng);
+        if (u < config_.polarClusterFraction) {
+            c.center = uniform(rng) < 0.5
+                           ? LonLat::random(rng, config_.poleCapLat, 90.0)
+                           : LonLat::random(rng, -90.0, -config_.poleCapLat);
+        } else if (u < config_.polarClusterFraction + config_.wrapClusterFraction) {
+            c.center = LonLat::random(rng, 360.0 - config_.wrapWidth, config_.wrapWidth,
+                                      -60.0, 60.0);
+        } else {
+            c.center = LonLat::random(rng);
+        }
+        c.sigma = config_.minClusterSigma +
+                  uniform(rng) * (config_.maxClusterSigma - config_.minClusterSigma);
+        clusters_.push_back(c);
+        // relative cluster size, Pareto distributed with minimum 1
+        double size = 1.0;
+        if (config_.clusterSizeExponent > 0.0) {
+            size = std::pow(1.0 - uniform(rng), -1.0 / config_.clusterSizeExponent);
+        }
+        total += size;
+        cdf_.push_back(total);
+    }
+    for (double& c : cdf_) {
+        c /= total;
+    }
+}
+
+void SkyGenerator::generateBlock(size_t block,
+                                 std::vector<SyntheticSource>& sources) const {
+    size_t const begin = block * BLOCK_SIZE;
+    size_t const end = std::min(begin + BLOCK_SIZE, config_.numPoints);
+    auto rng = MakeRng(config_.seed, block);
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    sources.clear();
+    sources.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        if (uniform(rng) < config_.noiseFraction) {
+            sources.push_back(SyntheticSource{LonLat::random(rng), NOISE_LABEL});
+            continue;
+        }
+        size_t c = std::upper_bound(cdf_.begin(), cdf_.end(), uniform(rng)) -
+                   cdf_.begin();
+        c = std::min(c, clusters_.size() - 1);
+        Cluster const& cluster = clusters_[c];
+        sources.push_back(
+            SyntheticSource{gaussian(rng, cluster.center, cluster.sigma),
+                            static_cast<int64_t>(c)});
+    }
+}
+
+std::vector<SyntheticSource> SkyGenerator::generate(size_t numThreads) const {
+    std::vector<SyntheticSource> sources(config_.numPoints);
+    ParallelFor(numBlocks(), numThreads, [&](size_t, size_t begin, size_t end) {
+        std::vector<SyntheticSource> block;
+        for (size_t b = begin; b < end; ++b) {
+            generateBlock(b, block);
+            std::copy(block.begin(), block.end(), sources.begin() + b * BLOCK_SIZE);
+        }
+    });
+    return sources;
+}
+
+void SkyGenerator::write(std::filesystem::path const& path, CatalogFormat format,
+                         bool labels, size_t numThreads) const {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error(
+            fmt::format("failed to open {}: errno={}", path.c_str(), errno));
+    }
+    absl::Cleanup const closer = [fd] { ::close(fd); };
+
+    LOG(INFO) << "writing " << config_.numPoints << " synthetic sources to " << path;
+    // Blocks are generated and formatted in parallel in batches of a few blocks per
+    // thread, and then written out sequentially while preserving block order.
+    numThreads = ResolveThreadCount(numThreads);
+    size_t const batchSize = 4 * numThreads;
+    std::vector<std::string> buffers(batchSize);
+    for (size_t first = 0; first < numBlocks(); first += batchSize) {
+        size_t const n = std::min(batchSize, numBlocks() - first);
+        ParallelFor(n, numThreads, [&](size_t, size_t begin, size_t end) {
+            std::vector<SyntheticSource> block;
+            for (size_t b = begin; b < end; ++b) {
+                generateBlock(first + b, block);
+                formatBlock(block, format, labels, buffers[b]);
+            }
+        });
+        for (size_t b = 0; b < n; ++b) {
+            writeFully(fd, buffers[b].data(), buffers[b].size(), path);
+        }
+    }
+    LOG(INFO) << "finished writing synthetic sources";
+}
+
+}  // namespace optics
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "Labels.h"
+#include "LonLat.h"
+
+namespace optics {
+
+enum class CatalogFormat {
+    // One "lon,lat[,label]\n" line per source, angles in degrees.
+    CSV,
+    // Native-endian records of two doubles (lon, lat in degrees), optionally followed
+    // by a 64-bit signed label.
+    BINARY,
+};
+
+struct SkyGeneratorConfig {
+    // Seed from which all random numbers are derived. Output depends only on the
+    // configuration, never on the number of threads used to produce it.
+    uint64_t seed = 1;
+    // Total number of sources to generate.
+    size_t numPoints = 1000000;
+    // Number of Gaussian clusters.
+    size_t numClusters = 1000;
+    // Fraction of sources drawn uniformly from the whole sky.
+    double noiseFraction = 0.5;
+    // Cluster standard deviations are drawn uniformly from this range (deg), which
+    // must not include 0.
+    double minClusterSigma = 1.0 / 3600.0;
+    double maxClusterSigma = 10.0 / 3600.0;
+    // Shape parameter of the Pareto distribution from which relative cluster sizes
+    // are drawn. Smaller values give a heavier tail; 0 makes all clusters equally
+    // likely.
+    double clusterSizeExponent = 1.5;
+    // Fraction of cluster centers placed in the polar caps |lat| >= poleCapLat.
+    double polarClusterFraction = 0.05;
+    double poleCapLat = 85.0;
+    // Fraction of cluster centers placed within wrapWidth deg of longitude 0/360.
+    double wrapClusterFraction = 0.05;
+    double wrapWidth = 0.5;
+};
+
+// A generated source, along with the index of the cluster it was drawn from
+// (NOISE_LABEL for background sources).
+struct SyntheticSource {
+    LonLat p;
+    int64_t label;
+};
+
+// Generates synthetic sky catalogues consisting of a uniform background and a set of
+// Gaussian clusters, some of which sit on the poles or straddle the longitude 0/360
+// discontinuity, for use in accuracy and load testing.
+//
+// Sources are produced in fixed size blocks. Each block is generated from its own
+// deterministically seeded random number generator, so blocks can be produced in
+// parallel and in any order with identical results.
+class SkyGenerator {
+   public:
+    static constexpr size_t BLOCK_SIZE = static_cast<size_t>(1) << 16;
+
+    struct Cluster {
+        LonLat center;
+        // standard deviation of the cluster (deg)
+        double sigma;
+    };
+
+    explicit SkyGenerator(SkyGeneratorConfig const& config);
+
+    SkyGeneratorConfig const& config() const { return config_; }
+    std::vector<Cluster> const& clusters() const { return clusters_; }
+    size_t numBlocks() const {
+        return (config_.numPoints + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    // Replaces the contents of `sources` with the sources in the given block.
+    // Assumes that block < numBlocks().
+    void generateBlock(size_t block, std::vector<SyntheticSource>& sources) const;
+
+    // Generates the entire catalogue in memory using `numThreads` threads (0 means
+    // all hardware threads).
+    std::vector<SyntheticSource> generate(size_t numThreads = 0) const;
+
+    // Writes the entire catalogue to a file, optionally including ground truth
+    // labels, using `numThreads` threads (0 means all hardware threads) to generate
+    // and format blocks. Blocks are written in order.
+    void write(std::filesystem::path const& path, CatalogFormat format, bool labels,
+               size_t numThreads = 0) const;
+
+   private:
+    SkyGeneratorConfig config_;
+    std::vector<Cluster> clusters_;
+    // cumulative relative cluster sizes, normalized to 1
+    std::vector<double> cdf_;
+};
+
+}  // namespace optics
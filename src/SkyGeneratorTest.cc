@@ -0,0 +1,118 @@
+#include <absl/cleanup/cleanup.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "InputFile.h"
+#include "SkyGenerator.h"
+#include "TestPath.h"
+
+namespace optics {
+namespace {
+
+SkyGeneratorConfig TestConfig() {
+    SkyGeneratorConfig config;
+    config.seed = 42;
+    config.numPoints = 3 * SkyGenerator::BLOCK_SIZE + 1234;
+    config.numClusters = 50;
+    config.noiseFraction = 0.25;
+    config.polarClusterFraction = 0.2;
+    config.wrapClusterFraction = 0.2;
+    return config;
+}
+
+// Checks that output does not depend on the number of threads
+TEST(SkyGeneratorTest, Deterministic) {
+    SkyGenerator generator{TestConfig()};
+    auto a = generator.generate(1);
+    auto b = generator.generate(3);
+    ASSERT_EQ(a.size(), TestConfig().numPoints);
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        ASSERT_EQ(a[i].p.lon, b[i].p.lon);
+        ASSERT_EQ(a[i].p.lat, b[i].p.lat);
+        ASSERT_EQ(a[i].label, b[i].label);
+    }
+}
+
+// Checks the noise fraction, and that cluster members lie close to their cluster
+TEST(SkyGeneratorTest, Distribution) {
+    SkyGenerator generator{TestConfig()};
+    auto sources = generator.generate(2);
+    auto const& clusters = generator.clusters();
+    ASSERT_EQ(clusters.size(), TestConfig().numClusters);
+    size_t numNoise = 0;
+    for (auto const& s : sources) {
+        EXPECT_GE(s.p.lon, 0.0);
+        EXPECT_LE(s.p.lon, 360.0);
+        EXPECT_GE(s.p.lat, -90.0);
+        EXPECT_LE(s.p.lat, 90.0);
+        if (s.label == NOISE_LABEL) {
+            ++numNoise;
+            continue;
+        }
+        ASSERT_GE(s.label, 0);
+        ASSERT_LT(static_cast<size_t>(s.label), clusters.size());
+        auto const& c = clusters[s.label];
+        EXPECT_LT(c.center.distance(s.p), 10.0 * c.sigma);
+    }
+    double const noiseFraction = static_cast<double>(numNoise) / sources.size();
+    EXPECT_NEAR(noiseFraction, TestConfig().noiseFraction, 0.01);
+}
+
+// Checks that invalid configurations are rejected
+TEST(SkyGeneratorTest, InvalidConfig) {
+    auto config = TestConfig();
+    config.noiseFraction = 1.5;
+    EXPECT_THROW(SkyGenerator{config}, std::invalid_argument);
+    config = TestConfig();
+    config.minClusterSigma = 0.0;
+    EXPECT_THROW(SkyGenerator{config}, std::invalid_argument);
+    config.minClusterSigma = -1.0 / 3600.0;
+    EXPECT_THROW(SkyGenerator{config}, std::invalid_argument);
+    config = TestConfig();
+    config.minClusterSigma = 2.0 * config.maxClusterSigma;
+    EXPECT_THROW(SkyGenerator{config}, std::invalid_argument);
+    config = TestConfig();
+    config.wrapClusterFraction = 0.9;
+    EXPECT_THROW(SkyGenerator{config}, std::invalid_argument);
+}
+
+// Checks that CSV output can be read back
+TEST(SkyGeneratorTest, WriteCsv) {
+    auto config = TestConfig();
+    config.numPoints = 1000;
+    SkyGenerator generator{config};
+    auto sources = generator.generate(1);
+    auto const path = TestPath(".csv");
+    absl::Cleanup const remover = [&path] { std::filesystem::remove(path); };
+    generator.write(path, CatalogFormat::CSV, true, 2);
+    {
+        InputFile file{path};
+        std::string_view data = file.data();
+        size_t i = 0;
+        while (!data.empty()) {
+            size_t eol = data.find('\n');
+            ASSERT_NE(eol, std::string_view::npos);
+            ASSERT_LT(i, sources.size());
+            LonLat p = LonLat::fromCsv(data.substr(0, eol), ',');
+            EXPECT_NEAR(p.lon, sources[i].p.lon, 1e-9);
+            EXPECT_NEAR(p.lat, sources[i].p.lat, 1e-9);
+            std::string_view line = data.substr(0, eol);
+            EXPECT_EQ(line.substr(line.rfind(',') + 1),
+                      std::to_string(sources[i].label));
+            data.remove_prefix(eol + 1);
+            ++i;
+        }
+        EXPECT_EQ(i, sources.size());
+    }
+}
+
+}  // namespace
+}  // namespace optics
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+
+// Hot-path statistics are only collected when the library is compiled with
+// OPTICS_ENABLE_STATS defined (see the OPTICS_ENABLE_STATS CMake option). Otherwise,
+// statements wrapped in OPTICS_STATS() compile to nothing and all counters read as 0.
+#ifdef OPTICS_ENABLE_STATS
+#define OPTICS_STATS(...) __VA_ARGS__
+#else
+#define OPTICS_STATS(...)
+#endif
+
+namespace optics {
+
+#ifdef OPTICS_ENABLE_STATS
+constexpr bool STATS_ENABLED = true;
+#else
+constexpr bool STATS_ENABLED = false;
+#endif
+
+// Range query counters.
+struct QueryStats {
+    size_t queries = 0;
+    // 3-d tree nodes visited, including leaves
+    size_t nodesVisited = 0;
+    size_t leavesScanned = 0;
+    size_t distanceEvaluations = 0;
+    // points found to be in range
+    size_t hits = 0;
+    // queries answered from the leaves cached by a QueryContext, without a descent
+    // from the root of the tree
+    size_t frontierReuses = 0;
+
+    QueryStats& operator+=(QueryStats const& s) {
+        queries += s.queries;
+        frontierReuses += s.frontierReuses;
+        nodesVisited += s.nodesVisited;
+        leavesScanned += s.leavesScanned;
+        distanceEvaluations += s.distanceEvaluations;
+        hits += s.hits;
+        return *this;
+    }
+};
+
+// Seed list (priority queue) counters.
+struct SeedListStats {
+    size_t adds = 0;
+    // updates that lowered the reachability-distance of a point already in the list
+    size_t decreases = 0;
+    size_t pops = 0;
+    // heap levels traversed while restoring the heap invariant
+    size_t siftSteps = 0;
+
+    SeedListStats& operator+=(SeedListStats const& s) {
+        adds += s.adds;
+        decreases += s.decreases;
+        pops += s.pops;
+        siftSteps += s.siftSteps;
+        return *this;
+    }
+};
+
+// Statistics for a single OPTICS run.
+struct OpticsStats {
+    static constexpr size_t HISTOGRAM_BINS = 65;
+
+    QueryStats query;
+    SeedListStats seeds;
+    size_t corePoints = 0;
+    size_t nonCorePoints = 0;
+    size_t clusters = 0;
+    // Histogram of epsilon-neighborhood sizes n, excluding the query point itself.
+    // Bin 0 counts empty neighborhoods, and bin b > 0 counts 2^(b-1) <= n < 2^b.
+    std::array<size_t, HISTOGRAM_BINS> neighborhoodSizes = {};
+    // wall clock time spent building the 3-d tree (s)
+    double buildSeconds = 0.0;
+    // wall clock time spent computing the cluster ordering, excluding publishing (s)
+    double orderingSeconds = 0.0;
+    // wall clock time spent inside ClusterPublisher::publish (s)
+    double publishSeconds = 0.0;
+
+    static size_t histogramBin(size_t n) { return std::bit_width(n); }
+};
+
+}  // namespace optics
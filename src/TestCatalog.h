@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "ClusterPublisher.h"
+#include "SkyGenerator.h"
+#include "Tree.h"
+#include "Vec3.h"
+
+// Fixtures shared by the clustering tests.
+
+namespace optics {
+
+// Collects published clusters, and the summaries of clusters published with one.
+struct CollectingPublisher : ClusterPublisher {
+    std::vector<std::vector<char const*>> clusters;
+    std::vector<ClusterSummary> summaries;
+
+    void publish(std::vector<char const*> const& cluster) override {
+        clusters.push_back(cluster);
+    }
+
+    void publishSummarized(std::vector<char const*> const& cluster,
+                           ClusterSummary const& summary) override {
+        publish(cluster);
+        summaries.push_back(summary);
+    }
+};
+
+// Returns the clusters as sorted sets of records, dropping records for which keep()
+// is false and clusters left empty.
+template <typename F>
+std::vector<std::vector<char const*>> Normalized(
+    std::vector<std::vector<char const*>> const& clusters, F&& keep) {
+    std::vector<std::vector<char const*>> result;
+    for (auto const& cluster : clusters) {
+        std::vector<char const*> kept;
+        std::copy_if(cluster.begin(), cluster.end(), std::back_inserter(kept), keep);
+        if (!kept.empty()) {
+            std::sort(kept.begin(), kept.end());
+            result.push_back(std::move(kept));
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Returns the clusters as sorted sets of records
+inline std::vector<std::vector<char const*>> Normalized(
+    std::vector<std::vector<char const*>> const& clusters) {
+    return Normalized(clusters, [](char const*) { return true; });
+}
+
+// Returns the configuration of a synthetic catalogue of compact, well separated
+// clusters, which tests may adjust.
+inline SkyGeneratorConfig TestCatalogConfig(size_t numPoints) {
+    SkyGeneratorConfig config;
+    config.seed = 7;
+    config.numPoints = numPoints;
+    config.numClusters = 20;
+    config.noiseFraction = 0.01;
+    config.minClusterSigma = 1.0 / 3600.0;
+    config.maxClusterSigma = 2.0 / 3600.0;
+    return config;
+}
+
+// A synthetic catalogue, by default as configured by TestCatalogConfig(). The record
+// of the i-th point is &records[i], so that published records can be mapped back to
+// labels. Records past the last point are spare, for points added by a test.
+struct TestCatalog {
+    std::vector<SyntheticSource> sources;
+    std::vector<char> records;
+    std::vector<Point> points;
+
+    explicit TestCatalog(SkyGeneratorConfig const& config, size_t numSpareRecords = 0)
+        : sources{SkyGenerator{config}.generate(2)},
+          records(config.numPoints + numSpareRecords),
+          points(config.numPoints) {
+        for (size_t i = 0; i < config.numPoints; ++i) {
+            points[i].v = sources[i].p;
+            points[i].record = &records[i];
+        }
+    }
+
+    explicit TestCatalog(size_t numPoints, size_t numSpareRecords = 0)
+        : TestCatalog{TestCatalogConfig(numPoints), numSpareRecords} {}
+
+    int64_t label(char const* record) const {
+        return sources[record - records.data()].label;
+    }
+};
+
+// Clustering parameters suited to TestCatalog
+inline constexpr size_t MinNeighbors = 5;
+inline double const Epsilon = SquaredEuclidianDistance(3.0 / 3600.0);
+
+}  // namespace optics
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace optics {
+
+// Returns a path in the temporary directory that is unique to the running test and
+// process, so that tests run concurrently (e.g. by ctest -j) never share files.
+inline std::filesystem::path TestPath(std::string_view extension) {
+    ::testing::TestInfo const* info =
+        ::testing::UnitTest::GetInstance()->current_test_info();
+    std::string name = std::string{info->test_suite_name()} + "." + info->name() +
+                       "." + std::to_string(::getpid());
+    name += extension;
+    return std::filesystem::temp_directory_path() / name;
+}
+
+}  // namespace optics
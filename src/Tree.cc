@@ -4,56 +4,105 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <utility>
 
+#include "BasicTree.h"
+#include "Parallel.h"
+
 namespace optics {
 
 namespace {
 
-// Finds the dimension in which the given points have maximum extent. Used to pick a
-// splitting dimension during tree construction. Assumes that points != nullptr and
-// numPoints > 0.
-//
-// Returns a pair containing the maximum extent of the input points and the dimension of
-// maximum extent.
-std::pair<double, size_t> MaxExtentAndDim(Point const* points, size_t numPoints) {
-    Vec3 min = {std::numeric_limits<double>::infinity(),
-                std::numeric_limits<double>::infinity(),
-                std::numeric_limits<double>::infinity()};
-    Vec3 max = -min;
-
-    for (size_t i = 0; i < numPoints; ++i) {
-        min = Min(min, points[i].v);
-        max = Max(max, points[i].v);
-    }
-    Vec3 extents = max - min;
-    double maxExtent = extents.x();
-    size_t maxDim = 0;
-    if (extents.y() > maxExtent) {
-        maxExtent = extents.y();
-        maxDim = 1;
-    }
-    if (extents.z() > maxExtent) {
-        maxExtent = extents.z();
-        maxDim = 2;
-    }
-    return std::make_pair(maxExtent, maxDim);
-}
+// Added to the squared radius of the ball for which leaves are cached by a
+// QueryContext, so that rounding errors in bound tests never drop a leaf that a query
+// contained in the ball needs.
+constexpr double CACHE_TOLERANCE = 64.0 * std::numeric_limits<double>::epsilon();
 
-// Orders N-dimensional points along a single dimension.
-struct PointCmp {
-    size_t dim;
+// Returns the squared euclidian distance between v and the closest point of the
+// axis-aligned box with the given corners. This never exceeds the squared distance
+// computed by SquaredEuclidianDistance() between v and any point inside the box, as
+// each term of the sum is at most the corresponding term for the point.
+double SquaredDistanceToBox(Vec3 const& min, Vec3 const& max, Vec3 const& v) {
+    double sum = 0.0;
+    for (size_t d = 0; d < 3; ++d) {
+        double const gap = std::max(std::max(min.coords[d] - v.coords[d], 0.0),
+                                    v.coords[d] - max.coords[d]);
+        sum += gap * gap;
+    }
+    return sum;
+}
 
-    bool operator()(Point const& a, Point const& b) const {
-        return a.v.coords[dim] < b.v.coords[dim];
+// Returns false if no point in the region of space bounded by min and max along each
+// dimension can be within squared euclidian distance `dist` of v. This performs the
+// same comparisons as a traversal from the root to the region.
+bool MayIntersect(Vec3 const& min, Vec3 const& max, Vec3 const& v, double dist) {
+    for (size_t d = 0; d < 3; ++d) {
+        double const x = v.coords[d];
+        if (x < min.coords[d]) {
+            if (MinSquaredEuclidianDistance(x, min.coords[d]) > dist) {
+                return false;
+            }
+        } else if (x > max.coords[d]) {
+            if (MinSquaredEuclidianDistance(x, max.coords[d]) > dist) {
+                return false;
+            }
+        }
     }
-};
+    return true;
+}
+
+// Returns the smallest single precision value F such that the single precision
+// squared distance between the (rounded) coordinates of two unit vectors can only
+// exceed F if their double precision squared distance exceeds `dist`.
+//
+// Rounding a coordinate in [-1, 1] to single precision changes it by at most 2^-25,
+// so the difference vector of two rounded points is within sqrt(3) 2^-24 < 2^-23 of
+// the exact one. The radius is widened by that amount, and the squared radius by a
+// relative 2^-20 to cover the rounding of the subtractions, products and sums.
+float SinglePrecisionThreshold(double dist) {
+    double const radius = std::sqrt(dist) + 0x1p-23;
+    double const threshold = radius * radius * (1.0 + 0x1p-20);
+    float const f = static_cast<float>(threshold);
+    return static_cast<double>(f) >= threshold
+               ? f
+               : std::nextafter(f, std::numeric_limits<float>::infinity());
+}
 
 }  // namespace
 
+NodeLayout::NodeLayout(size_t numLevels, size_t blockHeight)
+    : blockHeight_{blockHeight} {
+    if (numLevels > MAX_LEVELS) {
+        throw std::invalid_argument("too many tree levels");
+    }
+    if (blockHeight == 0) {
+        size_ = (static_cast<size_t>(1) << numLevels) - 1;
+        return;
+    }
+    // Rows of blocks are stored one after the other, top row first. Each block of a
+    // row covers `height` levels, and is padded if it is a full height block.
+    size_t offset = 0;
+    for (size_t top = 0; top < numLevels; top += blockHeight) {
+        size_t const height = std::min(blockHeight, numLevels - top);
+        size_t const blockSize =
+            (static_cast<size_t>(1) << height) - (height == blockHeight ? 0 : 1);
+        for (size_t t = 0; t < height; ++t) {
+            levels_[top + t] = Level{offset, blockSize, t};
+        }
+        offset += (static_cast<size_t>(1) << top) * blockSize;
+    }
+    size_ = offset;
+}
+
 Tree::Tree(Point* points, size_t numPoints, size_t pointsPerLeaf,
-           double leafExtentThreshold)
+           double leafExtentThreshold, TreeBuilder builder)
     : points_(points), numPoints_(numPoints) {
     if (points == nullptr || numPoints == 0) {
         throw std::invalid_argument("no input points provided");
@@ -61,133 +110,480 @@ Tree::Tree(Point* points, size_t numPoints, size_t pointsPerLeaf,
     if (pointsPerLeaf == 0) {
         throw std::invalid_argument("target number of points per leaf must be > 0");
     }
-    // compute tree height
-    size_t h = 0;
-    while (h < MAX_HEIGHT &&
-           numPoints / (static_cast<size_t>(1) << h) > pointsPerLeaf) {
-        ++h;
-    }
+    size_t const h = TreeHeight(numPoints, pointsPerLeaf);
     height_ = h;
-    size_t numNodes = (static_cast<size_t>(1) << (h + 1)) - 1;
-    nodes_ = std::make_unique<Node[]>(numNodes);
-    build(leafExtentThreshold);
+    numNodes_ = (static_cast<size_t>(1) << (h + 1)) - 1;
+    // Node and point accesses are random, so interleave the nodes of large trees
+    // across NUMA nodes to give threads on every socket the same average latency.
+    // Nodes are built in breadth first order.
+    layout_ = NodeLayout{h + 1, 0};
+    nodes_ = NumaArray<Node>{numNodes_, InterleaveIfLarge<Node>(numNodes_)};
+    OPTICS_STATS(auto const start = std::chrono::steady_clock::now());
+    if (builder == TreeBuilder::NTH_ELEMENT) {
+        build(leafExtentThreshold);
+    } else if (numPoints <= std::numeric_limits<uint32_t>::max()) {
+        buildPresorted<uint32_t>(leafExtentThreshold);
+    } else {
+        buildPresorted<uint64_t>(leafExtentThreshold);
+    }
+    OPTICS_STATS(buildSeconds_ = std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count());
 }
 
 size_t Tree::inRange(Vec3 const& v, double const dist) {
+    NodeView const nodes = this->nodes();
+    bool const mixed = mixedPrecision();
+    float const* const x = coords_.data();
+    float const* const y = x + numPoints_;
+    float const* const z = y + numPoints_;
+    float const vx = static_cast<float>(v.x());
+    float const vy = static_cast<float>(v.y());
+    float const vz = static_cast<float>(v.z());
+    float const threshold = mixed ? SinglePrecisionThreshold(dist) : 0.0f;
     std::array<bool, MAX_HEIGHT> descend;
     size_t node = 0;
     size_t h = 0;
     size_t head = NOT_FOUND;
     size_t tail = NOT_FOUND;
-    while (true) {
-        if (nodes_[node].isLeaf()) {
-            // reached a leaf
-            size_t left = 0;
-            size_t right = nodes_[node].right();
-            if ((node & (node + 1)) != 0) {
-                // node has a left sibling - use it to obtain index of first point in
-                // leaf.
-                left = nodes_[node - 1].right();
-            }
-            // Scan leaf for results, and append them to embedded linked list
-            for (size_t i = left; i < right; ++i) {
-                double d = SquaredEuclidianDistance(v, points_[i].v);
-                if (d <= dist) {
-                    points_[i].dist = d;
-                    if (tail == NOT_FOUND) {
-                        head = i;
-                    } else {
-                        points_[tail].next = i;
-                    }
-                    tail = i;
-                }
+    OPTICS_STATS(QueryStats stats; stats.queries = 1);
+    // Descends from `node` to the first leaf below it that must be visited.
+    auto toLeaf = [&] {
+        while (true) {
+            OPTICS_STATS(++stats.nodesVisited);
+            Node const& n = nodes[node];
+            if (n.isLeaf()) {
+                return;
             }
-            // move back up the tree
+            // determine which children must be visited
+            double const vd = v.coords[n.splitDim()];
+            descend[h] = MinSquaredEuclidianDistance(vd, n.split) <= dist;
+            node = (node << 1) + (descend[h] || vd < n.split ? 1 : 2);
+            ++h;
+        }
+    };
+    // Moves from a leaf to the next leaf that must be visited. Returns false once the
+    // whole tree has been traversed.
+    auto nextLeaf = [&] {
+        // move back up the tree
+        for (; h > 0; --h) {
             node = (node - 1) >> 1;
-            --h;
-            for (; h != static_cast<size_t>(-1) && !descend[h]; --h) {
-                node = (node - 1) >> 1;
+            if (descend[h - 1]) {
+                descend[h - 1] = false;
+                node = (node << 1) + 2;
+                toLeaf();
+                return true;
             }
-            if (h == static_cast<size_t>(-1)) {
-                // finished tree traversal
-                break;
+        }
+        return false;
+    };
+    auto leafBegin = [&nodes](size_t leaf) {
+        // use the left sibling, if any, to obtain the index of the first point
+        return (leaf & (leaf + 1)) != 0 ? nodes[leaf - 1].right() : 0;
+    };
+    // Scan leaf for results, and append them to embedded linked list
+    auto scan = [&](size_t i) {
+        double d = SquaredEuclidianDistance(v, points_[i].v);
+        if (d <= dist) {
+            OPTICS_STATS(++stats.hits);
+            points_[i].dist = d;
+            if (tail == NOT_FOUND) {
+                head = i;
+            } else {
+                points_[tail].next = i;
             }
-            descend[h] = false;
-            node = (node << 1) + 2;
-            ++h;
-        } else {
-            // determine which children must be visited
-            double split = nodes_[node].split;
-            size_t dim = nodes_[node].splitDim();
-            double vd = v.coords[dim];
-            if (MinSquaredEuclidianDistance(vd, split) <= dist) {
-                // both children must be visited
-                descend[h] = true;
-                node = (node << 1) + 1;
-                ++h;
-            } else if (vd < split) {
-                // visit left child
-                descend[h] = false;
-                node = (node << 1) + 1;
-                ++h;
+            tail = i;
+        }
+    };
+    toLeaf();
+    size_t left = leafBegin(node);
+    size_t right = nodes[node].right();
+    bool more = true;
+    while (more) {
+        size_t const begin = left;
+        size_t const end = right;
+        // Find the next leaf before scanning this one, so that its points are
+        // prefetched while this leaf is scanned.
+        more = nextLeaf();
+        if (more) {
+            left = leafBegin(node);
+            right = nodes[node].right();
+            if (mixed) {
+                for (size_t i = left; i < right; i += 16) {
+                    __builtin_prefetch(x + i);
+                    __builtin_prefetch(y + i);
+                    __builtin_prefetch(z + i);
+                }
             } else {
-                // visit right child
-                descend[h] = false;
-                node = (node << 1) + 2;
-                ++h;
+                for (size_t i = left; i < right; ++i) {
+                    __builtin_prefetch(points_ + i);
+                }
+            }
+        }
+        OPTICS_STATS(++stats.leavesScanned; stats.distanceEvaluations += end - begin);
+        if (mixed) {
+            // Filter up to 64 points at a time in single precision, without
+            // branches, and only touch the points that pass.
+            for (size_t base = begin; base < end; base += 64) {
+                size_t const n = std::min<size_t>(64, end - base);
+                uint64_t mask = 0;
+                for (size_t k = 0; k < n; ++k) {
+                    float const dx = x[base + k] - vx;
+                    float const dy = y[base + k] - vy;
+                    float const dz = z[base + k] - vz;
+                    bool const pass = dx * dx + dy * dy + dz * dz <= threshold;
+                    mask |= static_cast<uint64_t>(pass) << k;
+                }
+                for (; mask != 0; mask &= mask - 1) {
+                    scan(base + std::countr_zero(mask));
+                }
+            }
+        } else {
+            for (size_t i = begin; i < end; ++i) {
+                scan(i);
             }
         }
     }
+    if (tail != NOT_FOUND) {
+        // terminate the linked list - the last result may have been linked to another
+        // point by an earlier query
+        points_[tail].next = NOT_FOUND;
+    }
+    OPTICS_STATS(stats_ += stats);
     return head;
 }
 
+size_t Tree::inRange(Vec3 const& v, double const dist, QueryContext& context) {
+    QueryStats stats;
+    OPTICS_STATS(stats.queries = 1);
+    double const radius = std::sqrt(dist);
+    if (!context.valid_ || context.tree_ != this ||
+        std::sqrt(SquaredEuclidianDistance(v, context.center_)) + radius >
+            context.radius_) {
+        cacheLeaves(v, radius * (1.0 + context.widening_), context, stats);
+    } else {
+        OPTICS_STATS(++stats.frontierReuses);
+    }
+    size_t head = NOT_FOUND;
+    size_t tail = NOT_FOUND;
+    auto append = [this, &head, &tail](size_t i, double d) {
+        points_[i].dist = d;
+        if (tail == NOT_FOUND) {
+            head = i;
+        } else {
+            points_[tail].next = i;
+        }
+        tail = i;
+    };
+    for (QueryContext::Leaf& leaf : context.leaves_) {
+        OPTICS_STATS(++stats.nodesVisited);
+        if (leaf.tight) {
+            if (SquaredDistanceToBox(leaf.min, leaf.max, v) > dist) {
+                continue;
+            }
+        } else if (!MayIntersect(leaf.min, leaf.max, v, dist)) {
+            continue;
+        }
+        OPTICS_STATS(++stats.leavesScanned;
+                     stats.distanceEvaluations += leaf.end - leaf.begin);
+        if (leaf.tight) {
+            for (size_t i = leaf.begin; i < leaf.end; ++i) {
+                double const d = SquaredEuclidianDistance(v, points_[i].v);
+                if (d <= dist) {
+                    OPTICS_STATS(++stats.hits);
+                    append(i, d);
+                }
+            }
+            continue;
+        }
+        // first scan of the leaf: replace the bounds of its region of space with the
+        // bounding box of its points
+        Vec3 min = points_[leaf.begin].v;
+        Vec3 max = min;
+        for (size_t i = leaf.begin; i < leaf.end; ++i) {
+            Vec3 const& p = points_[i].v;
+            min = Min(min, p);
+            max = Max(max, p);
+            double const d = SquaredEuclidianDistance(v, p);
+            if (d <= dist) {
+                OPTICS_STATS(++stats.hits);
+                append(i, d);
+            }
+        }
+        leaf.min = min;
+        leaf.max = max;
+        leaf.tight = true;
+    }
+    if (tail != NOT_FOUND) {
+        points_[tail].next = NOT_FOUND;
+    }
+    OPTICS_STATS(context.stats_ += stats);
+    return head;
+}
+
+void Tree::cacheLeaves(Vec3 const& v, double radius, QueryContext& context,
+                       [[maybe_unused]] QueryStats& stats) const {
+    // bounds of the region of space covered by a node
+    struct Frame {
+        size_t node;
+        Vec3 min;
+        Vec3 max;
+    };
+
+    NodeView const nodes = this->nodes();
+    double const inf = std::numeric_limits<double>::infinity();
+    double const dist = radius * radius + CACHE_TOLERANCE;
+    context.leaves_.clear();
+    // Nodes are visited depth first, left child first, so that leaves are cached
+    // (and results reported) in the same order as by a fresh query.
+    std::array<Frame, MAX_HEIGHT + 1> stack;
+    size_t size = 0;
+    stack[size++] = Frame{0, Vec3{-inf, -inf, -inf}, Vec3{inf, inf, inf}};
+    while (size > 0) {
+        Frame const frame = stack[--size];
+        Node const& node = nodes[frame.node];
+        OPTICS_STATS(++stats.nodesVisited);
+        if (node.isLeaf()) {
+            bool const first = (frame.node & (frame.node + 1)) == 0;
+            size_t const left = first ? 0 : nodes[frame.node - 1].right();
+            if (node.right() > left) {
+                context.leaves_.push_back(QueryContext::Leaf{
+                    left, node.right(), frame.min, frame.max, false});
+            }
+            continue;
+        }
+        size_t const dim = node.splitDim();
+        double const vd = v.coords[dim];
+        bool const near = MinSquaredEuclidianDistance(vd, node.split) <= dist;
+        if (near || vd >= node.split) {
+            Frame& right = stack[size++];
+            right = Frame{(frame.node << 1) + 2, frame.min, frame.max};
+            right.min.coords[dim] = node.split;
+        }
+        if (near || vd < node.split) {
+            Frame& left = stack[size++];
+            left = Frame{(frame.node << 1) + 1, frame.min, frame.max};
+            left.max.coords[dim] = node.split;
+        }
+    }
+    context.valid_ = true;
+    context.tree_ = this;
+    context.center_ = v;
+    context.radius_ = radius;
+}
+
+void Tree::setNodeLayout(size_t blockHeight) {
+    NodeLayout layout{height_ + 1, blockHeight};
+    NumaArray<Node> nodes{layout.size(), InterleaveIfLarge<Node>(layout.size())};
+    for (size_t i = 0; i < numNodes_; ++i) {
+        nodes[layout.position(i)] = nodes_[layout_.position(i)];
+    }
+    nodes_ = std::move(nodes);
+    layout_ = layout;
+}
+
+void Tree::setMixedPrecision(bool enabled) {
+    if (!enabled) {
+        coords_ = NumaArray<float>{};
+        return;
+    }
+    size_t const numCoords = 3 * numPoints_;
+    coords_ = NumaArray<float>{numCoords, InterleaveIfLarge<float>(numCoords)};
+    float* const x = coords_.data();
+    float* const y = x + numPoints_;
+    float* const z = y + numPoints_;
+    ParallelFor(numPoints_, 0, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            x[i] = static_cast<float>(points_[i].v.x());
+            y[i] = static_cast<float>(points_[i].v.y());
+            z[i] = static_cast<float>(points_[i].v.z());
+        }
+    });
+}
+
 void Tree::build(double leafExtentThreshold) {
     LOG(INFO) << "building 3d tree of height " << height_ << " for " << numPoints_
               << " points";
-    size_t node = 0;
-    size_t left = 0;
-    size_t right = numPoints_;
-    size_t h = 0;
-    while (true) {
-        nodes_[node].setRight(right);
-        if (h < height_) {
-            // find splitting dimension
-            auto [extent, dim] = MaxExtentAndDim(points_ + left, right - left);
-            if (extent > leafExtentThreshold) {
-                nodes_[node].setSplitDim(dim);
-                // find median of array
-                size_t median = left + ((right - left) >> 1);
-                std::nth_element(points_ + left, points_ + median, points_ + right,
-                                 PointCmp{dim});
-                right = median;
-                nodes_[node].split = points_[right].v.coords[dim];
-                // process left child
-                node = (node << 1) + 1;
-                ++h;
+    BuildTree<PointTraits>(points_, numPoints_, height_, leafExtentThreshold,
+                           nodes_.data());
+    LOG(INFO) << "built 3d tree";
+}
+
+template <typename I>
+void Tree::buildPresorted(double leafExtentThreshold) {
+    LOG(INFO) << "building 3d tree of height " << height_ << " for " << numPoints_
+              << " points from presorted coordinates";
+    size_t const n = numPoints_;
+    size_t const numThreads = ResolveThreadCount(0);
+    // order[d] lists the points of every node of the current level, each node's
+    // points being contiguous and sorted by coordinate d (ties broken by index)
+    std::array<std::vector<I>, 3> order;
+    std::array<std::vector<I>, 3> next;
+    ParallelFor(3, 3, [&](size_t, size_t begin, size_t end) {
+        for (size_t d = begin; d < end; ++d) {
+            std::vector<std::pair<double, I>> keys(n);
+            for (size_t i = 0; i < n; ++i) {
+                keys[i] = {points_[i].v.coords[d], static_cast<I>(i)};
+            }
+            std::sort(keys.begin(), keys.end());
+            order[d].resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                order[d][i] = keys[i].second;
+            }
+            next[d].resize(n);
+        }
+    });
+    // point order of the finished tree, filled in as leaves are created
+    std::vector<I> final(n);
+    // whether each point of a node being split goes to its left child
+    std::vector<uint8_t> goesLeft(n);
+
+    struct Split {
+        size_t node;
+        size_t left;
+        size_t median;
+        size_t right;
+        size_t dim;
+    };
+    struct Leaf {
+        size_t left;
+        size_t right;
+    };
+    std::vector<Split> splits;
+    std::vector<Leaf> leaves;
+    auto coord = [this](I i, size_t d) { return points_[i].v.coords[d]; };
+    // Partitions [s.left, s.right) of the sorted orders into the same range of
+    // `next`, each side keeping its order. Runs on `threads` threads.
+    auto partition = [&](Split const& s, size_t threads) {
+        size_t const size = s.right - s.left;
+        I const* const byDim = order[s.dim].data() + s.left;
+        ParallelFor(size, threads, [&](size_t, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                goesLeft[byDim[k]] = s.left + k < s.median;
+            }
+        });
+        std::vector<size_t> numLeft(threads + 1, 0);
+        for (size_t d = 0; d < 3; ++d) {
+            I const* const src = order[d].data();
+            I* const dst = next[d].data();
+            if (d == s.dim) {
+                std::copy(src + s.left, src + s.right, dst + s.left);
+                continue;
+            }
+            // count the points going left in each chunk, then scatter
+            if (threads > 1) {
+                ParallelFor(size, threads, [&](size_t t, size_t begin, size_t end) {
+                    size_t count = 0;
+                    for (size_t k = s.left + begin; k < s.left + end; ++k) {
+                        count += goesLeft[src[k]];
+                    }
+                    numLeft[t + 1] = count;
+                });
+                for (size_t t = 0; t < threads; ++t) {
+                    numLeft[t + 1] += numLeft[t];
+                }
+            }
+            ParallelFor(size, threads, [&](size_t t, size_t begin, size_t end) {
+                size_t l = s.left + numLeft[t];
+                size_t r = s.median + begin - numLeft[t];
+                for (size_t k = s.left + begin; k < s.left + end; ++k) {
+                    I const i = src[k];
+                    if (goesLeft[i]) {
+                        dst[l++] = i;
+                    } else {
+                        dst[r++] = i;
+                    }
+                }
+            });
+        }
+    };
+
+    nodes_[0].setRight(n);
+    for (size_t h = 0; h <= height_; ++h) {
+        splits.clear();
+        leaves.clear();
+        size_t const first = (static_cast<size_t>(1) << h) - 1;
+        for (size_t node = first; node < 2 * first + 1; ++node) {
+            if (node != 0 && nodes_[(node - 1) >> 1].isLeaf()) {
+                // below a leaf
+                continue;
+            }
+            size_t const left = node == first ? 0 : nodes_[node - 1].right();
+            size_t const right = nodes_[node].right();
+            if (h == height_) {
+                leaves.push_back(Leaf{left, right});
                 continue;
             }
-            // node extent is below the subdivision limit: set right index for all right
-            // children of node as their left siblings may be valid
-            size_t h2 = h;
-            size_t c = node;
-            do {
-                c = (c << 1) + 2;
-                ++h2;
+            // the extent along each dimension is that of the first and last point
+            double maxExtent = -std::numeric_limits<double>::infinity();
+            size_t maxDim = 0;
+            if (right > left) {
+                for (size_t d = 0; d < 3; ++d) {
+                    double const extent =
+                        coord(order[d][right - 1], d) - coord(order[d][left], d);
+                    if (d == 0 || extent > maxExtent) {
+                        maxExtent = extent;
+                        maxDim = d;
+                    }
+                }
+            }
+            if (maxExtent > leafExtentThreshold) {
+                size_t const median = left + ((right - left) >> 1);
+                nodes_[node].setSplitDim(maxDim);
+                nodes_[node].split = coord(order[maxDim][median], maxDim);
+                nodes_[(node << 1) + 1].setRight(median);
+                nodes_[(node << 1) + 2].setRight(right);
+                splits.push_back(Split{node, left, median, right, maxDim});
+                continue;
+            }
+            // node extent is below the subdivision limit: set right index for all
+            // right children of node as their left siblings may be valid
+            for (size_t c = (node << 1) + 2; c < numNodes_; c = (c << 1) + 2) {
                 nodes_[c].setRight(right);
-            } while (h2 < height_);
+            }
+            leaves.push_back(Leaf{left, right});
         }
-        // move up the tree until a left child is found
-        left = right;
-        for (; h > 0 && (node & 1) == 0; --h) {
-            node = (node - 1) >> 1;
+        ParallelFor(leaves.size(), numThreads, [&](size_t, size_t begin, size_t end) {
+            for (size_t j = begin; j < end; ++j) {
+                Leaf const& leaf = leaves[j];
+                std::copy(order[0].data() + leaf.left, order[0].data() + leaf.right,
+                          final.data() + leaf.left);
+            }
+        });
+        if (splits.size() >= numThreads) {
+            ParallelFor(splits.size(), numThreads,
+                        [&](size_t, size_t begin, size_t end) {
+                            for (size_t j = begin; j < end; ++j) {
+                                partition(splits[j], 1);
+                            }
+                        });
+        } else {
+            for (Split const& split : splits) {
+                partition(split, numThreads);
+            }
+        }
+        std::swap(order, next);
+    }
+    for (size_t d = 0; d < 3; ++d) {
+        order[d] = std::vector<I>{};
+        next[d] = std::vector<I>{};
+    }
+    // Move the points to their final positions by following the cycles of the
+    // permutation: the point at index final[k] moves to index k.
+    for (size_t k = 0; k < n; ++k) {
+        if (final[k] == k) {
+            continue;
         }
-        if (h == 0) {
-            // tree construction complete!
-            break;
+        Point const point = points_[k];
+        size_t j = k;
+        while (final[j] != k) {
+            size_t const src = final[j];
+            points_[j] = points_[src];
+            final[j] = static_cast<I>(j);
+            j = src;
         }
-        // node is now the index of a left child - process its right sibling
-        right = nodes_[(node - 1) >> 1].right();
-        node += 1;
+        points_[j] = point;
+        final[j] = static_cast<I>(j);
     }
     LOG(INFO) << "built 3d tree";
 }
@@ -3,10 +3,16 @@
 #include <sys/types.h>
 
 #include <array>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
-#include <memory>
+#include <utility>
+#include <vector>
 
+#include "Numa.h"
+#include "QueryContext.h"
+#include "Stats.h"
 #include "Vec3.h"
 
 namespace optics {
@@ -33,6 +39,99 @@ struct alignas(16) Node {
     void setRight(size_t index) { metadata = (index << SHIFT) | (metadata & MASK); }
 };
 
+// The positions of the nodes of a 3-d tree in its node array. Nodes are identified by
+// their breadth first index, in which the children of node i are 2i + 1 and 2i + 2.
+//
+// By default, nodes are also stored in breadth first order. The nodes visited by a
+// query below the top few levels of a tall tree are then far apart, and each is
+// likely a cache and TLB miss. The blocked layout instead cuts the tree into
+// subtrees of `blockHeight` levels, each stored contiguously in breadth first order,
+// so that a root to leaf path touches one block per `blockHeight` levels. Blocks of
+// 2^k - 1 nodes are padded to 2^k nodes, so that blocks of height 2 fill a 64-byte
+// cache line and blocks of height 8 a 4 KB page, except in the bottom row of blocks
+// if the number of levels is not a multiple of the block height.
+class NodeLayout {
+   public:
+    NodeLayout() = default;
+
+    // Blocked layout of a tree with the given number of levels, or breadth first
+    // layout if blockHeight is 0.
+    NodeLayout(size_t numLevels, size_t blockHeight);
+
+    size_t blockHeight() const { return blockHeight_; }
+
+    // Returns the number of node slots in the node array.
+    size_t size() const { return size_; }
+
+    // Returns the position of a node in the node array.
+    size_t position(size_t node) const {
+        if (blockHeight_ == 0) {
+            return node;
+        }
+        size_t const depth = std::bit_width(node + 1) - 1;
+        Level const& level = levels_[depth];
+        // index of the node within its level, and of its block within its row
+        size_t const i = node + 1 - (static_cast<size_t>(1) << depth);
+        size_t const t = level.depthInBlock;
+        size_t const mask = (static_cast<size_t>(1) << t) - 1;
+        return level.offset + (i >> t) * level.blockSize + mask + (i & mask);
+    }
+
+   private:
+    static constexpr size_t MAX_LEVELS = sizeof(size_t) * 8;
+
+    // How the nodes at a given depth are stored
+    struct Level {
+        // position of the first block of the row of blocks containing the level
+        size_t offset;
+        // number of node slots per block in that row
+        size_t blockSize;
+        // depth of the level relative to the roots of the blocks
+        size_t depthInBlock;
+    };
+
+    size_t blockHeight_ = 0;
+    size_t size_ = 0;
+    std::array<Level, MAX_LEVELS> levels_{};
+};
+
+// Read-only access to the nodes of a 3-d tree by breadth first index, whatever their
+// layout in memory.
+class NodeView {
+   public:
+    NodeView(Node const* nodes, NodeLayout const& layout)
+        : nodes_{nodes}, layout_{&layout} {}
+
+    Node const& operator[](size_t node) const {
+        return nodes_[layout_->position(node)];
+    }
+
+    Node const* data() const { return nodes_; }
+    NodeLayout const& layout() const { return *layout_; }
+
+   private:
+    Node const* nodes_;
+    NodeLayout const* layout_;
+};
+
+// How a Tree is constructed. Both builders split every node at the median point
+// along its dimension of maximum extent, and produce equivalent trees: only the order
+// of points within a leaf, and the side of a split that points with coordinates
+// equal to the splitting value end up on, may differ.
+enum class TreeBuilder {
+    // Selects the median of each node with std::nth_element, after finding the
+    // extent of the node with a scan of its points. Needs no extra memory.
+    NTH_ELEMENT,
+    // Sorts the points along each dimension once, and then builds the tree level by
+    // level with stable partitions of the sorted orders. The extent and median of
+    // every node are then known without a scan or a selection, and each level is a
+    // few sequential streaming passes that run in parallel. Needs 3 sorted orders,
+    // a copy of them, and a final order: 28 bytes per point for fewer than 2^32
+    // points, and 56 bytes otherwise, plus 16 bytes per point and dimension while
+    // sorting.
+    PRESORTED,
+};
+
 constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
 constexpr size_t UNPROCESSED = static_cast<size_t>(-1);
 constexpr size_t PROCESSED = static_cast<size_t>(-2);
@@ -93,13 +192,23 @@ class Tree {
     // - leafExtentThreshold:  If the maximum extent of a 3-d tree node along each
     //                         dimension is below this number, then no children are
     //                         created for the node.
+    // - builder:              The construction algorithm.
     Tree(Point* points, size_t numPoints, size_t pointsPerLeaf,
-         double leafExtentThreshold);
+         double leafExtentThreshold, TreeBuilder builder = TreeBuilder::NTH_ELEMENT);
 
     size_t size() const { return numPoints_; }
     size_t height() const { return height_; }
     Point const* getPoints() const { return points_; }
 
+    // Returns range query counters accumulated since construction or the last call to
+    // resetStats(). Always zero unless compiled with OPTICS_ENABLE_STATS.
+    QueryStats const& stats() const { return stats_; }
+    void resetStats() { stats_ = QueryStats{}; }
+
+    // Returns the wall clock time taken to build the tree in seconds. Always zero
+    // unless compiled with OPTICS_ENABLE_STATS.
+    double buildSeconds() const { return buildSeconds_; }
+
     // Locates all points in the 3-d tree within squared euclidian distance `dist` of
     // the input query point `v`.
     //
@@ -108,13 +217,147 @@ class Tree {
     // embedded in the point array. If no points are in range, NOT_FOUND is returned.
     size_t inRange(Vec3 const& v, double dist);
 
+    // Enables or disables mixed precision range queries. When enabled, a single
+    // precision copy of the point coordinates (12 bytes per point) is made, and
+    // inRange(v, dist) first compares single precision squared distances against a
+    // threshold widened by a bound on their rounding error. Only points passing this
+    // filter have their distance computed in double precision, so results, including
+    // distances and their order, are identical to those of double precision queries,
+    // while most rejected points cost a third of the memory traffic. The copy must be
+    // refreshed (by enabling mixed precision again) if point coordinates change.
+    void setMixedPrecision(bool enabled);
+    bool mixedPrecision() const { return coords_.size() != 0; }
+
+    // As inRange(v, dist), but answers the query from the leaves cached in `context`
+    // by an earlier query when possible (see QueryContext). Counters are accumulated
+    // in the context rather than in this tree.
+    size_t inRange(Vec3 const& v, double dist, QueryContext& context);
+
+    // Calls fn(i, d) for every point i within squared euclidian distance d <= `dist`
+    // of the query point `v`. Unlike inRange(), this does not modify the points, so
+    // any number of threads may call it concurrently.
+    template <typename F>
+    void visitRange(Vec3 const& v, double dist, F&& fn) const;
+
+    // Rearranges the nodes of the tree in subtrees of `blockHeight` levels (see
+    // NodeLayout), or in breadth first order if blockHeight is 0, which is the
+    // default. Blocks of 2 to 4 levels make queries on tall trees touch fewer cache
+    // lines. Results are unaffected.
+    void setNodeLayout(size_t blockHeight);
+    NodeLayout const& nodeLayout() const { return layout_; }
+
+    // Returns the nodes of the tree, indexed by breadth first index, and their number.
+    NodeView nodes() const { return NodeView{nodes_.data(), layout_}; }
+    size_t numNodes() const { return numNodes_; }
+
+    // Partitions the point array into spatially compact, contiguous ranges: the
+    // ranges of the highest nodes for which accept(begin, end) returns true, and of
+    // the leaves below nodes that are not accepted. Returns the index following the
+    // last point of each non-empty range, in point order: range i spans
+    // [ends[i - 1], ends[i]), where ends[-1] is 0.
+    template <typename F>
+    std::vector<size_t> partition(F&& accept) const;
+
+    // Returns the partition of the point array into leaves.
+    std::vector<size_t> leafEnds() const {
+        return partition([](size_t, size_t) { return false; });
+    }
+
    private:
     Point* points_;  // unowned
     size_t numPoints_;
     size_t height_;
-    std::unique_ptr<Node[]> nodes_;
+    size_t numNodes_;
+    NumaArray<Node> nodes_;
+    NodeLayout layout_;
+    // single precision x, y and z coordinates of the points, one array after the
+    // other, if mixed precision queries are enabled
+    NumaArray<float> coords_;
+    QueryStats stats_;
+    double buildSeconds_ = 0.0;
 
     void build(double leafExtentThreshold);
+    template <typename I>
+    void buildPresorted(double leafExtentThreshold);
+    void cacheLeaves(Vec3 const& v, double radius, QueryContext& context,
+                     QueryStats& stats) const;
 };
 
+// Calls fn(i, d) for every point i within squared euclidian distance d <= `dist` of
+// the query point `v`, in a tree with the given node array. The coordinates of the
+// i-th point are position(i), which allows querying Point arrays, copies of their
+// coordinates, and points in other layouts (see BasicTree).
+template <typename Position, typename F>
+void VisitRange(NodeView nodes, Position&& position, Vec3 const& v, double dist,
+                F&& fn) {
+    std::array<bool, Tree::MAX_HEIGHT> descend;
+    size_t node = 0;
+    size_t h = 0;
+    while (true) {
+        if (nodes[node].isLeaf()) {
+            size_t const left = (node & (node + 1)) != 0 ? nodes[node - 1].right() : 0;
+            size_t const right = nodes[node].right();
+            for (size_t i = left; i < right; ++i) {
+                double const d = SquaredEuclidianDistance(v, position(i));
+                if (d <= dist) {
+                    fn(i, d);
+                }
+            }
+            // move back up the tree
+            if (node == 0) {
+                break;
+            }
+            node = (node - 1) >> 1;
+            --h;
+            for (; h != static_cast<size_t>(-1) && !descend[h]; --h) {
+                node = (node - 1) >> 1;
+            }
+            if (h == static_cast<size_t>(-1)) {
+                break;
+            }
+            descend[h] = false;
+            node = (node << 1) + 2;
+            ++h;
+        } else {
+            double const split = nodes[node].split;
+            double const vd = v.coords[nodes[node].splitDim()];
+            descend[h] = MinSquaredEuclidianDistance(vd, split) <= dist;
+            node = (node << 1) + (descend[h] || vd < split ? 1 : 2);
+            ++h;
+        }
+    }
+}
+
+template <typename F>
+void Tree::visitRange(Vec3 const& v, double dist, F&& fn) const {
+    Point const* const points = points_;
+    VisitRange(
+        nodes(), [points](size_t i) -> Vec3 const& { return points[i].v; }, v, dist,
+        std::forward<F>(fn));
+}
+
+template <typename F>
+std::vector<size_t> Tree::partition(F&& accept) const {
+    NodeView const nodes = this->nodes();
+    std::vector<size_t> ends;
+    // visit nodes in point order via a depth first traversal
+    std::vector<size_t> stack = {0};
+    while (!stack.empty()) {
+        size_t const node = stack.back();
+        stack.pop_back();
+        size_t const left = (node & (node + 1)) != 0 ? nodes[node - 1].right() : 0;
+        size_t const right = nodes[node].right();
+        if (right == left) {
+            continue;
+        }
+        if (nodes[node].isLeaf() || accept(left, right)) {
+            ends.push_back(right);
+        } else {
+            stack.push_back((node << 1) + 2);
+            stack.push_back((node << 1) + 1);
+        }
+    }
+    return ends;
+}
+
 }  // namespace optics
@@ -0,0 +1,720 @@
+#include <absl/cleanup/cleanup.h>
+#include <benchmark/benchmark.h>
+#include <fmt/core.h>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "BasicTree.h"
+#include "BubbleOptics.h"
+#include "ClusterPublisher.h"
+#include "CrossMatch.h"
+#include "DynamicTree.h"
+#include "LonLat.h"
+#include "Numa.h"
+#include "Optics.h"
+#include "PixelIndex.h"
+#include "QueryContext.h"
+#include "RecordArena.h"
+#include "SkyGenerator.h"
+#include "Tree.h"
+#include "TreeReplicas.h"
+#include "Vec3.h"
+
+namespace optics {
+namespace {
+
+constexpr size_t NUM_POINTS = static_cast<size_t>(1) << 22;
+constexpr size_t NUM_QUERIES = static_cast<size_t>(1) << 14;
+// expected number of points in range of each query
+constexpr double NEIGHBORS = 16.0;
+
+// Where the data queried by the benchmark threads lives
+enum class Layout {
+    // points touched by a single thread, as when loaded by a single-threaded reader
+    SINGLE_NODE,
+    // points interleaved across NUMA nodes
+    INTERLEAVED,
+    // coordinates and nodes replicated on each NUMA node
+    REPLICATED,
+};
+
+char const* LayoutName(Layout layout) {
+    switch (layout) {
+        case Layout::SINGLE_NODE:
+            return "single_node";
+        case Layout::INTERLEAVED:
+            return "interleaved";
+        case Layout::REPLICATED:
+            return "replicated";
+    }
+    return "";
+}
+
+// Uniformly distributed points on the unit sphere, indexed by a 3-d tree
+struct Dataset {
+    NumaArray<Point> points;
+    Tree tree;
+    std::unique_ptr<TreeReplicas> replicas;
+
+    Dataset(MemoryPlacement placement, size_t numThreads, bool replicate)
+        : points{MakePoints(placement, numThreads)},
+          tree{points.data(), points.size(), 16, 0.0} {
+        if (replicate) {
+            replicas = std::make_unique<TreeReplicas>(tree);
+        }
+    }
+
+    static NumaArray<Point> MakePoints(MemoryPlacement placement, size_t numThreads) {
+        NumaArray<Point> points{NUM_POINTS, placement, numThreads};
+        std::mt19937_64 rng(1234);
+        for (size_t i = 0; i < points.size(); ++i) {
+            points[i].v = LonLat::random(rng);
+        }
+        return points;
+    }
+};
+
+Dataset& GetDataset(Layout layout) {
+    switch (layout) {
+        case Layout::SINGLE_NODE: {
+            static Dataset dataset{MemoryPlacement::FIRST_TOUCH, 1, false};
+            return dataset;
+        }
+        case Layout::INTERLEAVED: {
+            static Dataset dataset{MemoryPlacement::INTERLEAVE, 0, false};
+            return dataset;
+        }
+        case Layout::REPLICATED:
+            break;
+    }
+    static Dataset dataset{MemoryPlacement::FIRST_TOUCH, 1, true};
+    return dataset;
+}
+
+// Measures the range query throughput of threads pinned to a single NUMA node.
+void BM_RangeQuery(benchmark::State& state, Layout layout, int node) {
+    Dataset const& dataset = GetDataset(layout);
+    // Thread 0 is the main thread, which runs every other benchmark: restore its
+    // affinity afterwards.
+    cpu_set_t affinity;
+    CPU_ZERO(&affinity);
+    ::sched_getaffinity(0, sizeof(affinity), &affinity);
+    absl::Cleanup const restore = [&affinity] {
+        ::sched_setaffinity(0, sizeof(affinity), &affinity);
+    };
+    if (!PinThreadToNumaNode(node)) {
+        state.SkipWithError("failed to pin thread to NUMA node");
+        return;
+    }
+    // points within a circle expected to contain NEIGHBORS points
+    double const radius = std::sqrt(4.0 * NEIGHBORS / NUM_POINTS);
+    double const dist = radius * radius;
+    // queries are generated by, and so local to, each thread
+    std::mt19937_64 rng(state.thread_index());
+    std::vector<Vec3> queries(NUM_QUERIES);
+    for (Vec3& q : queries) {
+        q = LonLat::random(rng);
+    }
+    size_t const replica =
+        dataset.replicas ? dataset.replicas->replicaFor(node) : 0;
+    size_t found = 0;
+    size_t q = 0;
+    auto count = [&found](size_t, double) { ++found; };
+    for (auto _ : state) {
+        Vec3 const& v = queries[q];
+        q = (q + 1) & (NUM_QUERIES - 1);
+        if (dataset.replicas) {
+            dataset.replicas->visitRange(replica, v, dist, count);
+        } else {
+            dataset.tree.visitRange(v, dist, count);
+        }
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["neighbors"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+
+// Measures the latency of range queries centered on consecutive points of the tree
+// ordered point array, which are close to each other like the consecutive queries
+// of an OPTICS cluster expansion. With a QueryContext, most queries are answered from
+// the leaves cached by an earlier query.
+void BM_ConsecutiveQuery(benchmark::State& state, bool useContext) {
+    Dataset& dataset = GetDataset(Layout::SINGLE_NODE);
+    double const radius = std::sqrt(4.0 * state.range(0) / NUM_POINTS);
+    double const dist = radius * radius;
+    QueryContext context;
+    Point* points = dataset.points.data();
+    size_t i = 0;
+    size_t found = 0;
+    for (auto _ : state) {
+        size_t j = useContext ? dataset.tree.inRange(points[i].v, dist, context)
+                              : dataset.tree.inRange(points[i].v, dist);
+        for (; j != NOT_FOUND; j = points[j].next) {
+            ++found;
+        }
+        i = (i + 1) & (NUM_POINTS - 1);
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["neighbors"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_CAPTURE(BM_ConsecutiveQuery, fresh, false)->Arg(16)->Arg(256);
+BENCHMARK_CAPTURE(BM_ConsecutiveQuery, context, true)->Arg(16)->Arg(256);
+
+// Measures the latency of range queries centered on random points, with double or
+// mixed precision distance computations in leaves.
+void BM_Precision(benchmark::State& state, bool mixed) {
+    Dataset& dataset = GetDataset(Layout::SINGLE_NODE);
+    double const radius = std::sqrt(4.0 * state.range(0) / NUM_POINTS);
+    double const dist = radius * radius;
+    std::mt19937_64 rng(5678);
+    std::vector<Vec3> queries(NUM_QUERIES);
+    for (Vec3& q : queries) {
+        q = LonLat::random(rng);
+    }
+    dataset.tree.setMixedPrecision(mixed);
+    Point* points = dataset.points.data();
+    size_t found = 0;
+    size_t q = 0;
+    for (auto _ : state) {
+        for (size_t j = dataset.tree.inRange(queries[q], dist); j != NOT_FOUND;
+             j = points[j].next) {
+            ++found;
+        }
+        q = (q + 1) & (NUM_QUERIES - 1);
+    }
+    dataset.tree.setMixedPrecision(false);
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["neighbors"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_CAPTURE(BM_Precision, double, false)->Arg(16)->Arg(256);
+BENCHMARK_CAPTURE(BM_Precision, mixed, true)->Arg(16)->Arg(256);
+
+struct CountingSink : MatchSink {
+    size_t count = 0;
+
+    void match(std::span<Match const> matches) override { count += matches.size(); }
+};
+
+// Measures the time taken to cross-match a second catalogue of uniformly distributed
+// points against the dataset, with NEIGHBORS expected matches per point: either one
+// range query per point on a single thread, or with a parallel dual-tree join.
+void BM_CrossMatch(benchmark::State& state, bool dualTree) {
+    constexpr size_t NUM_MATCHED = static_cast<size_t>(1) << 20;
+    Dataset& dataset = GetDataset(Layout::INTERLEAVED);
+    static std::vector<Point> points = [] {
+        std::vector<Point> points(NUM_MATCHED);
+        std::mt19937_64 rng(5678);
+        for (Point& p : points) {
+            p.v = LonLat::random(rng);
+        }
+        return points;
+    }();
+    static Tree const tree{points.data(), points.size(), 16, 0.0};
+    double const radius = std::sqrt(4.0 * NEIGHBORS / NUM_POINTS);
+    double const dist = radius * radius;
+    size_t found = 0;
+    for (auto _ : state) {
+        if (dualTree) {
+            CountingSink sink;
+            CrossMatch(dataset.tree, tree, dist, sink);
+            found += sink.count;
+        } else {
+            CountingSink sink;
+            std::vector<Match> batch;
+            for (Point const& q : points) {
+                dataset.tree.visitRange(q.v, dist, [&](size_t i, double d) {
+                    batch.push_back(Match{dataset.points[i].record, q.record, d});
+                });
+                if (batch.size() >= 4096) {
+                    sink.match(batch);
+                    batch.clear();
+                }
+            }
+            sink.match(batch);
+            found += sink.count;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * NUM_MATCHED);
+    state.counters["matches"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_CAPTURE(BM_CrossMatch, per_row, false)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_CrossMatch, dual_tree, true)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Counts data TLB load misses of the calling thread in user space, if the kernel
+// allows it.
+class TlbMissCounter {
+   public:
+    TlbMissCounter() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    TlbMissCounter(TlbMissCounter const&) = delete;
+    TlbMissCounter& operator=(TlbMissCounter const&) = delete;
+
+    ~TlbMissCounter() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    bool valid() const { return fd_ >= 0; }
+
+    uint64_t read() const {
+        uint64_t value = 0;
+        if (fd_ < 0 || ::read(fd_, &value, sizeof(value)) != sizeof(value)) {
+            return 0;
+        }
+        return value;
+    }
+
+   private:
+    int fd_;
+};
+
+// Measures the latency and data TLB misses of random range queries when points and
+// tree nodes are backed by regular pages, transparent huge pages, or reserved huge
+// pages. Only one dataset is kept at a time, so benchmarks with the same mode should
+// run consecutively.
+void BM_HugePages(benchmark::State& state, HugePages mode) {
+    static std::unique_ptr<Dataset> dataset;
+    static HugePages datasetMode;
+    if (!dataset || datasetMode != mode) {
+        dataset.reset();
+        HugePages const previous = GetHugePages();
+        SetHugePages(mode);
+        dataset = std::make_unique<Dataset>(MemoryPlacement::FIRST_TOUCH, 1, false);
+        SetHugePages(previous);
+        datasetMode = mode;
+    }
+    double const radius = std::sqrt(4.0 * NEIGHBORS / NUM_POINTS);
+    double const dist = radius * radius;
+    std::mt19937_64 rng(5678);
+    std::vector<Vec3> queries(NUM_QUERIES);
+    for (Vec3& q : queries) {
+        q = LonLat::random(rng);
+    }
+    Point* points = dataset->points.data();
+    TlbMissCounter counter;
+    uint64_t const misses = counter.read();
+    size_t found = 0;
+    size_t q = 0;
+    for (auto _ : state) {
+        for (size_t j = dataset->tree.inRange(queries[q], dist); j != NOT_FOUND;
+             j = points[j].next) {
+            ++found;
+        }
+        q = (q + 1) & (NUM_QUERIES - 1);
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["neighbors"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+    if (counter.valid()) {
+        state.counters["dtlb_misses"] =
+            benchmark::Counter(static_cast<double>(counter.read() - misses),
+                               benchmark::Counter::kAvgIterations);
+    }
+}
+
+BENCHMARK_CAPTURE(BM_HugePages, none, HugePages::NONE);
+BENCHMARK_CAPTURE(BM_HugePages, transparent, HugePages::TRANSPARENT);
+BENCHMARK_CAPTURE(BM_HugePages, explicit, HugePages::EXPLICIT);
+
+// Returns NUM_POINTS points, either uniformly distributed, or in 1024 clumps with a
+// dispersion of 0.25 degrees, which are about 100 times denser than uniform points.
+std::vector<Point> MakeSky(bool clustered) {
+    std::vector<Point> points(NUM_POINTS);
+    std::mt19937_64 rng(1234);
+    LonLat center;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (!clustered) {
+            points[i].v = LonLat::random(rng);
+            continue;
+        }
+        if (i % (NUM_POINTS / 1024) == 0) {
+            center = LonLat::random(rng);
+        }
+        points[i].v = center.perturb(rng, 0.25);
+    }
+    return points;
+}
+
+// Points indexed by a 3-d tree or a pixel index
+template <typename Index>
+struct IndexedSky {
+    std::vector<Point> points;
+    Index index;
+
+    explicit IndexedSky(bool clustered)
+        : points{MakeSky(clustered)}, index{points.data(), points.size(), 16, 0.0} {}
+};
+
+template <typename Index>
+IndexedSky<Index>& GetIndexedSky(bool clustered) {
+    if (clustered) {
+        static IndexedSky<Index> sky{true};
+        return sky;
+    }
+    static IndexedSky<Index> sky{false};
+    return sky;
+}
+
+// Measures the latency of range queries centered on randomly chosen points, with a
+// radius chosen to find about NEIGHBORS points in uniform data, or in the clumps of
+// clustered data.
+template <typename Index>
+void BM_IndexQuery(benchmark::State& state, bool clustered) {
+    IndexedSky<Index>& sky = GetIndexedSky<Index>(clustered);
+    double const radius =
+        std::sqrt(4.0 * NEIGHBORS / NUM_POINTS) / (clustered ? 10.0 : 1.0);
+    double const dist = radius * radius;
+    std::mt19937_64 rng(5678);
+    std::uniform_int_distribution<size_t> pick{0, NUM_POINTS - 1};
+    std::vector<Vec3> queries(NUM_QUERIES);
+    for (Vec3& q : queries) {
+        q = sky.points[pick(rng)].v;
+    }
+    Point const* points = sky.points.data();
+    size_t found = 0;
+    size_t q = 0;
+    for (auto _ : state) {
+        for (size_t j = sky.index.inRange(queries[q], dist); j != NOT_FOUND;
+             j = points[j].next) {
+            ++found;
+        }
+        q = (q + 1) & (NUM_QUERIES - 1);
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["neighbors"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+
+void BM_TreeQuery(benchmark::State& state, bool clustered) {
+    BM_IndexQuery<Tree>(state, clustered);
+}
+
+void BM_PixelIndexQuery(benchmark::State& state, bool clustered) {
+    BM_IndexQuery<PixelIndex>(state, clustered);
+}
+
+BENCHMARK_CAPTURE(BM_TreeQuery, uniform, false);
+BENCHMARK_CAPTURE(BM_PixelIndexQuery, uniform, false);
+BENCHMARK_CAPTURE(BM_TreeQuery, clustered, true);
+BENCHMARK_CAPTURE(BM_PixelIndexQuery, clustered, true);
+
+// Measures the time taken to read the records of every point in tree order, as
+// cluster publication does, when records are scattered across the input CSV or have
+// been compacted in tree order.
+void BM_RecordGather(benchmark::State& state, bool compact) {
+    constexpr size_t RECORD_SIZE = 96;
+    static std::string input = [] {
+        std::string input(NUM_POINTS * RECORD_SIZE, 'x');
+        for (size_t i = 0; i < NUM_POINTS; ++i) {
+            input[(i + 1) * RECORD_SIZE - 1] = '\n';
+        }
+        return input;
+    }();
+    static std::vector<Point> points = [] {
+        std::vector<Point> points = MakeSky(false);
+        for (size_t i = 0; i < NUM_POINTS; ++i) {
+            points[i].record = input.data() + i * RECORD_SIZE;
+        }
+        Tree{points.data(), points.size(), 16, 0.0};
+        return points;
+    }();
+    std::vector<char const*> records(NUM_POINTS);
+    for (size_t i = 0; i < NUM_POINTS; ++i) {
+        records[i] = points[i].record;
+    }
+    RecordArena arena;
+    if (compact) {
+        arena = RecordArena{records, input};
+    }
+    size_t sum = 0;
+    for (auto _ : state) {
+        for (char const* record : records) {
+            for (size_t b = 0; b < RECORD_SIZE; b += 32) {
+                sum += static_cast<unsigned char>(record[b]);
+            }
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(state.iterations() * NUM_POINTS);
+}
+
+BENCHMARK_CAPTURE(BM_RecordGather, scattered, false)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_RecordGather, compacted, true)->Unit(benchmark::kMillisecond);
+
+// Measures the latency of random range queries for trees of different heights
+// (obtained by varying the number of points per leaf, range(0)) and node layouts
+// (range(1) is the block height, 0 for breadth first order). Only one tree is kept
+// at a time, so benchmarks with the same number of points per leaf should run
+// consecutively.
+void BM_NodeLayout(benchmark::State& state) {
+    static std::vector<Point> points = MakeSky(false);
+    static std::unique_ptr<Tree> tree;
+    static size_t treePointsPerLeaf = 0;
+    size_t const pointsPerLeaf = state.range(0);
+    if (treePointsPerLeaf != pointsPerLeaf) {
+        tree.reset();
+        tree = std::make_unique<Tree>(points.data(), points.size(), pointsPerLeaf, 0.0);
+        treePointsPerLeaf = pointsPerLeaf;
+    }
+    tree->setNodeLayout(state.range(1));
+    double const radius = std::sqrt(4.0 * NEIGHBORS / NUM_POINTS);
+    double const dist = radius * radius;
+    std::mt19937_64 rng(5678);
+    std::vector<Vec3> queries(NUM_QUERIES);
+    for (Vec3& q : queries) {
+        q = LonLat::random(rng);
+    }
+    size_t found = 0;
+    size_t q = 0;
+    for (auto _ : state) {
+        for (size_t j = tree->inRange(queries[q], dist); j != NOT_FOUND;
+             j = points[j].next) {
+            ++found;
+        }
+        q = (q + 1) & (NUM_QUERIES - 1);
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["height"] = static_cast<double>(tree->height());
+    state.counters["neighbors"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_NodeLayout)
+    ->ArgNames({"leaf", "block"})
+    ->ArgsProduct({{64, 16, 4, 1}, {0, 2, 3, 4, 8}});
+
+// Measures the time taken to build a tree over NUM_POINTS uniformly distributed
+// points with each builder.
+void BM_TreeBuild(benchmark::State& state, TreeBuilder builder) {
+    static std::vector<Point> const sky = MakeSky(false);
+    std::vector<Point> points(sky.size());
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::copy(sky.begin(), sky.end(), points.begin());
+        state.ResumeTiming();
+        Tree const tree{points.data(), points.size(), 16, 0.0, builder};
+        benchmark::DoNotOptimize(tree.nodes().data());
+    }
+    state.SetItemsProcessed(state.iterations() * NUM_POINTS);
+}
+
+BENCHMARK_CAPTURE(BM_TreeBuild, nth_element, TreeBuilder::NTH_ELEMENT)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_TreeBuild, presorted, TreeBuilder::PRESORTED)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Measures the time taken to build a tree in place over the same points stored as
+// coordinate columns, with a 4-byte payload column, and the latency of range queries
+// over them (compare with BM_TreeBuild and BM_TreeQuery).
+void BM_ColumnarTree(benchmark::State& state, bool build) {
+    static std::vector<Point> const sky = MakeSky(false);
+    size_t const n = sky.size();
+    std::vector<double> x(n);
+    std::vector<double> y(n);
+    std::vector<double> z(n);
+    std::vector<uint32_t> rows(n);
+    std::vector<double> dist(n);
+    std::vector<size_t> next(n);
+    auto reset = [&] {
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = sky[i].v.x();
+            y[i] = sky[i].v.y();
+            z[i] = sky[i].v.z();
+            rows[i] = static_cast<uint32_t>(i);
+        }
+    };
+    ColumnarPoints columns;
+    columns.coords = {x.data(), y.data(), z.data()};
+    columns.dist = dist.data();
+    columns.next = next.data();
+    columns.payload.push_back({rows.data(), sizeof(uint32_t)});
+    if (build) {
+        for (auto _ : state) {
+            state.PauseTiming();
+            reset();
+            state.ResumeTiming();
+            BasicTree<ColumnarTraits> const tree{columns, n, 16, 0.0};
+            benchmark::DoNotOptimize(tree.nodes().data());
+        }
+        state.SetItemsProcessed(state.iterations() * NUM_POINTS);
+        return;
+    }
+    reset();
+    BasicTree<ColumnarTraits> tree{columns, n, 16, 0.0};
+    double const radius = std::sqrt(4.0 * NEIGHBORS / NUM_POINTS);
+    std::mt19937_64 rng(5678);
+    std::uniform_int_distribution<size_t> pick{0, NUM_POINTS - 1};
+    std::vector<Vec3> queries(NUM_QUERIES);
+    for (Vec3& q : queries) {
+        q = sky[pick(rng)].v;
+    }
+    size_t found = 0;
+    size_t q = 0;
+    for (auto _ : state) {
+        for (size_t j = tree.inRange(queries[q], radius * radius); j != NOT_FOUND;
+             j = next[j]) {
+            ++found;
+        }
+        q = (q + 1) & (NUM_QUERIES - 1);
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetItemsProcessed(state.iterations());
+    state.counters["neighbors"] = benchmark::Counter(
+        static_cast<double>(found), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_CAPTURE(BM_ColumnarTree, build, true)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_ColumnarTree, query, false);
+
+// Measures the cost of inserting points into a dynamic tree over NUM_POINTS uniformly
+// distributed points, to compare with the cost of rebuilding a Tree (BM_TreeBuild).
+// Insertions follow the distribution of alert streams: new detections gather around
+// a few hundred positions at a time.
+void BM_DynamicInsert(benchmark::State& state) {
+    static std::vector<Point> const sky = MakeSky(false);
+    // Every invocation inserts into a fresh tree, so that the insertions measured do
+    // not depend on those of earlier invocations.
+    DynamicTree tree{sky, 16, 0.0};
+    std::mt19937_64 rng(1234);
+    LonLat center;
+    size_t inserted = 0;
+    size_t const rebuiltPoints = tree.rebuiltPoints();
+    for (auto _ : state) {
+        if (inserted % 256 == 0) {
+            center = LonLat::random(rng);
+        }
+        Point p;
+        p.v = center.perturb(rng, 0.01);
+        benchmark::DoNotOptimize(tree.insert(p));
+        ++inserted;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["rebuilt_per_insert"] =
+        static_cast<double>(tree.rebuiltPoints() - rebuiltPoints) / inserted;
+}
+
+BENCHMARK(BM_DynamicInsert);
+
+// Counts published clusters
+struct CountingPublisher : ClusterPublisher {
+    size_t numClusters = 0;
+
+    void publish(std::vector<char const*> const&) override { ++numClusters; }
+};
+
+// Measures the time taken to cluster a synthetic catalogue of 100k points in 1000
+// compact clusters exactly, and approximately with data bubbles of up to 256 points.
+void BM_Clustering(benchmark::State& state, bool bubbles) {
+    constexpr size_t numPoints = 100000;
+    constexpr size_t minNeighbors = 5;
+    double const epsilon = SquaredEuclidianDistance(3.0 / 3600.0);
+    static std::vector<Point> const catalog = [] {
+        SkyGeneratorConfig config;
+        config.seed = 11;
+        config.numPoints = numPoints;
+        config.numClusters = 1000;
+        config.noiseFraction = 0.01;
+        config.minClusterSigma = 1.0 / 3600.0;
+        config.maxClusterSigma = 2.0 / 3600.0;
+        std::vector<Point> points(numPoints);
+        std::vector<SyntheticSource> const sources = SkyGenerator{config}.generate();
+        for (size_t i = 0; i < numPoints; ++i) {
+            points[i].v = sources[i].p;
+        }
+        return points;
+    }();
+    std::vector<Point> points(numPoints);
+    CountingPublisher publisher;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::copy(catalog.begin(), catalog.end(), points.begin());
+        state.ResumeTiming();
+        if (bubbles) {
+            BubbleOptics{points.data(), numPoints, minNeighbors, epsilon, 0.0, 16, 256}
+                .run(publisher);
+        } else {
+            Optics{points.data(), numPoints, minNeighbors, epsilon, 0.0, 16}.run(
+                publisher);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * numPoints);
+    state.counters["clusters"] = benchmark::Counter(
+        static_cast<double>(publisher.numClusters), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_CAPTURE(BM_Clustering, exact, false)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Clustering, bubbles, true)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace optics
+
+// Registers one benchmark per data layout and NUMA node, each running one thread per
+// CPU of the node, so that items_per_second is the query throughput of a socket.
+int main(int argc, char** argv) {
+    using namespace optics;
+
+    for (Layout layout :
+         {Layout::SINGLE_NODE, Layout::INTERLEAVED, Layout::REPLICATED}) {
+        for (int node : NumaNodes()) {
+            int const numThreads = static_cast<int>(NumaNodeCpus(node).size());
+            std::string const name =
+                fmt::format("RangeQuery/{}/node:{}", LayoutName(layout), node);
+            benchmark::RegisterBenchmark(name.c_str(), BM_RangeQuery, layout, node)
+                ->Threads(numThreads)
+                ->UseRealTime();
+        }
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "TreeReplicas.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "Parallel.h"
+
+namespace optics {
+
+TreeReplicas::TreeReplicas(Tree const& tree, std::vector<int> nodes)
+    : layout_{tree.nodeLayout()} {
+    if (nodes.empty()) {
+        nodes = NumaNodes();
+    }
+    LOG(INFO) << "replicating 3d tree over " << tree.size() << " points on "
+              << nodes.size() << " NUMA nodes";
+    replicas_.resize(nodes.size());
+    // Each replica is copied by a thread pinned to its node, so that pages are placed
+    // on that node even where the memory policy cannot be set.
+    // Exceptions, such as failures to map memory, are rethrown once all threads have
+    // been joined.
+    FirstException error;
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(nodes.size());
+        for (size_t r = 0; r < nodes.size(); ++r) {
+            threads.emplace_back([this, &tree, &error, r, node = nodes[r]] {
+                error.run([&] {
+                    if (!PinThreadToNumaNode(node)) {
+                        LOG(WARNING) << "failed to pin thread to NUMA node " << node;
+                    }
+                    Replica& replica = replicas_[r];
+                    replica.node = node;
+                    replica.nodes = NumaArray<Node>{
+                        layout_.size(), node, [&tree](Node* data, size_t n) {
+                            std::copy(tree.nodes().data(), tree.nodes().data() + n,
+                                      data);
+                        }};
+                    replica.coords = NumaArray<Coords>{
+                        tree.size(), node, [&tree](Coords* data, size_t n) {
+                            Point const* points = tree.getPoints();
+                            for (size_t i = 0; i < n; ++i) {
+                                data[i].v = points[i].v;
+                            }
+                        }};
+                });
+            });
+        }
+    }
+    error.rethrow();
+}
+
+size_t TreeReplicas::replicaFor(int node) const {
+    for (size_t r = 0; r < replicas_.size(); ++r) {
+        if (replicas_[r].node == node) {
+            return r;
+        }
+    }
+    return 0;
+}
+
+}  // namespace optics
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Numa.h"
+#include "Tree.h"
+#include "Vec3.h"
+
+namespace optics {
+
+// Read-only copies of a 3-d tree, one per NUMA node, for parallel query workloads.
+// Each copy holds the tree nodes and the (tree ordered) coordinates of the points,
+// in memory local to its node. Threads pinned to a node (see PinThreadToNumaNode())
+// can then query the local copy without paying for remote memory accesses. Copying
+// only the coordinates needs 24 rather than 64 bytes per point.
+//
+// The replicas are snapshots: they must be rebuilt if the tree or the coordinates of
+// its points change. Results are reported as indexes into the tree ordered point
+// array, which are valid for every replica.
+class TreeReplicas {
+   public:
+    // Creates a replica of the tree on each online NUMA node, or only on the given
+    // nodes if `nodes` is not empty. Throws if the memory for a replica cannot be
+    // mapped.
+    explicit TreeReplicas(Tree const& tree, std::vector<int> nodes = {});
+
+    size_t size() const { return replicas_.size(); }
+
+    // Returns the NUMA node of the r-th replica.
+    int node(size_t r) const { return replicas_[r].node; }
+
+    // Returns the index of the replica on the given NUMA node, or 0 if there is none.
+    size_t replicaFor(int node) const;
+
+    // Calls fn(i, d) for every point i within squared euclidian distance d <= `dist`
+    // of the query point `v`, using the r-th replica. Thread-safe.
+    template <typename F>
+    void visitRange(size_t r, Vec3 const& v, double dist, F&& fn) const {
+        Replica const& replica = replicas_[r];
+        Coords const* const coords = replica.coords.data();
+        VisitRange(
+            NodeView{replica.nodes.data(), layout_},
+            [coords](size_t i) -> Vec3 const& { return coords[i].v; }, v, dist,
+            std::forward<F>(fn));
+    }
+
+   private:
+    struct Coords {
+        Vec3 v;
+    };
+
+    struct Replica {
+        int node;
+        NumaArray<Node> nodes;
+        NumaArray<Coords> coords;
+    };
+
+    // layout of the nodes of the tree, and of every replica
+    NodeLayout layout_;
+    std::vector<Replica> replicas_;
+};
+
+}  // namespace optics
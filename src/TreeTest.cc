@@ -4,11 +4,17 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <random>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
+#include "BasicTree.h"
+#include "LonLat.h"
+#include "QueryContext.h"
 #include "Tree.h"
+#include "TreeReplicas.h"
 #include "Vec3.h"
 
 namespace optics {
@@ -95,5 +101,376 @@ TEST(TreeTest, InRange) {
     }
 }
 
+TEST(TreeTest, VisitRange) {
+    std::vector<Point> points;
+    std::vector<MatchOracle> queries;
+
+    double const distance = SquaredEuclidianDistance(TestRadius);
+    MakeTestPoints(points, queries);
+    Tree tree{points.data(), points.size(), 32, 0.0};
+    TreeReplicas replicas{tree};
+    ASSERT_GE(replicas.size(), 1);
+    std::vector<size_t> matches;
+    for (auto const& oracle : queries) {
+        matches.clear();
+        tree.visitRange(oracle.query, distance, [&](size_t i, double d) {
+            EXPECT_EQ(d, SquaredEuclidianDistance(oracle.query, points[i].v));
+            matches.push_back(points[i].state);
+        });
+        EXPECT_THAT(matches,
+                    testing::UnorderedElementsAreArray(oracle.expectedMatches));
+        for (size_t r = 0; r < replicas.size(); ++r) {
+            matches.clear();
+            replicas.visitRange(r, oracle.query, distance, [&](size_t i, double) {
+                matches.push_back(points[i].state);
+            });
+            EXPECT_THAT(matches,
+                        testing::UnorderedElementsAreArray(oracle.expectedMatches));
+        }
+    }
+}
+
+// Checks that queries answered from a QueryContext return the same points, distances
+// and order as fresh queries, both when the cached leaves are reused and when not
+TEST(TreeTest, QueryContext) {
+    std::vector<Point> points;
+    std::vector<MatchOracle> queries;
+
+    double const distance = SquaredEuclidianDistance(TestRadius);
+    MakeTestPoints(points, queries);
+    Tree tree{points.data(), points.size(), 32, 0.0};
+    QueryContext context;
+    auto collect = [&points](size_t head) {
+        std::vector<std::pair<size_t, double>> result;
+        for (size_t i = head; i != NOT_FOUND; i = points[i].next) {
+            result.emplace_back(i, points[i].dist);
+        }
+        return result;
+    };
+    for (auto const& oracle : queries) {
+        auto const expected = collect(tree.inRange(oracle.query, distance));
+        EXPECT_EQ(collect(tree.inRange(oracle.query, distance, context)), expected);
+    }
+    // consecutive points in tree order are close, so most of these queries reuse the
+    // leaves cached by an earlier one
+    for (size_t i = 0; i < points.size(); i += 7) {
+        for (double d : {distance, 0.25 * distance}) {
+            auto const expected = collect(tree.inRange(points[i].v, d));
+            EXPECT_EQ(collect(tree.inRange(points[i].v, d, context)), expected);
+        }
+    }
+    context.clear();
+    auto const expected = collect(tree.inRange(points[0].v, distance));
+    EXPECT_EQ(collect(tree.inRange(points[0].v, distance, context)), expected);
+}
+
+// Checks that mixed precision queries return the same points, distances and order
+// as double precision queries, including for points within a few ulps of the query
+// radius
+TEST(TreeTest, MixedPrecision) {
+    std::mt19937_64 rng(1234);
+    std::uniform_real_distribution<double> angle{0.0, 360.0};
+    std::vector<Vec3> queries;
+    std::vector<Point> points;
+    std::vector<double> const radii = {1.0 / 3600.0, 30.0 / 3600.0, 1.0};
+    for (int i = 0; i < 3000; ++i) {
+        LonLat const q = LonLat::random(rng);
+        queries.push_back(q);
+        // points at angular distances within a relative 1e-12 of each radius
+        for (double radius : radii) {
+            Vec3 const n = NorthOf(q);
+            Vec3 const e = EastOf(q);
+            for (int k = -4; k <= 4; ++k) {
+                double const pa = RAD_PER_DEG * angle(rng);
+                double const a = RAD_PER_DEG * radius * (1.0 + k * 1e-12);
+                Vec3 const t = std::sin(pa) * e + std::cos(pa) * n;
+                points.emplace_back().v = std::cos(a) * Vec3{q} + std::sin(a) * t;
+            }
+        }
+    }
+    for (int i = 0; i < 50000; ++i) {
+        points.emplace_back().v = LonLat::random(rng);
+    }
+    Tree tree{points.data(), points.size(), 16, 0.0};
+    auto collect = [&points](size_t head) {
+        std::vector<std::pair<size_t, double>> result;
+        for (size_t i = head; i != NOT_FOUND; i = points[i].next) {
+            result.emplace_back(i, points[i].dist);
+        }
+        return result;
+    };
+    // queries, each with the radius of a circle of one of the radii, and if there is
+    // one, with the exact distance to a point close to that circle
+    std::vector<std::pair<Vec3, double>> ranges;
+    for (double radius : radii) {
+        double const dist = SquaredEuclidianDistance(radius);
+        for (Vec3 const& q : queries) {
+            ranges.emplace_back(q, dist);
+            for (size_t i = tree.inRange(q, dist); i != NOT_FOUND; i = points[i].next) {
+                if (points[i].dist > 0.5 * dist) {
+                    ranges.emplace_back(q, points[i].dist);
+                    break;
+                }
+            }
+        }
+    }
+    size_t const numBoundary = ranges.size() - radii.size() * queries.size();
+    std::vector<std::vector<std::pair<size_t, double>>> expected;
+    for (auto const& [q, dist] : ranges) {
+        expected.push_back(collect(tree.inRange(q, dist)));
+    }
+    tree.setMixedPrecision(true);
+    ASSERT_TRUE(tree.mixedPrecision());
+    for (size_t r = 0; r < ranges.size(); ++r) {
+        auto const& [q, dist] = ranges[r];
+        ASSERT_EQ(collect(tree.inRange(q, dist)), expected[r]);
+    }
+    EXPECT_GT(numBoundary, queries.size());
+}
+
+TEST(TreeTest, LeafEnds) {
+    std::vector<Point> points;
+    std::vector<MatchOracle> queries;
+    MakeTestPoints(points, queries);
+    Tree tree{points.data(), points.size(), 32, 0.0};
+    std::vector<size_t> const ends = tree.leafEnds();
+    ASSERT_EQ(ends.size(), static_cast<size_t>(1) << tree.height());
+    EXPECT_TRUE(std::is_sorted(ends.begin(), ends.end()));
+    EXPECT_GT(ends.front(), 0);
+    EXPECT_EQ(ends.back(), points.size());
+    // median splits leave at most one point more than the target in each leaf
+    for (size_t i = 1; i < ends.size(); ++i) {
+        EXPECT_LE(ends[i] - ends[i - 1], 33);
+    }
+}
+
+TEST(TreeTest, NodeLayout) {
+    for (size_t numLevels : {1, 2, 5, 12}) {
+        for (size_t blockHeight = 0; blockHeight <= 6; ++blockHeight) {
+            NodeLayout const layout{numLevels, blockHeight};
+            size_t const numNodes = (static_cast<size_t>(1) << numLevels) - 1;
+            ASSERT_GE(layout.size(), numNodes);
+            std::vector<size_t> positions;
+            for (size_t i = 0; i < numNodes; ++i) {
+                positions.push_back(layout.position(i));
+            }
+            std::sort(positions.begin(), positions.end());
+            EXPECT_EQ(std::adjacent_find(positions.begin(), positions.end()),
+                      positions.end());
+            EXPECT_LT(positions.back(), layout.size());
+        }
+    }
+    // children of the root of a block are in the same cache line
+    NodeLayout const layout{20, 2};
+    for (size_t i : {0, 3, 4, 100, 4100}) {
+        EXPECT_EQ(layout.position(i) / 4, layout.position(2 * i + 1) / 4) << i;
+        EXPECT_EQ(layout.position(i) / 4, layout.position(2 * i + 2) / 4) << i;
+        EXPECT_EQ(layout.position(i) % 4, 0);
+    }
+}
+
+// Checks that queries return the same results in the same order for every node
+// layout, including after switching back to breadth first order.
+TEST(TreeTest, SetNodeLayout) {
+    std::vector<Point> points;
+    std::vector<MatchOracle> queries;
+    double const distance = SquaredEuclidianDistance(TestRadius);
+    MakeTestPoints(points, queries);
+    Tree tree{points.data(), points.size(), 8, 0.0};
+    auto query = [&](Vec3 const& v) {
+        std::vector<std::pair<size_t, double>> results;
+        for (size_t i = tree.inRange(v, distance); i != NOT_FOUND; i = points[i].next) {
+            results.emplace_back(i, points[i].dist);
+        }
+        return results;
+    };
+    std::vector<std::vector<std::pair<size_t, double>>> expected;
+    for (auto const& oracle : queries) {
+        expected.push_back(query(oracle.query));
+    }
+    std::vector<size_t> const ends = tree.leafEnds();
+    for (size_t blockHeight : {1, 2, 3, 4, 8, 0}) {
+        tree.setNodeLayout(blockHeight);
+        EXPECT_EQ(tree.nodeLayout().blockHeight(), blockHeight);
+        EXPECT_EQ(tree.leafEnds(), ends);
+        TreeReplicas replicas{tree};
+        for (size_t q = 0; q < queries.size(); ++q) {
+            ASSERT_EQ(query(queries[q].query), expected[q]);
+            std::vector<std::pair<size_t, double>> visited;
+            replicas.visitRange(0, queries[q].query, distance, [&](size_t i, double d) {
+                visited.emplace_back(i, d);
+            });
+            ASSERT_EQ(visited, expected[q]);
+        }
+    }
+}
+
+// Checks that the points of every node lie on the correct side of the splits of its
+// ancestors. Returns the point ranges of the leaves, in order.
+std::vector<std::pair<size_t, size_t>> CheckTree(Tree const& tree) {
+    NodeView const nodes = tree.nodes();
+    Point const* points = tree.getPoints();
+    std::vector<std::pair<size_t, size_t>> leaves;
+    std::vector<size_t> stack = {0};
+    while (!stack.empty()) {
+        size_t const node = stack.back();
+        stack.pop_back();
+        size_t const left = (node & (node + 1)) != 0 ? nodes[node - 1].right() : 0;
+        size_t const right = nodes[node].right();
+        EXPECT_LE(left, right);
+        if (nodes[node].isLeaf()) {
+            leaves.emplace_back(left, right);
+            continue;
+        }
+        Node const& n = nodes[node];
+        size_t const median = nodes[(node << 1) + 1].right();
+        EXPECT_EQ(median, left + (right - left) / 2);
+        for (size_t i = left; i < right; ++i) {
+            double const x = points[i].v.coords[n.splitDim()];
+            if (i < median) {
+                EXPECT_LE(x, n.split);
+            } else {
+                EXPECT_GE(x, n.split);
+            }
+        }
+        stack.push_back((node << 1) + 2);
+        stack.push_back((node << 1) + 1);
+    }
+    return leaves;
+}
+
+// Checks that the presorted builder produces the same tree as the default builder,
+// with the same points in each leaf, for distinct points, clumps of points stopping
+// subdivision early, and duplicate coordinates.
+TEST(TreeTest, PresortedBuilder) {
+    std::mt19937_64 rng(1234);
+    std::vector<Point> points;
+    for (int i = 0; i < 20000; ++i) {
+        points.emplace_back().v = LonLat::random(rng);
+    }
+    for (int c = 0; c < 20; ++c) {
+        LonLat const center = LonLat::random(rng);
+        for (int i = 0; i < 500; ++i) {
+            points.emplace_back().v = center.perturb(rng, 0.0001);
+        }
+    }
+    for (size_t i = 0; i < points.size(); ++i) {
+        points[i].state = i;
+    }
+    for (double threshold : {0.0, 1e-5}) {
+        for (size_t pointsPerLeaf : {1, 7, 32, 100000}) {
+            std::vector<Point> expectedPoints = points;
+            Tree const expected{expectedPoints.data(), expectedPoints.size(),
+                                pointsPerLeaf, threshold};
+            std::vector<Point> actualPoints = points;
+            Tree const actual{actualPoints.data(), actualPoints.size(), pointsPerLeaf,
+                              threshold, TreeBuilder::PRESORTED};
+            ASSERT_EQ(actual.numNodes(), expected.numNodes());
+            auto const leaves = CheckTree(actual);
+            ASSERT_EQ(leaves, CheckTree(expected));
+            for (size_t node = 0; node < expected.numNodes(); ++node) {
+                Node const& a = actual.nodes()[node];
+                Node const& e = expected.nodes()[node];
+                ASSERT_EQ(a.metadata, e.metadata);
+                if (!e.isLeaf()) {
+                    ASSERT_EQ(a.split, e.split);
+                }
+            }
+            for (auto [left, right] : leaves) {
+                std::vector<size_t> a;
+                std::vector<size_t> b;
+                for (size_t i = left; i < right; ++i) {
+                    a.push_back(actualPoints[i].state);
+                    b.push_back(expectedPoints[i].state);
+                }
+                std::sort(a.begin(), a.end());
+                std::sort(b.begin(), b.end());
+                ASSERT_EQ(a, b);
+            }
+        }
+    }
+    // many duplicates: sides of splits may differ, but trees must be valid
+    std::vector<Point> duplicates(5000);
+    for (size_t i = 0; i < duplicates.size(); ++i) {
+        duplicates[i].v = points[i % 7].v;
+    }
+    Tree const tree{duplicates.data(), duplicates.size(), 4, 0.0,
+                    TreeBuilder::PRESORTED};
+    size_t end = 0;
+    for (auto [left, right] : CheckTree(tree)) {
+        EXPECT_EQ(left, end);
+        end = right;
+    }
+    EXPECT_EQ(end, duplicates.size());
+}
+
+// Checks that a tree over columns finds the same points as a Tree over copies of them,
+// and has the same structure.
+TEST(TreeTest, ColumnarPoints) {
+    std::vector<Point> points;
+    std::vector<MatchOracle> queries;
+
+    double const distance = SquaredEuclidianDistance(TestRadius);
+    MakeTestPoints(points, queries);
+    size_t const n = points.size();
+    std::vector<double> x(n);
+    std::vector<double> y(n);
+    std::vector<double> z(n);
+    std::vector<uint32_t> ids(n);
+    std::vector<double> dist(n);
+    std::vector<size_t> next(n);
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = points[i].v.x();
+        y[i] = points[i].v.y();
+        z[i] = points[i].v.z();
+        ids[i] = static_cast<uint32_t>(points[i].state);
+    }
+    std::vector<Point> const original = points;
+    ColumnarPoints columns;
+    columns.coords = {x.data(), y.data(), z.data()};
+    columns.dist = dist.data();
+    columns.next = next.data();
+    columns.payload.push_back({ids.data(), sizeof(uint32_t)});
+    BasicTree<ColumnarTraits> tree{columns, n, 32, 0.0};
+    Tree const expected{points.data(), n, 32, 0.0};
+    std::vector<Point> copy = original;
+    BasicTree<PointTraits> const generic{copy.data(), n, 32, 0.0};
+
+    // rows were reordered in place, keeping their payload
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(Vec3(x[i], y[i], z[i]), original[ids[i]].v);
+    }
+    ASSERT_EQ(tree.numNodes(), expected.numNodes());
+    ASSERT_EQ(generic.numNodes(), expected.numNodes());
+    for (size_t node = 0; node < expected.numNodes(); ++node) {
+        Node const& e = expected.nodes()[node];
+        for (Node const& a : {tree.nodes()[node], generic.nodes()[node]}) {
+            ASSERT_EQ(a.metadata, e.metadata);
+            if (!e.isLeaf()) {
+                ASSERT_EQ(a.split, e.split);
+            }
+        }
+    }
+    std::vector<size_t> matches;
+    for (auto const& oracle : queries) {
+        matches.clear();
+        for (size_t i = tree.inRange(oracle.query, distance); i != NOT_FOUND;
+             i = next[i]) {
+            Vec3 const v{x[i], y[i], z[i]};
+            EXPECT_EQ(dist[i], SquaredEuclidianDistance(oracle.query, v));
+            matches.push_back(ids[i]);
+        }
+        EXPECT_THAT(matches,
+                    testing::UnorderedElementsAreArray(oracle.expectedMatches));
+        matches.clear();
+        tree.visitRange(oracle.query, distance,
+                        [&](size_t i, double) { matches.push_back(ids[i]); });
+        EXPECT_THAT(matches,
+                    testing::UnorderedElementsAreArray(oracle.expectedMatches));
+    }
+    EXPECT_THROW((BasicTree<ColumnarTraits>{columns, 0, 32, 0.0}),
+                 std::invalid_argument);
+}
+
 }  // namespace
 }  // namespace optics
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include "Numa.h"
+#include "Parallel.h"
+
+namespace optics {
+
+// A disjoint set forest over [0, n) that any number of threads may update and query
+// concurrently without locks.
+//
+// Sets are linked by index rather than by rank: the root of a set is always its
+// smallest element, and unite() links the larger of two roots below the smaller one
+// with a compare-and-swap, retrying if either root has been linked in the meantime.
+// Since parent indexes only ever decrease, the forest stays acyclic under concurrent
+// updates. find() halves paths as it goes, which keeps trees shallow without a rank.
+class UnionFind {
+   public:
+    // Creates n singleton sets, initializing the parents with `numThreads` threads (0
+    // means all hardware threads).
+    explicit UnionFind(size_t n, size_t numThreads = 0)
+        : parents_{n, MemoryPlacement::FIRST_TOUCH, numThreads}, size_{n} {
+        std::atomic<size_t>* const parents = parents_.data();
+        ParallelFor(n, numThreads, [parents](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                parents[i].store(i, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    size_t size() const { return size_; }
+
+    // Returns the smallest element of the set containing i.
+    size_t find(size_t i) {
+        while (true) {
+            size_t parent = parents_[i].load(std::memory_order_relaxed);
+            if (parent == i) {
+                return i;
+            }
+            size_t const grandparent = parents_[parent].load(std::memory_order_relaxed);
+            if (grandparent == parent) {
+                return parent;
+            }
+            // path halving: failing to shorten the path is harmless
+            parents_[i].compare_exchange_weak(parent, grandparent,
+                                              std::memory_order_relaxed);
+            i = grandparent;
+        }
+    }
+
+    // Merges the sets containing i and j.
+    void unite(size_t i, size_t j) {
+        while (true) {
+            i = find(i);
+            j = find(j);
+            if (i == j) {
+                return;
+            }
+            if (i < j) {
+                std::swap(i, j);
+            }
+            // i is the larger root: link it below j, unless it stopped being a root
+            size_t expected = i;
+            if (parents_[i].compare_exchange_strong(expected, j,
+                                                    std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+   private:
+    NumaArray<std::atomic<size_t>> parents_;
+    size_t size_;
+};
+
+}  // namespace optics
@@ -0,0 +1,75 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Parallel.h"
+#include "UnionFind.h"
+
+namespace optics {
+namespace {
+
+// Returns the smallest element of the set containing each element, given by a
+// sequential disjoint set forest over the same links.
+std::vector<size_t> ExpectedRoots(size_t n,
+                                  std::vector<std::pair<size_t, size_t>> const& links) {
+    std::vector<size_t> parents(n);
+    std::iota(parents.begin(), parents.end(), 0);
+    auto find = [&](size_t i) {
+        while (parents[i] != i) {
+            i = parents[i];
+        }
+        return i;
+    };
+    for (auto [i, j] : links) {
+        i = find(i);
+        j = find(j);
+        parents[std::max(i, j)] = std::min(i, j);
+    }
+    std::vector<size_t> roots(n);
+    for (size_t i = 0; i < n; ++i) {
+        roots[i] = find(i);
+    }
+    return roots;
+}
+
+TEST(UnionFindTest, ConcurrentUnite) {
+    size_t const n = 100000;
+    std::mt19937_64 rng(1234);
+    std::uniform_int_distribution<size_t> pick{0, n - 1};
+    std::vector<std::pair<size_t, size_t>> links;
+    // chains of consecutive elements, which make deep trees, and random links
+    for (size_t i = 0; i + 1 < n; ++i) {
+        if (i % 1000 != 999) {
+            links.emplace_back(i + 1, i);
+        }
+    }
+    for (int k = 0; k < 50; ++k) {
+        links.emplace_back(pick(rng), pick(rng));
+    }
+    std::shuffle(links.begin(), links.end(), rng);
+    std::vector<size_t> const expected = ExpectedRoots(n, links);
+    for (size_t numThreads : {1, 4}) {
+        UnionFind sets{n, numThreads};
+        EXPECT_EQ(sets.size(), n);
+        ParallelFor(links.size(), numThreads, [&](size_t, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                sets.unite(links[k].first, links[k].second);
+            }
+        });
+        std::vector<size_t> roots(n);
+        ParallelFor(n, numThreads, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                roots[i] = sets.find(i);
+            }
+        });
+        EXPECT_EQ(roots, expected);
+    }
+}
+
+}  // namespace
+}  // namespace optics